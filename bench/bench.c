@@ -0,0 +1,789 @@
+/*
+Description:
+- Benchmark and synthetic dataset generator for the banking system.
+- Operations go through libbank, the same calls the menus make, just without the prompts.
+- Each run builds a fresh database of 10k, 100k and 1M accounts (or --accounts=...) in a temporary directory.
+  It times account lookup, deposit, withdrawal, transfer, account creation and deletion on it, then removes it.
+- Databases can be generated in the current binary store format (loaded through batch mode) or in the old
+  one-text-file-per-account format, which is then imported the way a first start would import it. Either way
+  the operations are timed through libbank.
+- --format=v1 is the reference: the old text files, with every operation timed through a copy of the original v1
+  menu's file code (index.txt scans, fscanf/fprintf of the account file, float balances), prompts left out.
+- Build: gcc bench/bench.c plus every .c file of libbank/ with -Ilibbank -o bench/bench.exe -lpthread (see README)
+- Run:   ./bench/bench.exe [--accounts=N[,N...]] [--ops=N] [--format=store|legacy|v1] [--durability=none|batch|op]
+                           [--seed=N] [--keep] [--threads=N]
+- With --threads=N, deposits and transfers are also timed from N threads at once, through the sharded engine.
+- Only generate a database: ./bench/bench.exe --generate=<dir> --accounts=N [--format=store|legacy]
+*/
+
+#define _GNU_SOURCE // nftw
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ftw.h>
+#include <pthread.h>
+
+#include "bank.h"
+
+#define BENCH_DEFAULT_OPS 10000
+#define BENCH_MAX_SIZES 8
+#define BENCH_BASELINE_SCAN 20000000 // index.txt lines the v1 reference may scan per operation type
+
+enum BenchFormat {
+    BENCH_FORMAT_STORE, // accounts.dat loaded through bankRunBatch
+    BENCH_FORMAT_LEGACY, // database/<accountNumber>.txt files plus index.txt, imported by bankOpen
+    BENCH_FORMAT_V1      // the same files, used directly by the original v1 code below
+};
+
+struct BenchResult {
+    size_t ops;
+    size_t failed;
+    double seconds;
+    double p50; // microseconds
+    double p99;
+};
+
+// accounts of the generated database, in store order
+struct BenchAccounts {
+    size_t count;
+    char (*numbers)[13];
+    char *savings; // 1 for a savings account, 0 for current
+};
+
+struct Bank *bank;
+struct BenchAccounts benchAccounts = { 0, NULL, NULL };
+uint64_t benchRandomState = 88172645463325252ull;
+size_t benchNextId = 0; // makes generated IDs and names unique
+
+// xorshift64, so runs with the same --seed touch the same accounts
+uint64_t benchNextRandom(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+uint64_t benchRandom() {
+    return benchNextRandom(&benchRandomState);
+}
+
+double benchNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// a new random account, numbered later by bankCreate or benchGenerateLegacy
+void benchFillAccount(struct Account *account) {
+    memset(account, 0, sizeof(*account));
+    size_t id = benchNextId++;
+    sprintf(account->name, "Bench Customer %zu", id);
+    sprintf(account->ID, "%012llu", 100000000000ull + id);
+    strcpy(account->type, id % 2 == 0 ? "Savings" : "Current");
+    sprintf(account->pin, "%04u", (unsigned)(benchRandom() % 10000));
+    account->balance = (int64_t)(benchRandom() % 10000000); // up to RM 100,000
+}
+
+// --- timed operations, 'i' is the iteration number ---
+typedef int (*BenchOperation)(size_t i);
+
+const char *benchPick() {
+    return benchAccounts.numbers[benchRandom() % benchAccounts.count];
+}
+
+int benchLookup(size_t i) {
+    (void)i;
+    return bankLookup(bank, benchPick(), NULL) == BANK_OK;
+}
+
+int benchDeposit(size_t i) {
+    (void)i;
+    return bankDeposit(bank, benchPick(), 100, NULL) == BANK_OK;
+}
+
+int benchWithdraw(size_t i) {
+    (void)i;
+    return bankWithdraw(bank, benchPick(), 100, NULL) == BANK_OK;
+}
+
+int benchTransferFrom(uint64_t *state) {
+    size_t sender = benchNextRandom(state) % benchAccounts.count, receiver;
+    // remittance only goes between a savings and a current account
+    do {
+        receiver = benchNextRandom(state) % benchAccounts.count;
+    } while (benchAccounts.savings[receiver] == benchAccounts.savings[sender]);
+
+    return bankTransfer(bank, benchAccounts.numbers[sender], benchAccounts.numbers[receiver], 100, NULL, NULL) == BANK_OK;
+}
+
+int benchTransfer(size_t i) {
+    (void)i;
+    return benchTransferFrom(&benchRandomState);
+}
+
+int benchCreate(size_t i) {
+    (void)i;
+    struct Account account;
+    benchFillAccount(&account);
+    return bankCreate(bank, &account) == BANK_OK;
+}
+
+// deletes walk the accounts in the shuffled order left by benchShuffle, so none is deleted twice
+int benchDelete(size_t i) {
+    return bankDelete(bank, benchAccounts.numbers[i]) == BANK_OK;
+}
+
+// run 'operation' 'ops' times and collect its throughput and latency percentiles
+struct BenchResult benchRun(BenchOperation operation, size_t ops) {
+    struct BenchResult result = { ops, 0, 0, 0, 0 };
+    double *latencies = malloc((ops > 0 ? ops : 1) * sizeof(double));
+    if (latencies == NULL) return result;
+
+    double started = benchNow();
+    for (size_t i = 0; i < ops; i++) {
+        double before = benchNow();
+        if (!operation(i)) result.failed++;
+        latencies[i] = (benchNow() - before) * 1e6;
+    }
+    result.seconds = benchNow() - started;
+
+    if (ops > 0) {
+        qsort(latencies, ops, sizeof(double), compareDoubles);
+        result.p50 = latencies[ops / 2];
+        result.p99 = latencies[(size_t)(ops * 0.99)];
+    }
+    free(latencies);
+    return result;
+}
+
+// --- v1 reference ---
+// the file handling of the original v1 menu, kept as it was (float balances included) apart from the prompts
+// and messages, so --format=v1 times what the libbank numbers are compared against
+void baselineLog(const char *message) {
+    FILE *transactionLog = fopen("database/transaction.log", "a");
+    if (transactionLog == NULL) return;
+    time_t t = time(NULL);
+    char *timeStr = ctime(&t);
+    timeStr[strcspn(timeStr, "\n")] = 0;
+    fprintf(transactionLog, "[%s] %s\n", timeStr, message);
+    fclose(transactionLog);
+}
+
+int baselineInIndex(const char *accNum) {
+    FILE *indexFile = fopen("database/index.txt", "r");
+    if (!indexFile) return 0;
+    char number[13];
+    int found = 0;
+    while (fscanf(indexFile, "%12s", number) == 1) {
+        if (strcmp(number, accNum) == 0) {
+            found = 1;
+            break;
+        }
+    }
+    fclose(indexFile);
+    return found;
+}
+
+// verifyAccount() without the prompts: the number is looked up in index.txt and the account file is read
+int baselineVerify(const char *accountNumber) {
+    if (!baselineInIndex(accountNumber)) return 0;
+    char filename[128];
+    sprintf(filename, "database/%s.txt", accountNumber);
+    FILE *accFile = fopen(filename, "r");
+    if (!accFile) return 0;
+    char storedName[100], storedPIN[5], storedID[13], typeStr[20], storedAccNum[13];
+    float balance;
+    fscanf(accFile, "Name: %[^\n]\n", storedName);
+    fscanf(accFile, "ID: %12s\n", storedID);
+    fscanf(accFile, "Account Number: %12s\n", storedAccNum);
+    fscanf(accFile, "Account Type: %[^\n]\n", typeStr);
+    fscanf(accFile, "PIN: %4s\n", storedPIN);
+    fscanf(accFile, "Balance: %f\n", &balance);
+    fclose(accFile);
+    return 1;
+}
+
+float baselineBalance(const char *accountNumber) {
+    char filename[128];
+    sprintf(filename, "database/%s.txt", accountNumber);
+    FILE *accFile = fopen(filename, "r");
+    if (!accFile) return -1;
+    char line[256];
+    float balance = -1;
+    while (fgets(line, sizeof(line), accFile)) {
+        if (strstr(line, "Balance:") != NULL) {
+            sscanf(line, "Balance: %f", &balance);
+            break;
+        }
+    }
+    fclose(accFile);
+    return balance;
+}
+
+int baselineUpdate(char operation, float amount, const char *accountNumber, const char *receiverType) {
+    char filename[128];
+    sprintf(filename, "database/%s.txt", accountNumber);
+    FILE *accFile = fopen(filename, "r+");
+    if (!accFile) return 0;
+
+    char name[100], ID[13], number[13], type[10], pin[5];
+    float balance;
+    fscanf(accFile, "Name: %[^\n]\n", name);
+    fscanf(accFile, "ID: %12s\n", ID);
+    fscanf(accFile, "Account Number: %12s\n", number);
+    fscanf(accFile, "Account Type: %[^\n]\n", type);
+    fscanf(accFile, "PIN: %4s\n", pin);
+    fscanf(accFile, "Balance: %f\n", &balance);
+
+    float fee = 0.0;
+    if (operation == '+') {
+        if (!(amount > 0 && amount <= 50000)) {
+            fclose(accFile);
+            return 0;
+        }
+        balance += amount;
+    } else {
+        if (receiverType != NULL) {
+            if (strcmp(type, "Savings") == 0 && strcmp(receiverType, "Current") == 0) {
+                fee = 0.02;
+            } else if (strcmp(type, "Current") == 0 && strcmp(receiverType, "Savings") == 0) {
+                fee = 0.03;
+            } else {
+                fclose(accFile);
+                return 0;
+            }
+        }
+        float totalAmount = amount + (amount * fee);
+        if (totalAmount > balance) {
+            fclose(accFile);
+            return 0;
+        }
+        balance -= totalAmount;
+    }
+
+    rewind(accFile);
+    fprintf(accFile, "Name: %s\n", name);
+    fprintf(accFile, "ID: %s\n", ID);
+    fprintf(accFile, "Account Number: %s\n", number);
+    fprintf(accFile, "Account Type: %s\n", type);
+    fprintf(accFile, "PIN: %s\n", pin);
+    fprintf(accFile, "Balance: %.2f\n", balance);
+    fclose(accFile);
+    return 1;
+}
+
+int baselineLookup(size_t i) {
+    (void)i;
+    return baselineVerify(benchPick());
+}
+
+int baselineDeposit(size_t i) {
+    (void)i;
+    const char *accountNumber = benchPick();
+    if (!baselineVerify(accountNumber) || !baselineUpdate('+', 1.0f, accountNumber, NULL)) return 0;
+    if (baselineBalance(accountNumber) >= 0) baselineLog("Deposited RM 1.00");
+    return 1;
+}
+
+int baselineWithdraw(size_t i) {
+    (void)i;
+    const char *accountNumber = benchPick();
+    if (!baselineVerify(accountNumber)) return 0;
+    baselineBalance(accountNumber);
+    if (!baselineUpdate('-', 1.0f, accountNumber, NULL)) return 0;
+    if (baselineBalance(accountNumber) >= 0) baselineLog("Withdrew RM 1.00");
+    return 1;
+}
+
+int baselineTransfer(size_t i) {
+    (void)i;
+    size_t sender = benchRandom() % benchAccounts.count, receiver;
+    do {
+        receiver = benchRandom() % benchAccounts.count;
+    } while (benchAccounts.savings[receiver] == benchAccounts.savings[sender]);
+    const char *from = benchAccounts.numbers[sender], *to = benchAccounts.numbers[receiver];
+    if (!baselineVerify(from) || !baselineInIndex(to)) return 0;
+    baselineBalance(from);
+
+    // the receiver's type is read from its file
+    char filename[128], receiverType[10], line[256];
+    sprintf(filename, "database/%s.txt", to);
+    FILE *file = fopen(filename, "r");
+    if (!file) return 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (strstr(line, "Account Type:") != NULL) {
+            sscanf(line, "Account Type: %9[^\n]", receiverType);
+            break;
+        }
+    }
+    fclose(file);
+    if (!baselineUpdate('-', 1.0f, from, receiverType) || !baselineUpdate('+', 1.0f, to, NULL)) return 0;
+    baselineLog("Transfer");
+    return 1;
+}
+
+int baselineCreate(size_t i) {
+    (void)i;
+    struct Account account;
+    benchFillAccount(&account);
+    // v1 reseeded from the clock on every create and drew until index.txt didn't have the number
+    srand(time(NULL));
+    int accountNumberInt;
+    char tempAccNum[13];
+    do {
+        int min = 1000000;
+        int max = 999999999;
+        accountNumberInt = min + rand() % (max + 1 - min);
+        sprintf(tempAccNum, "%d", accountNumberInt);
+    } while (baselineInIndex(tempAccNum));
+    sprintf(account.accountNumber, "%d", accountNumberInt);
+
+    FILE *indexFile = fopen("database/index.txt", "a");
+    if (indexFile == NULL) return 0;
+    fprintf(indexFile, "%s\n", account.accountNumber);
+    fclose(indexFile);
+
+    char filename[100];
+    sprintf(filename, "database/%s.txt", account.accountNumber);
+    FILE *accFile = fopen(filename, "w");
+    if (accFile == NULL) return 0;
+    fprintf(accFile, "Name: %s\n", account.name);
+    fprintf(accFile, "ID: %s\n", account.ID);
+    fprintf(accFile, "Account Number: %s\n", account.accountNumber);
+    fprintf(accFile, "Account Type: %s\n", account.type);
+    fprintf(accFile, "PIN: %s\n", account.pin);
+    fprintf(accFile, "Balance: %.2f\n", 0.0f);
+    fclose(accFile);
+    baselineLog("Created account");
+    return 1;
+}
+
+// the account file is removed and index.txt is copied without it
+int baselineDelete(size_t i) {
+    const char *accountNumber = benchAccounts.numbers[i];
+    if (!baselineVerify(accountNumber)) return 0;
+    char filename[128];
+    sprintf(filename, "database/%s.txt", accountNumber);
+    if (remove(filename) != 0) return 0;
+
+    FILE *indexRead = fopen("database/index.txt", "r");
+    if (!indexRead) return 0;
+    FILE *indexTemp = fopen("database/temp_index.txt", "w");
+    if (!indexTemp) {
+        fclose(indexRead);
+        return 0;
+    }
+    char number[13];
+    while (fscanf(indexRead, "%12s", number) == 1) {
+        if (strcmp(number, accountNumber) != 0) fprintf(indexTemp, "%s\n", number);
+    }
+    fclose(indexRead);
+    fclose(indexTemp);
+    if (remove("database/index.txt") != 0 || rename("database/temp_index.txt", "database/index.txt") != 0) return 0;
+    baselineLog("Deleted account");
+    return 1;
+}
+
+// the generated accounts for the v1 reference, read back from index.txt and the account files
+int baselineLoadAccounts(size_t count) {
+    free(benchAccounts.numbers);
+    free(benchAccounts.savings);
+    benchAccounts.count = 0;
+    benchAccounts.numbers = malloc((count + 1) * sizeof(*benchAccounts.numbers));
+    benchAccounts.savings = malloc(count + 1);
+    FILE *indexFile = fopen("database/index.txt", "r");
+    if (benchAccounts.numbers == NULL || benchAccounts.savings == NULL || indexFile == NULL) {
+        if (indexFile != NULL) fclose(indexFile);
+        return 0;
+    }
+    while (benchAccounts.count < count && fscanf(indexFile, "%12s", benchAccounts.numbers[benchAccounts.count]) == 1) {
+        char filename[128], line[256];
+        sprintf(filename, "database/%s.txt", benchAccounts.numbers[benchAccounts.count]);
+        FILE *accFile = fopen(filename, "r");
+        if (accFile == NULL) break;
+        benchAccounts.savings[benchAccounts.count] = 0;
+        while (fgets(line, sizeof(line), accFile)) {
+            if (strncmp(line, "Account Type: Savings", 21) == 0) benchAccounts.savings[benchAccounts.count] = 1;
+        }
+        fclose(accFile);
+        benchAccounts.count++;
+    }
+    fclose(indexFile);
+    return benchAccounts.count == count;
+}
+
+// --- concurrent runs ---
+struct BenchThread {
+    pthread_t thread;
+    int transfer;   // transfers instead of deposits
+    size_t ops;
+    size_t failed;
+    uint64_t random; // each thread has its own generator
+    double *latencies;
+};
+
+void *benchThread(void *arg) {
+    struct BenchThread *thread = arg;
+    for (size_t i = 0; i < thread->ops; i++) {
+        double before = benchNow();
+        int ok = thread->transfer
+                     ? benchTransferFrom(&thread->random)
+                     : bankDeposit(bank, benchAccounts.numbers[benchNextRandom(&thread->random) % benchAccounts.count],
+                                   100, NULL) == BANK_OK;
+        if (!ok) thread->failed++;
+        thread->latencies[i] = (benchNow() - before) * 1e6;
+    }
+    return NULL;
+}
+
+// like benchRun, with 'ops' deposits or transfers spread over 'threads' threads sharing the handle
+struct BenchResult benchRunThreads(int transfer, size_t ops, int threads) {
+    struct BenchResult result = { 0, 0, 0, 0, 0 };
+    struct BenchThread *workers = calloc((size_t)threads, sizeof(struct BenchThread));
+    double *latencies = malloc((ops > 0 ? ops : 1) * sizeof(double));
+    if (workers == NULL || latencies == NULL) {
+        free(workers);
+        free(latencies);
+        return result;
+    }
+
+    double started = benchNow();
+    int running = 0;
+    for (; running < threads; running++) {
+        struct BenchThread *worker = &workers[running];
+        worker->transfer = transfer;
+        worker->ops = ops / (size_t)threads;
+        worker->random = benchRandom() | 1;
+        worker->latencies = latencies + result.ops;
+        if (pthread_create(&worker->thread, NULL, benchThread, worker) != 0) break;
+        result.ops += worker->ops;
+    }
+    for (int i = 0; i < running; i++) {
+        pthread_join(workers[i].thread, NULL);
+        result.failed += workers[i].failed;
+    }
+    result.seconds = benchNow() - started;
+
+    if (result.ops > 0) {
+        qsort(latencies, result.ops, sizeof(double), compareDoubles);
+        result.p50 = latencies[result.ops / 2];
+        result.p99 = latencies[(size_t)(result.ops * 0.99)];
+    }
+    free(latencies);
+    free(workers);
+    return result;
+}
+
+// one table row, whole-run timings like 'generate' have no per-operation latencies
+void benchReport(const char *name, struct BenchResult result) {
+    printf("%-12s %10zu %8zu %12.0f", name, result.ops, result.failed,
+           result.seconds > 0 ? result.ops / result.seconds : 0.0);
+    if (result.p99 > 0) {
+        printf(" %10.2f %10.2f\n", result.p50, result.p99);
+    } else {
+        printf(" %10s %10s\n", "-", "-");
+    }
+}
+
+// --- dataset generation ---
+// write 'count' accounts in the old format: one database/<accountNumber>.txt per account and index.txt
+int benchGenerateLegacy(size_t count) {
+    FILE *indexFile = fopen("database/index.txt", "w");
+    if (indexFile == NULL) return 0;
+
+    for (size_t i = 0; i < count; i++) {
+        struct Account account;
+        benchFillAccount(&account);
+        // the old generator handed out random 7-9 digit numbers, a spread out sequence is close enough
+        sprintf(account.accountNumber, "%zu", (size_t)1000000 + i * 37);
+
+        char filename[128], text[ACCOUNT_TEXT_SIZE];
+        sprintf(filename, "database/%s.txt", account.accountNumber);
+        FILE *accFile = fopen(filename, "w");
+        if (accFile == NULL) {
+            fclose(indexFile);
+            return 0;
+        }
+        fwrite(text, 1, formatAccountText(&account, text), accFile);
+        fclose(accFile);
+        fprintf(indexFile, "%s\n", account.accountNumber);
+    }
+    fclose(indexFile);
+    return 1;
+}
+
+// write a batch file that creates 'count' accounts, and once they are numbered one that gives them their balances.
+// 'results' is the result file of the first batch, NULL to write the first one
+int benchWriteBatch(const char *path, size_t count, const char *results) {
+    FILE *batch = fopen(path, "w");
+    if (batch == NULL) return 0;
+    FILE *created = results != NULL ? fopen(results, "r") : NULL;
+    if (results != NULL && created == NULL) {
+        fclose(batch);
+        return 0;
+    }
+
+    char line[128];
+    for (size_t i = 0; i < count; i++) {
+        struct Account account;
+        benchFillAccount(&account);
+        if (created == NULL) {
+            fprintf(batch, "create %s %s %s %s\n", account.type, account.ID, account.pin, account.name);
+            continue;
+        }
+        // "<line> OK <accountNumber> <balance>", a single deposit is capped at RM 50,000
+        char money[MONEY_TEXT_SIZE];
+        if (fgets(line, sizeof(line), created) == NULL || sscanf(line, "%*s OK %12s", account.accountNumber) != 1) break;
+        fprintf(batch, "deposit %s %s\n", account.accountNumber, formatMoney(account.balance % DEPOSIT_LIMIT_SEN + 1, money));
+    }
+    if (created != NULL) fclose(created);
+    return fclose(batch) == 0;
+}
+
+// create database/ in the current directory with 'count' accounts, and time how long loading them takes
+int benchGenerate(size_t count, enum BenchFormat format, enum BankDurability durability) {
+    if (mkdir("database", 0755) != 0 && errno != EEXIST) return 0;
+    if (format != BENCH_FORMAT_STORE) {
+        double written = benchNow();
+        if (!benchGenerateLegacy(count)) return 0;
+        // the v1 reference uses the files as they are
+        if (format == BENCH_FORMAT_V1) {
+            struct BenchResult result = { count, 0, benchNow() - written, 0, 0 };
+            benchReport("generate", result);
+            return 1;
+        }
+    }
+
+    // the legacy files are imported by the first bankOpen
+    double started = benchNow();
+    if (bankOpen("database", durability, &bank) != BANK_OK) return 0;
+    int ok = 1;
+    if (format == BENCH_FORMAT_LEGACY) {
+        ok = (size_t)bankCount(bank) == count;
+    } else {
+        // two batches, like a bulk load: the accounts, then their opening balances
+        struct BankBatchStats stats;
+        ok = benchWriteBatch("create.txt", count, NULL) &&
+             bankRunBatch(bank, "create.txt", "create.out", &stats) == BANK_OK && stats.succeeded == count &&
+             benchWriteBatch("deposit.txt", count, "create.out") &&
+             bankRunBatch(bank, "deposit.txt", "deposit.out", &stats) == BANK_OK && stats.succeeded == count;
+        remove("create.txt");
+        remove("create.out");
+        remove("deposit.txt");
+        remove("deposit.out");
+    }
+    // start the timed operations from a snapshot and an empty journal, like after a clean restart
+    ok = ok && bankCheckpoint(bank) == BANK_OK;
+    double seconds = benchNow() - started;
+
+    struct BenchResult result = { count, ok ? 0 : 1, seconds, 0, 0 };
+    benchReport(format == BENCH_FORMAT_LEGACY ? "convert" : "generate", result);
+    return ok;
+}
+
+// bankListAccounts() callback, records the account numbers. their types are looked up afterwards
+void benchCollectAccount(const char *accountNumber, void *context) {
+    size_t *capacity = context;
+    if (benchAccounts.count >= *capacity) return;
+    strcpy(benchAccounts.numbers[benchAccounts.count], accountNumber);
+    benchAccounts.count++;
+}
+
+// collect the account numbers and types of the database, the operations pick from them
+int benchLoadAccounts() {
+    free(benchAccounts.numbers);
+    free(benchAccounts.savings);
+    benchAccounts.count = 0;
+    size_t capacity = (size_t)bankCount(bank);
+    benchAccounts.numbers = malloc((capacity + 1) * sizeof(*benchAccounts.numbers));
+    benchAccounts.savings = malloc(capacity + 1);
+    if (benchAccounts.numbers == NULL || benchAccounts.savings == NULL) return 0;
+    if (bankListAccounts(bank, benchCollectAccount, &capacity) != BANK_OK) return 0;
+
+    for (size_t i = 0; i < benchAccounts.count; i++) {
+        struct Account account;
+        if (bankLookup(bank, benchAccounts.numbers[i], &account) != BANK_OK) return 0;
+        benchAccounts.savings[i] = strcmp(account.type, "Savings") == 0;
+    }
+    return benchAccounts.count > 0;
+}
+
+// Fisher-Yates over the account list, keeps numbers and types together
+void benchShuffle() {
+    for (size_t i = benchAccounts.count - 1; i > 0; i--) {
+        size_t j = benchRandom() % (i + 1);
+        if (j == i) continue;
+        char number[13], savings = benchAccounts.savings[i];
+        memcpy(number, benchAccounts.numbers[i], sizeof(number));
+        memcpy(benchAccounts.numbers[i], benchAccounts.numbers[j], sizeof(number));
+        memcpy(benchAccounts.numbers[j], number, sizeof(number));
+        benchAccounts.savings[i] = benchAccounts.savings[j];
+        benchAccounts.savings[j] = savings;
+    }
+}
+
+void benchCloseDatabase() {
+    bankClose(bank);
+    bank = NULL;
+}
+
+int removeEntry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+// generate a database of 'count' accounts in a temporary directory and time every operation on it
+int benchSize(size_t count, size_t ops, enum BenchFormat format, enum BankDurability durability, int keep,
+              int threads) {
+    char directory[] = "/tmp/bankbench.XXXXXX";
+    char home[PATH_MAX];
+    if (getcwd(home, sizeof(home)) == NULL || mkdtemp(directory) == NULL || chdir(directory) != 0) {
+        printf("Error: couldn't create a temporary directory.\n");
+        return 0;
+    }
+
+    if (format == BENCH_FORMAT_V1) {
+        printf("\n=== %zu accounts (v1 reference: text files through the original v1 code) ===\n", count);
+    } else {
+        printf("\n=== %zu accounts (%s, libbank durability %s) ===\n", count,
+               format == BENCH_FORMAT_LEGACY ? "legacy text files imported into the store" : "store format",
+               durability == BANK_DURABILITY_NONE ? "none" : durability == BANK_DURABILITY_OP ? "op" : "batch");
+    }
+    printf("%-12s %10s %8s %12s %10s %10s\n", "operation", "ops", "failed", "ops/s", "p50 (us)", "p99 (us)");
+
+    int ok = benchGenerate(count, format, durability) &&
+             (format == BENCH_FORMAT_V1 ? baselineLoadAccounts(count) : benchLoadAccounts());
+    if (ok && format == BENCH_FORMAT_V1) {
+        // every v1 operation scans index.txt, so big databases get fewer of them
+        if (ops > benchAccounts.count) ops = benchAccounts.count;
+        if (ops > BENCH_BASELINE_SCAN / count) {
+            ops = BENCH_BASELINE_SCAN / count > 10 ? BENCH_BASELINE_SCAN / count : 10;
+            printf("(%zu ops per operation, every one scans index.txt)\n", ops);
+        }
+        benchReport("lookup", benchRun(baselineLookup, ops));
+        benchReport("deposit", benchRun(baselineDeposit, ops));
+        benchReport("withdraw", benchRun(baselineWithdraw, ops));
+        benchReport("transfer", benchRun(baselineTransfer, ops));
+        benchReport("create", benchRun(baselineCreate, ops));
+        benchShuffle();
+        benchReport("delete", benchRun(baselineDelete, ops));
+    } else if (ok) {
+        if (ops > benchAccounts.count) ops = benchAccounts.count;
+        benchReport("lookup", benchRun(benchLookup, ops));
+        benchReport("deposit", benchRun(benchDeposit, ops));
+        benchReport("withdraw", benchRun(benchWithdraw, ops));
+        benchReport("transfer", benchRun(benchTransfer, ops));
+        if (threads > 1 && bankStartEngine(bank, threads) == BANK_OK) {
+            char name[32];
+            snprintf(name, sizeof(name), "deposit x%d", threads);
+            benchReport(name, benchRunThreads(0, ops, threads));
+            snprintf(name, sizeof(name), "transfer x%d", threads);
+            benchReport(name, benchRunThreads(1, ops, threads));
+        }
+        benchReport("create", benchRun(benchCreate, ops));
+        benchShuffle();
+        benchReport("delete", benchRun(benchDelete, ops));
+
+        struct BankCacheStats cache;
+        bankCacheStats(bank, &cache);
+        unsigned long reads = cache.hits + cache.misses;
+        printf("account cache: %lu hits, %lu misses (%.1f%% hit rate)\n", cache.hits, cache.misses,
+               reads > 0 ? 100.0 * cache.hits / reads : 0.0);
+    } else {
+        printf("Error: couldn't generate the database in %s.\n", directory);
+    }
+    benchCloseDatabase();
+
+    if (chdir(home) != 0) return 0;
+    if (keep) {
+        printf("Database kept in %s\n", directory);
+    } else {
+        nftw(directory, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    size_t sizes[BENCH_MAX_SIZES] = { 10000, 100000, 1000000 };
+    int sizeCount = 3;
+    size_t ops = BENCH_DEFAULT_OPS;
+    enum BenchFormat format = BENCH_FORMAT_STORE;
+    enum BankDurability durability = BANK_DURABILITY_BATCH;
+    const char *generateDirectory = NULL;
+    int keep = 0;
+    int threads = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--accounts=", 11) == 0) {
+            // comma separated list of database sizes
+            sizeCount = 0;
+            char *cursor = argv[i] + 11;
+            while (*cursor != '\0' && sizeCount < BENCH_MAX_SIZES) {
+                char *end;
+                sizes[sizeCount] = strtoul(cursor, &end, 10);
+                if (end == cursor || sizes[sizeCount] == 0) break;
+                sizeCount++;
+                cursor = *end == ',' ? end + 1 : end;
+            }
+            if (sizeCount == 0 || *cursor != '\0') sizeCount = -1;
+        } else if (strncmp(argv[i], "--ops=", 6) == 0) {
+            ops = strtoul(argv[i] + 6, NULL, 10);
+        } else if (strcmp(argv[i], "--format=store") == 0) {
+            format = BENCH_FORMAT_STORE;
+        } else if (strcmp(argv[i], "--format=legacy") == 0) {
+            format = BENCH_FORMAT_LEGACY;
+        } else if (strcmp(argv[i], "--format=v1") == 0) {
+            format = BENCH_FORMAT_V1;
+        } else if (strncmp(argv[i], "--durability=", 13) == 0 && bankParseDurability(argv[i] + 13, &durability)) {
+            continue;
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            benchRandomState = strtoull(argv[i] + 7, NULL, 10) | 1;
+        } else if (strncmp(argv[i], "--generate=", 11) == 0) {
+            generateDirectory = argv[i] + 11;
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            keep = 1;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0 && atoi(argv[i] + 10) > 0) {
+            threads = atoi(argv[i] + 10);
+        } else {
+            sizeCount = -1;
+        }
+        if (sizeCount < 0) {
+            printf("Usage: bench.exe [--accounts=N[,N...]] [--ops=N] [--format=store|legacy|v1]\n"
+                   "                 [--durability=none|batch|op] [--seed=N] [--keep] [--threads=N] [--generate=<dir>]\n");
+            return 1;
+        }
+    }
+
+    if (generateDirectory != NULL) {
+        // just write the first size into <dir>/database and leave it there
+        if ((mkdir(generateDirectory, 0755) != 0 && errno != EEXIST) || chdir(generateDirectory) != 0) {
+            printf("Error: couldn't use directory '%s'.\n", generateDirectory);
+            return 1;
+        }
+        printf("%-12s %10s %8s %12s %10s %10s\n", "operation", "ops", "failed", "ops/s", "p50 (us)", "p99 (us)");
+        int ok = benchGenerate(sizes[0], format, durability);
+        benchCloseDatabase();
+        return ok ? 0 : 1;
+    }
+
+    int ok = 1;
+    for (int i = 0; i < sizeCount; i++) {
+        if (!benchSize(sizes[i], ops, format, durability, keep, threads)) ok = 0;
+    }
+    free(benchAccounts.numbers);
+    free(benchAccounts.savings);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+// --- account number allocator ---
+// account numbers come from a keyed permutation of the 7-9 digit range: a 4-round Feistel network over
+// 30 bits, cycle-walked back into the range. feeding it a counter (the cursor in the store header) gives
+// every account a different number in O(1) without checking what has been used, and consecutive accounts
+// still get numbers that look random
+#include "bank_internal.h"
+
+#define ACCOUNT_NUMBER_MIN 1000000u   // 7 digits
+#define ACCOUNT_NUMBER_MAX 999999999u // 9 digits
+#define ALLOC_HALF_BITS 15            // two 15-bit halves, 2^30 covers the range
+#define ALLOC_HALF_MASK ((1u << ALLOC_HALF_BITS) - 1)
+
+// pick a secret key for a store that doesn't have one yet
+void allocInitKey(struct Bank *bank) {
+    uint32_t key[2] = { 0, 0 };
+    FILE *random = fopen("/dev/urandom", "rb");
+    if (random != NULL) {
+        if (fread(key, sizeof(key), 1, random) != 1) key[0] = key[1] = 0;
+        fclose(random);
+    }
+    if (key[0] == 0 && key[1] == 0) {
+        key[0] = (uint32_t)time(NULL);
+        key[1] = (uint32_t)getpid() * 2654435761u;
+    }
+    bank->store.header->allocKey[0] = key[0];
+    bank->store.header->allocKey[1] = key[1] | 1; // never all zero, which means "no key yet"
+    // journal replay can move the cursor forward but can't bring a lost key back, so it is made durable now
+    msync(bank->store.base, sizeof(struct StoreHeader), MS_SYNC);
+}
+
+// Feistel round function, mixes one half with a round key
+uint32_t allocRound(struct Bank *bank, uint32_t half, int round) {
+    uint32_t x = half ^ bank->store.header->allocKey[round & 1] ^ ((uint32_t)round * 0x9E3779B9u);
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x & ALLOC_HALF_MASK;
+}
+
+// bijection on [0, 2^30)
+uint32_t allocPermute(struct Bank *bank, uint32_t value) {
+    uint32_t left = value >> ALLOC_HALF_BITS;
+    uint32_t right = value & ALLOC_HALF_MASK;
+    for (int round = 0; round < 4; round++) {
+        uint32_t next = left ^ allocRound(bank, right, round);
+        left = right;
+        right = next;
+    }
+    return (left << ALLOC_HALF_BITS) | right;
+}
+
+// write the next unused account number into 'out', returns 0 once the whole range has been handed out
+int allocateAccountNumber(struct Bank *bank, char *out) {
+    uint32_t range = ACCOUNT_NUMBER_MAX - ACCOUNT_NUMBER_MIN + 1;
+    if (bank->store.header->allocKey[0] == 0 && bank->store.header->allocKey[1] == 0) allocInitKey(bank);
+
+    while (bank->store.header->allocCursor < range) {
+        uint32_t value = bank->store.header->allocCursor++;
+        // cycle walking: the permutation covers 2^30 values, re-apply it until it lands inside the range
+        do {
+            value = allocPermute(bank, value);
+        } while (value >= range);
+
+        sprintf(out, "%u", ACCOUNT_NUMBER_MIN + value);
+        // numbers are only taken twice by accounts imported from the old random generator
+        if (lookupAccount(bank, out) < 0) return 1;
+    }
+    return 0;
+}
+
@@ -0,0 +1,453 @@
+// --- the bank handle and its operations ---
+// every public function takes the shared locks it needs (see lock.c), runs one of the unlocked operations
+// below and releases them. the unlocked versions are also what batch mode runs, a chunk at a time under
+// every lock. lookups take no lock at all, see findAccount()
+#include "bank_internal.h"
+
+void bankPath(const struct Bank *bank, const char *name, char *out) {
+    snprintf(out, PATH_MAX, "%s/%s", bank->directory, name);
+}
+
+const char *bankErrorText(enum BankError error) {
+    switch (error) {
+    case BANK_OK: return "ok";
+    case BANK_NOT_FOUND: return "account not found";
+    case BANK_INVALID_AMOUNT: return "amount must be between RM 0 and RM 50,000";
+    case BANK_INSUFFICIENT_FUNDS: return "insufficient balance";
+    case BANK_SAME_TYPE: return "transfers must go between a savings and a current account";
+    case BANK_INVALID_ACCOUNT: return "invalid account details";
+    case BANK_NO_NUMBERS: return "no account numbers left";
+    case BANK_STORE_FULL: return "account store is full";
+    case BANK_JOURNAL_ERROR: return "couldn't write to the journal";
+    case BANK_IO_ERROR: return "couldn't read or write the database";
+    case BANK_NOT_SUPPORTED: return "not available when connected to a server";
+    }
+    return "unknown error";
+}
+
+int bankParseDurability(const char *name, enum BankDurability *durability) {
+    if (strcmp(name, "none") == 0) {
+        *durability = BANK_DURABILITY_NONE;
+    } else if (strcmp(name, "batch") == 0) {
+        *durability = BANK_DURABILITY_BATCH;
+    } else if (strcmp(name, "op") == 0) {
+        *durability = BANK_DURABILITY_OP;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// --- opening and closing ---
+// undo a partly opened handle
+void bankFree(struct Bank *bank) {
+    cacheDestroy(bank->cache);
+    nameDestroy(bank->names);
+    journalClose(bank);
+    customerClose(bank);
+    filterClose(bank);
+    orderClose(bank);
+    indexClose(bank);
+    storeClose(bank);
+    lockClose(bank);
+    pthread_mutex_destroy(&bank->journalLock);
+    pthread_mutex_destroy(&bank->mapLock);
+    free(bank);
+}
+
+enum BankError bankOpen(const char *directory, enum BankDurability durability, struct Bank **out) {
+    if (strlen(directory) >= sizeof(((struct Bank *)NULL)->directory)) return BANK_IO_ERROR;
+    struct Bank *bank = calloc(1, sizeof(struct Bank));
+    if (bank == NULL) return BANK_IO_ERROR;
+    strcpy(bank->directory, directory);
+    bank->remoteFd = -1;
+    bank->lockFd = -1;
+    bank->store.fd = -1;
+    bank->index.fd = -1;
+    bank->order.fd = -1;
+    bank->filter.fd = -1;
+    bank->customers.fd = -1;
+    bank->journal.fd = -1;
+    pthread_mutex_init(&bank->mapLock, NULL);
+    pthread_mutex_init(&bank->journalLock, NULL);
+    bank->cache = cacheCreate();
+    bank->names = nameCreate();
+
+    mkdir(directory, 0755);
+    int alone;
+    if (!lockOpen(bank, &alone)) {
+        bankFree(bank);
+        return BANK_IO_ERROR;
+    }
+
+    // the first process in opens the account store (rebuilding it from the last snapshot if it is damaged)
+    // and its index, replays the journal records the store doesn't have yet, and imports the old
+    // per-account text files the first time the store is created. later processes only map the files,
+    // holding every lock so nothing changes under them meanwhile
+    if (!alone) lockAll(bank);
+    enum BankError error = BANK_OK;
+    if (!storeOpen(bank) && (!alone || !restoreFromSnapshot(bank))) {
+        error = BANK_IO_ERROR;
+    } else if (!indexOpen(bank) || !orderOpen(bank) || !filterOpen(bank) || !customerOpen(bank)) {
+        error = BANK_IO_ERROR;
+    } else if (!journalOpen(bank, durability, alone)) {
+        error = BANK_JOURNAL_ERROR;
+    }
+    if (!alone) unlockAll(bank);
+    if (error != BANK_OK) {
+        bankFree(bank);
+        return error;
+    }
+
+    if (alone) {
+        // a process that died mid-write may have left slots marked as being written
+        storeResetSeq(bank);
+        if (bank->store.header->used == 0) {
+            convertLegacyDatabase(bank);
+            if (needsCheckpoint(bank)) checkpoint(bank);
+        }
+        lockShare(bank);
+    }
+    *out = bank;
+    return BANK_OK;
+}
+
+// compaction is worth it once tombstones make up a quarter of the live accounts
+int needsCompaction(struct Bank *bank) {
+    return bank->store.header->deleted >= 16 && bank->store.header->deleted * 4 >= bank->store.header->count;
+}
+
+// reclaim what deletions left behind: tombstoned store slots go back on the free list, the hash index is
+// rebuilt without tombstones and the tree without the room deleted keys left in its leaves. called with every
+// lock held, returns 1 on success
+int compactDatabase(struct Bank *bank) {
+    storeReclaim(bank);
+    return indexRebuild(bank, bank->index.header->capacity) && orderRebuild(bank);
+}
+
+void bankClose(struct Bank *bank) {
+    if (bank == NULL) return;
+    if (bank->remoteFd >= 0) {
+        clientClose(bank);
+        return;
+    }
+    engineStop(bank);
+    lockAll(bank);
+    // amortize deletions: reclaim tombstones once enough of them have piled up
+    if (needsCompaction(bank)) {
+        compactDatabase(bank);
+    }
+    journalClose(bank);
+    unlockAll(bank);
+    bankFree(bank);
+}
+
+void bankSetLog(struct Bank *bank, struct BankLog *log) {
+    bank->log = log;
+}
+
+// --- unlocked operations ---
+int isDigits(const char *text) {
+    if (*text == '\0') return 0;
+    for (; *text != '\0'; text++) {
+        if (!isdigit((unsigned char)*text)) return 0;
+    }
+    return 1;
+}
+
+// give 'account' the next account number and add it, journaled before it reaches the store
+enum BankError addAccount(struct Bank *bank, struct Account *account) {
+    // the same rules the menu enforces while asking for the details
+    size_t idLength = strlen(account->ID);
+    if (account->name[0] == '\0' || !isDigits(account->ID) || idLength < 8 || idLength > 12 ||
+        (strcmp(account->type, "Savings") != 0 && strcmp(account->type, "Current") != 0) ||
+        !isDigits(account->pin) || strlen(account->pin) != 4) {
+        return BANK_INVALID_ACCOUNT;
+    }
+    account->balance = 0;
+
+    // take the next number from the allocator, unique without scanning existing accounts
+    if (!allocateAccountNumber(bank, account->accountNumber)) return BANK_NO_NUMBERS;
+
+    // commit the new account to the journal, then add it to the store
+    if (!journalAccount(bank, JOURNAL_CREATE, account)) return BANK_JOURNAL_ERROR;
+    int slot = storeInsert(bank, account);
+    // the filter, the tree and the customer index learn the number before the index does, so a reader never
+    // finds it in the index but not in them
+    if (slot >= 0) {
+        filterInsert(bank, account->accountNumber);
+        orderInsert(bank, account->accountNumber, slot);
+        customerInsert(bank, account);
+        nameInsert(bank, slot, account);
+    }
+    if (slot < 0 || !indexInsert(bank, account->accountNumber, slot)) {
+        // the create is already in the journal: take back what was added and journal a delete, so replay
+        // doesn't bring back an account the caller was told wasn't created
+        if (slot >= 0) {
+            storeRemove(bank, slot);
+            orderRemove(bank, account->accountNumber);
+            filterRemove(bank, account->accountNumber);
+            customerRemove(bank, account);
+            nameRemove(bank, slot);
+        }
+        journalAccount(bank, JOURNAL_DELETE, account);
+        return BANK_STORE_FULL;
+    }
+    bankLogEvent(bank->log, BANK_LOG_CREATE, account->accountNumber, NULL, 0, 0, 0);
+    return BANK_OK;
+}
+
+// delete an account: journal it, tombstone it in the hash index and the store, and take it out of the tree,
+// the filter and its customer's accounts. the store space is reclaimed later by compactDatabase()
+enum BankError removeAccount(struct Bank *bank, const char *accountNumber) {
+    struct Account deleted;
+    int slot = cacheRead(bank, accountNumber, &deleted);
+    if (slot < 0) return BANK_NOT_FOUND;
+    if (!journalAccount(bank, JOURNAL_DELETE, &deleted)) return BANK_JOURNAL_ERROR;
+    if (!indexRemove(bank, accountNumber) || !storeRemove(bank, slot)) return BANK_IO_ERROR;
+    orderRemove(bank, accountNumber);
+    filterRemove(bank, accountNumber);
+    customerRemove(bank, &deleted);
+    nameRemove(bank, slot);
+    bankLogEvent(bank->log, BANK_LOG_DELETE, accountNumber, NULL, 0, 0, 0);
+
+    // the account's old text file (if it was imported from one) would otherwise come back with an import
+    removeLegacyFile(bank, accountNumber);
+    return BANK_OK;
+}
+
+// deposit ('+') or withdraw ('-') 'amount' sen. the change is journaled before it is written to the store
+enum BankError applyBalance(struct Bank *bank, char operation, int64_t amount, const char *accountNumber,
+                            int64_t *newBalance) {
+    // load the account record, from the cache if it is there
+    struct Account account;
+    int slot = cacheRead(bank, accountNumber, &account);
+    if (slot < 0) return BANK_NOT_FOUND;
+
+    // validate the amount between 0 and 50000, for deposits and withdrawals alike
+    if (!(amount > 0 && amount <= DEPOSIT_LIMIT_SEN)) return BANK_INVALID_AMOUNT;
+    if (operation == '+') {
+        account.balance += amount;
+    } else if (operation == '-') {
+        if (amount > account.balance) return BANK_INSUFFICIENT_FUNDS;
+        account.balance -= amount;
+    }
+
+    // commit the change to the journal before applying it to the store
+    if (!journalBalance(bank, account.accountNumber, amount, account.balance)) return BANK_JOURNAL_ERROR;
+    // write the new balance back in place, and through to the cache
+    cacheWriteBalance(bank, slot, &account);
+    bankLogEvent(bank->log, operation == '+' ? BANK_LOG_DEPOSIT : BANK_LOG_WITHDRAW, account.accountNumber, NULL,
+                 amount, 0, account.balance);
+
+    if (newBalance != NULL) *newBalance = account.balance;
+    return BANK_OK;
+}
+
+// move 'amount' from sender to receiver as one unit: both records are read once, everything is validated
+// before anything changes, and the debit, fee and credit are committed as a single journal record before
+// both balances are written back
+enum BankError transferFunds(struct Bank *bank, const char *senderNumber, const char *receiverNumber, int64_t amount,
+                             int64_t pricedFee, int32_t *feeBps, int64_t *senderBalance) {
+    struct Account sender, receiver;
+    int senderSlot = cacheRead(bank, senderNumber, &sender);
+    int receiverSlot = senderSlot < 0 ? -1 : cacheRead(bank, receiverNumber, &receiver);
+    if (receiverSlot < 0) return BANK_NOT_FOUND;
+
+    int32_t rate;
+    if (!remittanceFee(sender.type, receiver.type, &rate)) return BANK_SAME_TYPE;
+    // the receiver is credited like a deposit, so the same limits apply
+    if (!(amount > 0 && amount <= DEPOSIT_LIMIT_SEN)) return BANK_INVALID_AMOUNT;
+
+    // a batch prices its transfers ahead of time (account types never change), otherwise this is a batch of one
+    int64_t fee = pricedFee;
+    if (fee < 0) computeFees(&amount, &rate, &fee, 1);
+    int64_t totalAmount = amount + fee;
+    if (totalAmount > sender.balance) return BANK_INSUFFICIENT_FUNDS;
+
+    sender.balance -= totalAmount;
+    receiver.balance += amount;
+
+    // both sides go into one record, so after a crash the transfer is replayed whole or not at all
+    struct JournalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = JOURNAL_TRANSFER;
+    record.amount = amount;
+    record.fee = fee;
+    record.balance = sender.balance;
+    strcpy(record.account.accountNumber, sender.accountNumber);
+    strcpy(record.toAccount, receiver.accountNumber);
+    record.toBalance = receiver.balance;
+    if (!journalAppend(bank, &record) || !journalCommit(bank)) return BANK_JOURNAL_ERROR;
+
+    cacheWriteBalance(bank, senderSlot, &sender);
+    cacheWriteBalance(bank, receiverSlot, &receiver);
+    bankLogEvent(bank->log, BANK_LOG_TRANSFER, sender.accountNumber, receiver.accountNumber, amount, fee,
+                 sender.balance);
+
+    if (feeBps != NULL) *feeBps = rate;
+    if (senderBalance != NULL) *senderBalance = sender.balance;
+    return BANK_OK;
+}
+
+// --- lookups ---
+// copy the account out without taking a lock: the index entry and the slot are read optimistically and the
+// read is retried if the index was rebuilt or the slot was written meanwhile; while the index is being
+// rebuilt the slot comes from the tree in order.dat instead. after a few collisions with writers it falls
+// back to the account's stripe lock. a cached copy whose slot hasn't changed skips all of that, and so does
+// a number the filter knows isn't an account. returns 1 if the account exists
+int findAccount(struct Bank *bank, const char *accountNumber, struct Account *out) {
+    struct Account account;
+    if (cacheLookup(bank, accountNumber, out) >= 0) return 1;
+    if (!filterMayContain(bank, accountNumber)) return 0;
+    for (int attempt = 0; attempt < 8; attempt++) {
+        uint32_t generation = __atomic_load_n(&bank->locks->indexGeneration, __ATOMIC_ACQUIRE);
+        if (!storeRefresh(bank)) break;
+        int slot;
+        if (generation & 1) {
+            // the index is being rebuilt, the tree has every account's slot as well
+            slot = orderFind(bank, accountNumber);
+            if (slot == ORDER_BUSY) continue;
+        } else {
+            if (!indexRefresh(bank)) break;
+            slot = lookupAccount(bank, accountNumber);
+        }
+        uint32_t seq;
+        int read = slot < 0 ? 0 : storeReadOptimistic(bank, slot, &account, &seq);
+        if (read < 0 || __atomic_load_n(&bank->locks->indexGeneration, __ATOMIC_ACQUIRE) != generation) continue;
+        // a slot found through a stale entry may hold another account by now
+        if (read > 0 && strcmp(account.accountNumber, accountNumber) != 0) continue;
+        if (read > 0) cacheStore(bank, slot, &account, seq);
+        if (read > 0 && out != NULL) *out = account;
+        return read;
+    }
+
+    lockAccount(bank, accountNumber);
+    int found = storeRead(bank, lookupAccount(bank, accountNumber), &account);
+    unlockAccount(bank, accountNumber);
+    if (found && out != NULL) *out = account;
+    return found;
+}
+
+// --- public operations ---
+// a handle from bankConnect() forwards each of these to the server, see client.c
+int bankCount(struct Bank *bank) {
+    if (bank->remoteFd >= 0) return clientCount(bank);
+    return (int)__atomic_load_n(&bank->store.header->count, __ATOMIC_ACQUIRE);
+}
+
+enum BankError bankLookup(struct Bank *bank, const char *accountNumber, struct Account *out) {
+    if (bank->remoteFd >= 0) return clientLookup(bank, accountNumber, out);
+    return findAccount(bank, accountNumber, out) ? BANK_OK : BANK_NOT_FOUND;
+}
+
+// listing copies account numbers out of the tree a chunk at a time, so it takes no lock either
+enum BankError bankListAccounts(struct Bank *bank, void (*visit)(const char *accountNumber, void *context),
+                                void *context) {
+    if (bank->remoteFd >= 0) return clientList(bank, visit, context);
+    struct BankListQuery all;
+    memset(&all, 0, sizeof(all));
+    return listPage(bank, &all, visit, context, NULL);
+}
+
+enum BankError bankListPage(struct Bank *bank, const struct BankListQuery *query,
+                            void (*visit)(const char *accountNumber, void *context), void *context, char *next) {
+    if (bank->remoteFd >= 0) return clientListPage(bank, query, visit, context, next);
+    return listPage(bank, query, visit, context, next);
+}
+
+enum BankError bankCreate(struct Bank *bank, struct Account *account) {
+    if (bank->remoteFd >= 0) return clientCreate(bank, account);
+    lockStructure(bank);
+    int all = 0;
+    if (!indexHasRoom(bank)) {
+        // growing the index replaces index.dat, which needs everyone else out of the way
+        unlockStructure(bank);
+        lockAll(bank);
+        all = 1;
+    }
+    enum BankError error = addAccount(bank, account);
+    if (all) {
+        unlockAll(bank);
+    } else {
+        unlockStructure(bank);
+    }
+    // keep the journal (and so the replay after a crash) short
+    maybeCheckpoint(bank);
+    repairIfNeeded(bank);
+    return error;
+}
+
+enum BankError bankDelete(struct Bank *bank, const char *accountNumber) {
+    if (bank->remoteFd >= 0) return clientDelete(bank, accountNumber);
+    lockAccount(bank, accountNumber);
+    lockStructure(bank);
+    enum BankError error = removeAccount(bank, accountNumber);
+    unlockStructure(bank);
+    unlockAccount(bank, accountNumber);
+    maybeCheckpoint(bank);
+    repairIfNeeded(bank);
+    return error;
+}
+
+enum BankError bankDeposit(struct Bank *bank, const char *accountNumber, int64_t amount, int64_t *newBalance) {
+    if (bank->remoteFd >= 0) return clientAmount(bank, WIRE_DEPOSIT, accountNumber, NULL, amount, NULL, newBalance);
+    if (bank->engine != NULL) return engineSubmit(bank, ENGINE_DEPOSIT, accountNumber, NULL, amount, NULL, newBalance);
+    lockAccount(bank, accountNumber);
+    enum BankError error = applyBalance(bank, '+', amount, accountNumber, newBalance);
+    unlockAccount(bank, accountNumber);
+    maybeCheckpoint(bank);
+    repairIfNeeded(bank);
+    return error;
+}
+
+enum BankError bankWithdraw(struct Bank *bank, const char *accountNumber, int64_t amount, int64_t *newBalance) {
+    if (bank->remoteFd >= 0) return clientAmount(bank, WIRE_WITHDRAW, accountNumber, NULL, amount, NULL, newBalance);
+    if (bank->engine != NULL) return engineSubmit(bank, ENGINE_WITHDRAW, accountNumber, NULL, amount, NULL, newBalance);
+    lockAccount(bank, accountNumber);
+    enum BankError error = applyBalance(bank, '-', amount, accountNumber, newBalance);
+    unlockAccount(bank, accountNumber);
+    maybeCheckpoint(bank);
+    repairIfNeeded(bank);
+    return error;
+}
+
+enum BankError bankTransfer(struct Bank *bank, const char *from, const char *to, int64_t amount, int32_t *feeBps,
+                            int64_t *senderBalance) {
+    if (bank->remoteFd >= 0) return clientAmount(bank, WIRE_TRANSFER, from, to, amount, feeBps, senderBalance);
+    if (bank->engine != NULL) return engineSubmit(bank, ENGINE_TRANSFER, from, to, amount, feeBps, senderBalance);
+    lockAccountPair(bank, from, to);
+    enum BankError error = transferFunds(bank, from, to, amount, -1, feeBps, senderBalance);
+    unlockAccountPair(bank, from, to);
+    maybeCheckpoint(bank);
+    repairIfNeeded(bank);
+    return error;
+}
+
+// --- maintenance ---
+int bankImportLegacy(struct Bank *bank) {
+    if (bank->remoteFd >= 0) return 0;
+    lockAll(bank);
+    int imported = convertLegacyDatabase(bank);
+    unlockAll(bank);
+    maybeCheckpoint(bank);
+    return imported;
+}
+
+enum BankError bankCompact(struct Bank *bank, uint32_t *reclaimed) {
+    if (bank->remoteFd >= 0) return BANK_NOT_SUPPORTED;
+    lockAll(bank);
+    uint32_t deleted = bank->store.header->deleted;
+    int ok = compactDatabase(bank);
+    unlockAll(bank);
+    if (reclaimed != NULL) *reclaimed = ok ? deleted : 0;
+    return ok ? BANK_OK : BANK_IO_ERROR;
+}
+
+enum BankError bankCheckpoint(struct Bank *bank) {
+    if (bank->remoteFd >= 0) return BANK_NOT_SUPPORTED;
+    lockAll(bank);
+    int ok = checkpoint(bank);
+    unlockAll(bank);
+    return ok ? BANK_OK : BANK_IO_ERROR;
+}
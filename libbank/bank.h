@@ -0,0 +1,251 @@
+/*
+Description:
+- libbank, the banking core shared by the v1 and v2 front ends (and bench/). It owns the account store, its indexes,
+  the write-ahead journal and snapshots, and never prints anything.
+- Everything goes through a 'struct Bank' handle returned by bankOpen(). There is no global state. Several threads
+  may share a handle and several processes may open the same database at once: balance changes lock only the
+  accounts involved, and lookups and listing take no lock at all (see lock.c).
+- Operations report failures as 'enum BankError' codes; turning them into messages is up to the caller
+  (bankErrorText() has a plain default).
+- Build: add the .c files of libbank/ to the front end's gcc command, with -Ilibbank -lpthread (see README).
+*/
+
+#ifndef BANK_H
+#define BANK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <signal.h>
+
+// Bank account structure
+struct Account {
+    char name[100];
+    char ID[13];
+    char accountNumber[13];
+    char type[10];
+    char pin[5];
+    int64_t balance; // in sen (1/100 RM)
+};
+
+// --- money ---
+// balances and amounts are whole sen (1/100 RM) in 64-bit integers, so no cents are lost to rounding.
+// text is only converted at input (parseMoney) and output (formatMoney)
+#define DEPOSIT_LIMIT_SEN 5000000 // RM 50,000
+#define MONEY_TEXT_SIZE 24        // enough for any int64_t amount as "-123.45"
+
+// parse "123", "123.4" or "123.45" into sen without going through floating point, returns 0 if malformed
+int parseMoney(const char *text, int64_t *sen);
+// format sen as "1234.56" into 'out' (MONEY_TEXT_SIZE bytes), returns 'out' so it can go straight into printf
+char *formatMoney(int64_t sen, char *out);
+
+// --- account text format ---
+// the old database/<accountNumber>.txt layout ("Name: ...\nID: ...\n..."), which bankImportLegacy() reads
+#define ACCOUNT_TEXT_SIZE 256     // enough for any account in the text layout
+
+// write 'account' in the text layout into 'out' (ACCOUNT_TEXT_SIZE bytes, not terminated), returns its length
+size_t formatAccountText(const struct Account *account, char *out);
+// remittance fees for a batch of transfers: fees[i] = amounts[i] * rateBps[i] / 10000 rounded half up
+void computeFees(const int64_t *restrict amounts, const int32_t *restrict rateBps, int64_t *restrict fees, size_t count);
+// remittance fee rate in basis points from sender to receiver type, returns 0 if the pair isn't allowed
+int remittanceFee(const char *senderType, const char *receiverType, int32_t *rateBps);
+
+// --- errors and options ---
+enum BankError {
+    BANK_OK = 0,
+    BANK_NOT_FOUND,          // no account with that number
+    BANK_INVALID_AMOUNT,     // amount must be between RM 0 and RM 50,000
+    BANK_INSUFFICIENT_FUNDS, // balance can't cover the amount (plus fee for a transfer)
+    BANK_SAME_TYPE,          // transfers are only allowed between a savings and a current account
+    BANK_INVALID_ACCOUNT,    // a new account's name, ID, type or PIN is malformed
+    BANK_NO_NUMBERS,         // every account number has been handed out
+    BANK_STORE_FULL,         // the account store couldn't grow
+    BANK_JOURNAL_ERROR,      // the change couldn't be committed to the journal, nothing was changed
+    BANK_IO_ERROR,           // a database file couldn't be opened, read or written
+    BANK_NOT_SUPPORTED       // not available on a handle connected to a server
+};
+
+// how often the journal is fsync'd, see README
+enum BankDurability {
+    BANK_DURABILITY_NONE,  // write to the OS at commit, never fsync
+    BANK_DURABILITY_BATCH, // one fsync per batch (a single operation outside a batch is a batch of one)
+    BANK_DURABILITY_OP     // fsync every operation, even inside a batch
+};
+
+// short lowercase description of an error, for callers without messages of their own
+const char *bankErrorText(enum BankError error);
+// parse a durability level name ("none", "batch" or "op"), returns 0 if it is unknown
+int bankParseDurability(const char *name, enum BankDurability *durability);
+
+// --- opening and closing ---
+struct Bank;
+
+// open the database in 'directory' (normally "database"), creating it if needed. a damaged store is rebuilt
+// from the last snapshot, unfinished journal records are replayed, and the old one-file-per-account layout is
+// imported the first time. on success '*bank' is the new handle
+enum BankError bankOpen(const char *directory, enum BankDurability durability, struct Bank **bank);
+// flush and close everything, compacting first if enough accounts were deleted
+void bankClose(struct Bank *bank);
+
+// --- sharded engine ---
+// run deposits, withdrawals and transfers on 'shards' threads (0 picks one per CPU) that each own a share of
+// the accounts, instead of on the calling threads. worth it when many threads share the handle, like a
+// server does; bankServe() starts it. results and durability are the same, and bankClose() stops it. with
+// 'batch' durability a failed group fsync answers the whole group BANK_JOURNAL_ERROR, though their changes
+// were applied
+enum BankError bankStartEngine(struct Bank *bank, int shards);
+
+// --- server mode ---
+// one process owns the database and serves many local clients over a Unix-domain socket. a handle from
+// bankConnect() works like a local one for the account operations below. maintenance and batch runs return
+// BANK_NOT_SUPPORTED on it (bankImportLegacy() imports nothing)
+#define BANK_SOCKET_FILE "bank.sock" // default socket name inside the database directory
+
+// serve 'bank' on 'socketPath' with 'workers' threads (0 picks one per CPU) until '*stop' becomes nonzero,
+// e.g. from a signal handler. fails with BANK_IO_ERROR if the socket can't be set up or is already served
+enum BankError bankServe(struct Bank *bank, const char *socketPath, int workers, const volatile sig_atomic_t *stop);
+// connect to a server, on success '*bank' is a handle that forwards every operation to it. close it with
+// bankClose()
+enum BankError bankConnect(const char *socketPath, struct Bank **bank);
+
+// --- accounts ---
+// number of live accounts, kept in the store header so it costs no scan
+int bankCount(struct Bank *bank);
+// copy an account into 'out' (may be NULL to only test that it exists)
+enum BankError bankLookup(struct Bank *bank, const char *accountNumber, struct Account *out);
+// call 'visit' for every live account number, in ascending order
+enum BankError bankListAccounts(struct Bank *bank, void (*visit)(const char *accountNumber, void *context),
+                                void *context);
+// call 'visit' for every live account opened with customer ID 'ID', in ascending order. reads only that
+// customer's entries in the customer index. BANK_INVALID_ACCOUNT if 'ID' isn't 1-12 digits
+enum BankError bankCustomerAccounts(struct Bank *bank, const char *ID,
+                                    void (*visit)(const char *accountNumber, void *context), void *context);
+
+// one result of bankSearchNames()
+#define BANK_SEARCH_MAX 32 // results one search returns at most
+struct BankNameMatch {
+    char accountNumber[13];
+    char name[100];
+    int32_t score; // 100 if the name is the query, lower the less of the query is in it and the longer it is
+};
+
+// fuzzy search over the account holders' names: up to 'max' accounts whose names share at least half of the
+// query's trigrams, best match first, in out[0..*found). case and punctuation don't matter and a misspelt or
+// missing letter still matches. the handle builds its in-memory index on the first search
+enum BankError bankSearchNames(struct Bank *bank, const char *query, struct BankNameMatch *out, int max,
+                               int *found);
+
+// which account numbers bankListPage() visits. zero/NULL fields don't filter
+struct BankListQuery {
+    const char *prefix; // only numbers starting with these digits
+    const char *from;   // only numbers >= this one
+    const char *to;     // only numbers <= this one
+    const char *after;  // only numbers > this one: the cursor a previous page handed back in 'next'
+    int limit;          // visit this many at most
+};
+
+// call 'visit' for the account numbers 'query' matches, in ascending order, reading only as far as the page
+// goes. 'next' (13 bytes, may be NULL) gets the cursor for the page after this one, or "" if there is none.
+// BANK_INVALID_ACCOUNT if 'from', 'to' or 'after' isn't an account number
+enum BankError bankListPage(struct Bank *bank, const struct BankListQuery *query,
+                            void (*visit)(const char *accountNumber, void *context), void *context, char *next);
+// add a new account with a fresh account number (written to account->accountNumber) and a zero balance
+enum BankError bankCreate(struct Bank *bank, struct Account *account);
+enum BankError bankDelete(struct Bank *bank, const char *accountNumber);
+// on success 'newBalance' (may be NULL) holds the resulting balance
+enum BankError bankDeposit(struct Bank *bank, const char *accountNumber, int64_t amount, int64_t *newBalance);
+enum BankError bankWithdraw(struct Bank *bank, const char *accountNumber, int64_t amount, int64_t *newBalance);
+// move 'amount' plus the remittance fee out of 'from' and 'amount' into 'to' as one unit. on success 'feeBps' and
+// 'senderBalance' (both may be NULL) hold the fee rate applied and the sender's new balance
+enum BankError bankTransfer(struct Bank *bank, const char *from, const char *to, int64_t amount, int32_t *feeBps,
+                            int64_t *senderBalance);
+
+// --- account cache ---
+// every handle keeps its most recently used accounts decoded in memory and checks on each use that nothing
+// has written the account since, so a hit never returns stale data. changes are written through to it
+struct BankCacheStats {
+    unsigned long hits;
+    unsigned long misses;   // the account was read from the store (or doesn't exist)
+    unsigned long entries;  // accounts cached right now
+};
+
+void bankCacheStats(struct Bank *bank, struct BankCacheStats *stats);
+
+// --- maintenance ---
+// import database/<accountNumber>.txt files listed in index.txt, skipping accounts already in the store.
+// returns the number imported
+int bankImportLegacy(struct Bank *bank);
+// reclaim deleted accounts now, 'reclaimed' (may be NULL) gets how many
+enum BankError bankCompact(struct Bank *bank, uint32_t *reclaimed);
+// write a snapshot now and empty the journal
+enum BankError bankCheckpoint(struct Bank *bank);
+
+// --- transaction log ---
+// every session and transaction event is kept as a structured record in database/history.dat, with an index
+// by account. logging an event only queues it, a background thread appends the queued records in batches. if
+// the queue is full the caller waits for room rather than dropping the event
+enum BankLogEvent {
+    BANK_LOG_SESSION_START,
+    BANK_LOG_SESSION_END,
+    BANK_LOG_SERVER_START,
+    BANK_LOG_SERVER_STOP,
+    BANK_LOG_CREATING,       // an account is being set up
+    BANK_LOG_CREATE,
+    BANK_LOG_DELETE,
+    BANK_LOG_DEPOSIT,
+    BANK_LOG_WITHDRAW,
+    BANK_LOG_TRANSFER,       // from 'account' to 'other'
+    BANK_LOG_BATCH           // 'amount' records ran and 'balance' of them succeeded
+};
+
+struct BankLogRecord {
+    int64_t time;            // seconds since the epoch
+    enum BankLogEvent event;
+    char account[13];
+    char other[13];          // the receiver of a transfer, empty otherwise
+    int64_t amount;          // sen
+    int64_t fee;
+    int64_t balance;         // the balance of 'account' afterwards
+};
+
+struct BankLog;
+
+// start logging to the database in 'directory' (normally "database")
+enum BankError bankLogOpen(const char *directory, struct BankLog **log);
+// queue one event, safe from any thread. unused arguments may be NULL or 0, a NULL 'log' logs nothing
+void bankLogEvent(struct BankLog *log, enum BankLogEvent event, const char *account, const char *other,
+                  int64_t amount, int64_t fee, int64_t balance);
+// write out everything queued and stop, after the last bankLogEvent()
+void bankLogClose(struct BankLog *log);
+// log every create, delete, deposit, withdrawal and transfer made through 'bank' to 'log', with the resulting
+// balance, including the records of bankRunBatch() and the requests bankServe() answers. set it before
+// bankServe() or bankStartEngine(). a handle from bankConnect() runs nothing itself, its server logs instead
+void bankSetLog(struct Bank *bank, struct BankLog *log);
+// short name of an event for reports, like "Deposit"
+const char *bankLogEventText(enum BankLogEvent event);
+
+// call 'visit' for every logged event with a time in [from, to] (seconds since the epoch), oldest first. with
+// an 'accountNumber' only that account's events are read, following its chain of records, otherwise the
+// range is found by binary search. events still queued by a running bankLogEvent() aren't there yet
+enum BankError bankHistory(const char *directory, const char *accountNumber, int64_t from, int64_t to,
+                           void (*visit)(const struct BankLogRecord *record, void *context), void *context);
+
+// --- batch mode ---
+// run a file of create / deposit / withdraw / transfer records and write one result line per record,
+// see README for the format. a record whose journal write fails gets an ERROR line and changes nothing; if
+// the fsync after a chunk fails, the run stops with BANK_JOURNAL_ERROR after that chunk's result lines, and
+// those changes are applied but may not survive a power loss
+struct BankBatchStats {
+    unsigned long records;   // records executed and reported
+    unsigned long succeeded;
+    double seconds;
+    unsigned long syncs;     // journal fsyncs issued by the run
+    unsigned long waves;     // steps the records took when each step runs every record not waiting for an
+                             // earlier one on the same account. records / waves is the width of that schedule,
+                             // how much could run at once, not how many records the workers actually overlapped
+    int workers;             // threads that ran records
+};
+
+enum BankError bankRunBatch(struct Bank *bank, const char *inputPath, const char *outputPath,
+                            struct BankBatchStats *stats);
+
+#endif
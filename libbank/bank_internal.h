@@ -0,0 +1,603 @@
+/*
+Description:
+- Internals of libbank shared between its source files: the on-disk layouts, the 'struct Bank' handle and the
+  unlocked building blocks the public functions in bank.c are made of.
+- Nothing outside libbank/ should include this file.
+*/
+
+#ifndef BANK_INTERNAL_H
+#define BANK_INTERNAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "bank.h"
+
+// --- binary account store (store.c) ---
+// all accounts live in a single file of fixed-size slots (accounts.dat) that is memory mapped,
+// so reading an account is a memory copy and a balance update only rewrites the balance field in place
+#define STORE_FILE "accounts.dat"
+#define STORE_MAGIC 0x314B4E42u // "BNK1"
+#define STORE_VERSION 1
+#define STORE_INITIAL_CAPACITY 1024
+#define STORE_NO_SLOT UINT32_MAX
+#define STORE_RESERVE ((size_t)1 << 38) // address space kept for the mapping, so it never moves when the file grows
+
+#define SLOT_FREE 0
+#define SLOT_USED 1
+#define SLOT_DELETED 2 // tombstone, the slot is reclaimed by the next compaction
+
+struct StoreHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotSize;    // sizeof(struct AccountSlot) when the file was created
+    uint32_t capacity;    // number of slots the file holds
+    uint32_t used;        // high-water mark, slots [0, used) have been handed out at least once
+    uint32_t count;       // number of live accounts
+    uint32_t freeHead;    // first slot of the free list, STORE_NO_SLOT if empty
+    uint32_t padding;     // keeps checkpointLsn 8-byte aligned
+    uint64_t checkpointLsn; // last journal record reflected in the store when it was last synced
+    uint32_t deleted;     // tombstoned slots waiting for compaction
+    uint32_t allocCursor; // how many account numbers the allocator has handed out
+    uint32_t allocKey[2]; // secret key of the account number permutation
+    uint32_t reserved[2]; // pad header to 64 bytes
+};
+
+struct AccountSlot {
+    uint32_t state;    // SLOT_FREE, SLOT_USED or SLOT_DELETED
+    uint32_t seq;      // odd while the slot is being written, see storeReadOptimistic()
+    uint32_t nextFree; // next slot in the free list while the slot is free
+    uint32_t reserved;
+    struct Account account;
+};
+
+struct Store {
+    int fd;
+    size_t mapSize;       // bytes of the file currently mapped, other processes may have grown it since
+    unsigned char *base;
+    struct StoreHeader *header;
+    struct AccountSlot *slots;
+};
+
+// --- account number hash index (index.c) ---
+// open-addressing hash table (linear probing) from account number to store slot, kept in index.dat
+// the file is memory mapped so it loads at startup without parsing and every change is written in place
+#define INDEX_FILE "index.dat"
+#define INDEX_MAGIC 0x31584449u // "IDX1"
+#define INDEX_VERSION 1
+#define INDEX_MIN_CAPACITY 1024
+#define INDEX_TEMP_FILE "index.tmp"
+#define INDEX_RESERVE ((size_t)1 << 34) // address space kept for the mapping, like STORE_RESERVE
+
+#define INDEX_EMPTY 0     // key of a never used entry
+#define INDEX_TOMBSTONE 1 // key of a removed entry, probing continues past it
+
+struct IndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;   // number of entries, always a power of 2
+    uint32_t count;      // live keys
+    uint32_t tombstones; // removed keys still occupying entries
+    uint32_t reserved[3];
+};
+
+struct IndexEntry {
+    uint32_t key;  // account number as an integer
+    uint32_t slot; // slot in the account store
+};
+
+struct Index {
+    int fd;
+    size_t mapSize;
+    uint32_t generation; // lock table generation of the index.dat that is mapped
+    struct IndexHeader *header;
+    struct IndexEntry *entries;
+};
+
+// --- sorted account tree (order.c) ---
+// a B+tree of fixed-size pages in order.dat from every live account's key to its store slot, for paged
+// listing, range scans and lookups while the hash index is being rebuilt. memory mapped like the store and
+// changed under the structure lock, readers walk it optimistically against 'seq'
+#define ORDER_FILE "order.dat"
+#define ORDER_MAGIC 0x3144524Fu // "ORD1"
+#define ORDER_VERSION 2 // version 1 was a sorted array of keys
+#define ORDER_PAGE_SIZE 4096
+#define ORDER_NODE_KEYS 510 // keys per page, so a node fills one page
+#define ORDER_MAX_HEIGHT 8  // far more than 2^32 keys need
+#define ORDER_INITIAL_PAGES 16
+#define ORDER_RESERVE ((size_t)1 << 34) // address space kept for the mapping, like STORE_RESERVE
+#define ORDER_READ_CHUNK 256 // keys a reader copies per optimistic pass
+#define ORDER_BUSY (-2)      // orderFind() collided with a writer
+
+// page 0 of the file
+struct OrderHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pageSize;    // ORDER_PAGE_SIZE when the file was created
+    uint32_t capacity;    // pages the file has room for
+    uint32_t pages;       // pages [0, pages) are in use
+    uint32_t root;        // page of the root node
+    uint32_t height;      // levels of nodes, 1 while the root is a leaf
+    uint32_t count;       // keys in the leaves
+    uint32_t seq;         // odd while a writer is changing pages
+    uint32_t firstLeaf;   // leftmost leaf, where a full scan starts
+    uint32_t reserved[6]; // pad header to 64 bytes
+};
+
+// every other page. a leaf holds keys and their slots in ascending order and links to the next leaf. an
+// inner node holds 'count' keys and count + 1 children: values[i] leads to the keys below keys[i] and
+// values[count] to the rest
+struct OrderNode {
+    uint16_t leaf;        // 1 for a leaf
+    uint16_t count;       // keys in use
+    uint32_t next;        // leaf: page of the next leaf in key order, 0 for the last one
+    uint32_t keys[ORDER_NODE_KEYS];
+    uint32_t values[ORDER_NODE_KEYS + 1];
+};
+
+struct Order {
+    int fd;
+    size_t mapSize;
+    struct OrderHeader *header; // also the start of page 0
+};
+
+// --- account number filter (filter.c) ---
+// cuckoo filter over every live account's key, kept in filter.dat, so most lookups of account numbers that
+// don't exist are answered without probing the index. memory mapped like order.dat and changed under the
+// structure lock, readers check it against 'seq'
+#define FILTER_FILE "filter.dat"
+#define FILTER_MAGIC 0x31544C46u // "FLT1"
+#define FILTER_VERSION 1
+#define FILTER_INITIAL_BUCKETS 1024
+#define FILTER_BUCKET_SLOTS 4
+#define FILTER_MAX_KICKS 500 // fingerprints moved to make room before the filter is rebuilt bigger
+#define FILTER_RESERVE ((size_t)1 << 34) // address space kept for the mapping, like STORE_RESERVE
+
+struct FilterHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t buckets;     // a power of two, FILTER_BUCKET_SLOTS fingerprints each
+    uint32_t count;       // fingerprints in use, one per live account
+    uint32_t seq;         // odd while a writer is moving fingerprints
+    uint32_t padding;     // keeps checkpointLsn 8-byte aligned
+    uint64_t checkpointLsn; // the store's checkpointLsn when the filter was last synced with it
+};
+
+struct Filter {
+    int fd;
+    size_t mapSize;
+    struct FilterHeader *header;
+    uint16_t *slots;      // 0 is an empty slot
+};
+
+// --- customer index (customer.c) ---
+// hash table from each customer ID to the account numbers opened with it, kept in customers.dat. memory
+// mapped like filter.dat and changed under the structure lock together with the store, readers check it
+// against 'seq'
+#define CUSTOMER_FILE "customers.dat"
+#define CUSTOMER_MAGIC 0x31545343u // "CST1"
+#define CUSTOMER_VERSION 2
+#define CUSTOMER_INITIAL_CAPACITY 1024
+#define CUSTOMER_READ_ACCOUNTS 64 // account numbers bankCustomerAccounts() collects without allocating
+#define CUSTOMER_RESERVE ((size_t)1 << 34) // address space kept for the mapping, like STORE_RESERVE
+#define CUSTOMER_EMPTY 0 // customerKey() is never 0 or all ones
+#define CUSTOMER_TOMBSTONE UINT64_MAX
+#define CUSTOMER_HEAD 0 // 'account' of the entry that starts a customer's chain, accountKey() is never 0
+#define CUSTOMER_NO_ENTRY UINT32_MAX
+
+struct CustomerHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;    // a power of two
+    uint32_t count;       // live account entries, one per account with a digits-only ID
+    uint32_t tombstones;  // removed account entries, still linked into their chains
+    uint32_t seq;         // odd while a writer is changing entries
+    uint64_t checkpointLsn; // the store's checkpointLsn when the index was last synced with it
+    uint32_t heads;       // chain heads, one per customer that has had an account since the last rebuild
+    uint8_t reserved[28]; // pads the header to 64 bytes
+};
+
+struct CustomerEntry {
+    uint64_t customer;    // customerKey() of the ID, CUSTOMER_EMPTY or CUSTOMER_TOMBSTONE
+    uint32_t account;     // accountKey() of the account number, CUSTOMER_HEAD for a chain head
+    uint32_t next;        // next entry of the customer's chain, CUSTOMER_NO_ENTRY at the end
+};
+
+struct Customers {
+    int fd;
+    size_t mapSize;
+    struct CustomerHeader *header;
+    struct CustomerEntry *entries;
+};
+
+// --- write-ahead journal (journal.c) ---
+#define JOURNAL_FILE "journal.wal"
+#define JOURNAL_MAGIC 0x334E524Au // "JRN3"
+#define JOURNAL_BUFFER_SIZE (64 * 1024)
+
+enum JournalType {
+    JOURNAL_BALANCE = 1, // account balance set to 'balance'
+    JOURNAL_CREATE,      // 'account' was created
+    JOURNAL_DELETE,      // account 'account.accountNumber' was deleted
+    JOURNAL_TRANSFER     // 'account.accountNumber' sent money to 'toAccount', both resulting balances are set
+};
+
+struct JournalRecord {
+    uint32_t magic;
+    uint32_t checksum; // over everything after this field, detects torn writes at the tail
+    uint64_t lsn;      // log sequence number, increases by one per record
+    uint32_t type;
+    uint32_t allocCursor; // the allocator's cursor once JOURNAL_CREATE took its number, 0 if it wasn't allocated
+    int64_t amount;    // amount of the operation in sen, for reference
+    int64_t balance;   // resulting balance for JOURNAL_BALANCE and of the sender for JOURNAL_TRANSFER
+    int64_t fee;       // remittance fee charged on top of 'amount'
+    struct Account account;
+    char toAccount[13]; // receiving account of JOURNAL_TRANSFER
+    int64_t toBalance;  // its resulting balance
+};
+
+struct Journal {
+    int fd;
+    enum BankDurability sync;
+    int batchDepth;      // > 0 while inside journalBeginBatch / journalEndBatch
+    size_t used;         // bytes waiting in 'buffer'
+    int unsynced;        // 1 if data was written since the last fsync
+    unsigned long syncs; // number of fsyncs issued this session
+    unsigned char buffer[JOURNAL_BUFFER_SIZE];
+};
+
+// --- snapshots (snapshot.c) ---
+#define SNAPSHOT_FILE "snapshot.dat"
+#define SNAPSHOT_TEMP_FILE "snapshot.tmp"
+#define SNAPSHOT_JOURNAL_RECORDS 100000 // take a snapshot once the journal holds this many records
+
+// --- the old text layout (legacy.c) ---
+#define ACCOUNT_LIST_FILE "index.txt"
+
+// --- locks shared by every process using the database (lock.c) ---
+// locks.dat is mapped by every open handle and holds process-shared robust mutexes: one per stripe of
+// accounts, one for the structure of the store and index, and one for appending to the journal
+#define LOCK_FILE "locks.dat"
+#define LOCK_MAGIC 0x314B434Cu // "LCK1"
+#define LOCK_VERSION 1
+#define LOCK_STRIPES 256
+
+struct LockTable {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t indexGeneration; // odd while index.dat is being rebuilt, handles remap it when it changes
+    uint32_t repair;          // set when a lock was taken over from a process that died holding it
+    uint64_t nextLsn;         // LSN of the next journal record, whoever writes it
+    uint64_t journalRecords;  // records in the journal file, reset by each snapshot
+    pthread_mutex_t structure; // store header, free list, allocator and index inserts/removals
+    pthread_mutex_t journal;   // LSN assignment and appends to journal.wal
+    pthread_mutex_t stripes[LOCK_STRIPES]; // balances of the accounts that hash to each stripe
+};
+
+// --- daemon protocol (server.c, client.c) ---
+// a server owns the database and answers requests from clients over a Unix-domain socket. every message is
+// a WireHeader followed by 'length' bytes of payload; a response echoes the request's op and carries an
+// enum BankError in 'status'. both ends are on the same machine, so fields are in native byte order
+#define WIRE_MAGIC 0xB4
+#define WIRE_MAX_PAYLOAD 4096
+#define WIRE_LIST_BATCH 256 // account numbers per WIRE_LIST response
+
+enum WireOp {
+    WIRE_COUNT = 1, // -> uint32_t count
+    WIRE_LOOKUP,    // WireAccountRequest -> struct Account
+    WIRE_LIST,      // -> WIRE_LIST_BATCH account numbers (13 bytes each) per response, an empty one ends the list
+    WIRE_CREATE,    // struct Account -> struct Account with its new number
+    WIRE_DELETE,    // WireAccountRequest -> nothing
+    WIRE_DEPOSIT,   // WireAmountRequest -> WireAmountResponse
+    WIRE_WITHDRAW,  // WireAmountRequest -> WireAmountResponse
+    WIRE_TRANSFER,  // WireAmountRequest -> WireAmountResponse with the fee rate and the sender's balance
+    WIRE_LIST_PAGE, // WireListRequest -> WireListResponse, one page of at most WIRE_LIST_BATCH numbers
+    WIRE_CUSTOMER,  // WireCustomerRequest -> the customer's account numbers, streamed like WIRE_LIST
+    WIRE_SEARCH     // WireSearchRequest -> WireSearchResponse
+};
+
+struct WireHeader {
+    uint8_t magic;
+    uint8_t op;
+    uint8_t status;
+    uint8_t reserved;
+    uint32_t length;
+};
+
+struct WireAccountRequest {
+    char accountNumber[13];
+};
+
+struct WireCustomerRequest {
+    char ID[13];
+};
+
+// 'max' is at most BANK_SEARCH_MAX
+struct WireSearchRequest {
+    char query[100];
+    int32_t max;
+};
+
+struct WireSearchResponse {
+    uint32_t count;
+    struct BankNameMatch matches[BANK_SEARCH_MAX];
+};
+
+struct WireAmountRequest {
+    int64_t amount;
+    char accountNumber[13]; // the sender of a transfer
+    char toAccount[13];
+};
+
+struct WireAmountResponse {
+    int64_t balance;
+    int32_t feeBps;
+};
+
+// a struct BankListQuery with the strings inline, 'limit' is at most WIRE_LIST_BATCH
+struct WireListRequest {
+    char prefix[13];
+    char from[13];
+    char to[13];
+    char after[13];
+    int32_t limit;
+};
+
+struct WireListResponse {
+    uint32_t count;
+    char next[13];
+    char numbers[WIRE_LIST_BATCH][13];
+};
+
+// --- sharded execution engine (engine.c) ---
+enum EngineOp {
+    ENGINE_DEPOSIT,
+    ENGINE_WITHDRAW,
+    ENGINE_TRANSFER,
+    ENGINE_PARK, // stop until the shard that sent it is done with a transfer
+    ENGINE_STOP
+};
+
+// --- account cache (cache.c) ---
+#define CACHE_ACCOUNTS 4096 // decoded accounts kept per handle
+
+// --- transaction history (history.c, written by log.c) ---
+// every logged event is one fixed-size record appended to history.dat. the records of an account are
+// chained newest to oldest, and history.idx maps each account to its newest record, so a statement reads only
+// that account's records. record times never go backwards in the file, so a time range is a binary search.
+// appends and index changes happen under an exclusive flock on history.idx, readers take it shared
+#define HISTORY_FILE "history.dat"
+#define HISTORY_INDEX_FILE "history.idx"
+#define HISTORY_MAGIC 0x31484E42u // "BNH1"
+#define HISTORY_INDEX_MAGIC 0x31494E42u // "BNI1"
+#define HISTORY_VERSION 1
+#define HISTORY_INDEX_CAPACITY 1024 // initial entries, doubled whenever it is half full
+#define HISTORY_NONE UINT64_MAX
+
+struct HistoryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;  // sizeof(struct HistoryRecord) when the file was created
+    uint32_t reserved[13]; // pad header to 64 bytes, records follow
+};
+
+struct HistoryRecord {
+    int64_t time;           // seconds since the epoch
+    int64_t amount;         // sen, or the records run by a batch
+    int64_t fee;
+    int64_t balance;        // the account's balance afterwards, or the records of a batch that succeeded
+    uint64_t previous;      // the account's record before this one, HISTORY_NONE if this is its first
+    uint64_t otherPrevious; // the same for 'other'
+    uint8_t event;          // enum BankLogEvent
+    char account[13];
+    char other[13];         // the receiver of a transfer
+    uint8_t reserved[5];    // pad record to 80 bytes
+};
+
+struct HistoryIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;    // entries, a power of two
+    uint32_t count;       // accounts in the table
+    uint64_t covered;     // records [0, covered) are linked into the table
+    uint64_t pending;     // end of the batch being appended, 0 when none is. after a crash the table is only
+                          // trusted if the file got that far, since it may point into the lost records
+    int64_t lastTime;     // time of record covered - 1, the next records may not be older
+    uint32_t reserved[6]; // pad header to 64 bytes
+};
+
+struct HistoryIndexEntry {
+    uint32_t key;    // accountKey() of the account, INDEX_EMPTY if unused
+    uint32_t padding;
+    uint64_t newest; // its newest record
+};
+
+struct History {
+    int fd;          // history.dat
+    int indexFd;     // history.idx, -1 if a reader found none
+    int writable;
+    struct HistoryIndexHeader *index; // mapping of history.idx, only used with the flock held
+                                      // (historyMapIndex() checks it against the file first)
+    size_t indexSize;
+};
+
+// --- the handle ---
+struct Bank {
+    int remoteFd;                // socket to a server when opened with bankConnect(), -1 for a local database
+    pthread_mutex_t remoteLock;  // one request at a time on 'remoteFd'
+    struct Engine *engine;       // shard threads balance changes are handed to, NULL until bankStartEngine()
+    struct AccountCache *cache;  // recently used accounts, NULL if it couldn't be allocated
+    struct NameIndex *names;     // name search index, built by the first search, NULL if it couldn't be allocated
+    struct BankLog *log;         // every change is logged here, see bankSetLog(), NULL logs nothing
+    int lockFd;                  // locks.dat, flock'd shared for as long as the handle is open
+    struct LockTable *locks;
+    pthread_mutex_t mapLock;     // extending or replacing this handle's mappings
+    pthread_mutex_t journalLock; // this handle's journal buffer
+    struct Store store;
+    struct Index index;
+    struct Order order;
+    struct Filter filter;
+    struct Customers customers;
+    struct Journal journal;
+    char directory[PATH_MAX - 64]; // leaves room for the file names appended by bankPath()
+};
+
+// full path of 'name' inside the database directory, 'out' holds PATH_MAX bytes
+void bankPath(const struct Bank *bank, const char *name, char *out);
+
+int storeOpen(struct Bank *bank);
+void storeClose(struct Bank *bank);
+int storeRead(struct Bank *bank, int slot, struct Account *out);
+int storeInsert(struct Bank *bank, const struct Account *account);
+int storeWriteBalance(struct Bank *bank, int slot, int64_t balance);
+int storeRemove(struct Bank *bank, int slot);
+int storeReclaim(struct Bank *bank);
+int storeRefresh(struct Bank *bank);
+int storeReadOptimistic(struct Bank *bank, int slot, struct Account *out, uint32_t *seq);
+uint32_t storeSeq(struct Bank *bank, int slot);
+void storeResetSeq(struct Bank *bank);
+
+int indexRebuild(struct Bank *bank, uint32_t capacity);
+int indexOpen(struct Bank *bank);
+void indexClose(struct Bank *bank);
+int accountKey(const char *accountNumber, uint32_t *key);
+uint32_t indexHash(uint32_t key);
+int lookupAccount(struct Bank *bank, const char *accountNumber);
+int indexInsert(struct Bank *bank, const char *accountNumber, int slot);
+int indexRemove(struct Bank *bank, const char *accountNumber);
+int indexRefresh(struct Bank *bank);
+int indexHasRoom(struct Bank *bank);
+int indexMakeRoom(struct Bank *bank);
+int findAccount(struct Bank *bank, const char *accountNumber, struct Account *out);
+
+int orderOpen(struct Bank *bank);
+void orderClose(struct Bank *bank);
+int orderRefresh(struct Bank *bank);
+int orderRebuild(struct Bank *bank);
+int orderInsert(struct Bank *bank, const char *accountNumber, int slot);
+int orderRemove(struct Bank *bank, const char *accountNumber);
+int orderFind(struct Bank *bank, const char *accountNumber);
+enum BankError listPage(struct Bank *bank, const struct BankListQuery *query,
+                        void (*visit)(const char *accountNumber, void *context), void *context, char *next);
+
+int filterOpen(struct Bank *bank);
+void filterClose(struct Bank *bank);
+int filterRefresh(struct Bank *bank);
+int filterRebuild(struct Bank *bank, uint32_t buckets);
+int filterInsert(struct Bank *bank, const char *accountNumber);
+int filterRemove(struct Bank *bank, const char *accountNumber);
+int filterMayContain(struct Bank *bank, const char *accountNumber);
+
+int customerOpen(struct Bank *bank);
+void customerClose(struct Bank *bank);
+int customerRefresh(struct Bank *bank);
+int customerRebuild(struct Bank *bank);
+int customerInsert(struct Bank *bank, const struct Account *account);
+int customerRemove(struct Bank *bank, const struct Account *account);
+
+int allocateAccountNumber(struct Bank *bank, char *out);
+
+int journalFlush(struct Bank *bank, int durable);
+int journalAppend(struct Bank *bank, struct JournalRecord *record);
+int journalCommit(struct Bank *bank);
+void journalBeginBatch(struct Bank *bank);
+int journalEndBatch(struct Bank *bank);
+int journalBalance(struct Bank *bank, const char *accountNumber, int64_t amount, int64_t balance);
+int journalAccount(struct Bank *bank, enum JournalType type, const struct Account *account);
+void journalSyncStore(struct Bank *bank);
+int journalOpen(struct Bank *bank, enum BankDurability sync, int recover);
+int journalRecover(struct Bank *bank);
+void journalClose(struct Bank *bank);
+
+int checkpoint(struct Bank *bank);
+int needsCheckpoint(struct Bank *bank);
+void maybeCheckpoint(struct Bank *bank);
+int restoreFromSnapshot(struct Bank *bank);
+
+int parseMoneyText(const char *text, size_t length, int64_t *sen);
+
+int parseAccountText(const char *text, size_t length, struct Account *out);
+int readAccountFile(const char *path, struct Account *out);
+
+int convertLegacyDatabase(struct Bank *bank);
+void removeLegacyFile(struct Bank *bank, const char *accountNumber);
+
+int wireSocket(int fd);
+int wireSend(int fd, uint8_t op, uint8_t status, const void *payload, uint32_t length);
+int wireReceive(int fd, struct WireHeader *header, void *payload, uint32_t size);
+void clientClose(struct Bank *bank);
+int clientCount(struct Bank *bank);
+enum BankError clientLookup(struct Bank *bank, const char *accountNumber, struct Account *out);
+enum BankError clientList(struct Bank *bank, void (*visit)(const char *accountNumber, void *context), void *context);
+enum BankError clientListPage(struct Bank *bank, const struct BankListQuery *query,
+                              void (*visit)(const char *accountNumber, void *context), void *context, char *next);
+enum BankError clientCustomerAccounts(struct Bank *bank, const char *ID,
+                                      void (*visit)(const char *accountNumber, void *context), void *context);
+enum BankError clientSearchNames(struct Bank *bank, const char *query, struct BankNameMatch *out, int max,
+                                 int *found);
+enum BankError clientCreate(struct Bank *bank, struct Account *account);
+enum BankError clientDelete(struct Bank *bank, const char *accountNumber);
+enum BankError clientAmount(struct Bank *bank, enum WireOp op, const char *from, const char *to, int64_t amount,
+                            int32_t *feeBps, int64_t *balance);
+
+enum BankError engineSubmit(struct Bank *bank, enum EngineOp op, const char *from, const char *to, int64_t amount,
+                            int32_t *feeBps, int64_t *balance);
+void engineStop(struct Bank *bank);
+
+struct AccountCache *cacheCreate(void);
+void cacheDestroy(struct AccountCache *cache);
+int cacheLookup(struct Bank *bank, const char *accountNumber, struct Account *out);
+void cacheStore(struct Bank *bank, int slot, const struct Account *account, uint32_t seq);
+int cacheRead(struct Bank *bank, const char *accountNumber, struct Account *out);
+int cacheWriteBalance(struct Bank *bank, int slot, struct Account *account);
+
+struct NameIndex *nameCreate(void);
+void nameDestroy(struct NameIndex *names);
+void nameInsert(struct Bank *bank, int slot, const struct Account *account);
+void nameRemove(struct Bank *bank, int slot);
+
+int historyOpen(struct History *history, const char *directory, int writable);
+void historyClose(struct History *history);
+int historyAppend(struct History *history, struct HistoryRecord *records, size_t count);
+
+int lockOpen(struct Bank *bank, int *alone);
+void lockShare(struct Bank *bank);
+void lockClose(struct Bank *bank);
+int lockMutex(struct Bank *bank, pthread_mutex_t *mutex);
+void lockAccount(struct Bank *bank, const char *accountNumber);
+void unlockAccount(struct Bank *bank, const char *accountNumber);
+void lockAccountPair(struct Bank *bank, const char *first, const char *second);
+void unlockAccountPair(struct Bank *bank, const char *first, const char *second);
+void lockStructure(struct Bank *bank);
+void unlockStructure(struct Bank *bank);
+void lockAll(struct Bank *bank);
+void unlockAll(struct Bank *bank);
+void repairIfNeeded(struct Bank *bank);
+int stripeOf(const char *accountNumber);
+
+// 1 if 'text' is non-empty and all digits
+int isDigits(const char *text);
+
+// unlocked operations, bank.c wraps them in the locks they need and batch.c calls them under lockAll()
+enum BankError addAccount(struct Bank *bank, struct Account *account);
+enum BankError removeAccount(struct Bank *bank, const char *accountNumber);
+enum BankError applyBalance(struct Bank *bank, char operation, int64_t amount, const char *accountNumber,
+                            int64_t *newBalance);
+// 'pricedFee' is the fee if the caller already computed it, -1 to compute it here
+enum BankError transferFunds(struct Bank *bank, const char *senderNumber, const char *receiverNumber, int64_t amount,
+                             int64_t pricedFee, int32_t *feeBps, int64_t *senderBalance);
+
+#endif
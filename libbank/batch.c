@@ -0,0 +1,527 @@
+// --- batch mode ---
+// bankRunBatch() runs a file of transactions without the menu, one per line:
+//   create <savings|current> <ID> <PIN> <full name>
+//   deposit <account> <amount>
+//   withdraw <account> <amount>
+//   transfer <from account> <to account> <amount>
+// blank lines and lines starting with '#' are skipped. every record goes through the same checks as the
+// menu and gets one line in the result file. a parser thread reads ahead while the executor runs the
+// previous chunk, and each chunk is committed as one journal batch.
+// inside a chunk, records that touch different accounts don't depend on each other: each record waits only
+// for the previous record of every account it touches, and a pool of worker threads runs whatever isn't
+// waiting. every account still sees its records in file order, so the results are the same as running them
+// one after another. creates take the next account number from the allocator, so a create waits for
+// everything before it and everything after it waits for the create
+#include "bank_internal.h"
+
+#define BATCH_CHUNK_RECORDS 1024 // records executed and committed together
+#define BATCH_QUEUE_CHUNKS 4     // parsed chunks the parser may run ahead of the executor
+#define BATCH_LINE_SIZE 256
+#define BATCH_MAX_WORKERS 16     // threads running records besides the executor
+#define BATCH_CONFLICT_SLOTS (BATCH_CHUNK_RECORDS * 4) // last record per account, a power of two
+#define BATCH_NONE (-1)
+
+enum BatchOp {
+    BATCH_INVALID, // line couldn't be parsed, 'error' says why
+    BATCH_CREATE,
+    BATCH_DEPOSIT,
+    BATCH_WITHDRAW,
+    BATCH_TRANSFER
+};
+
+struct BatchRecord {
+    enum BatchOp op;
+    unsigned long line;      // line number in the input file, echoed in the result
+    char accountNumber[13];  // account of a deposit or withdrawal, sender of a transfer
+    char toAccount[13];      // receiver of a transfer
+    int64_t amount;
+    int64_t fee;             // fee of a transfer priced with the rest of the chunk, -1 if it is priced when it runs
+    struct Account account;  // the new account of a create
+    const char *error;       // NULL once executed successfully
+    int64_t balance;         // resulting balance of 'accountNumber'
+    int pending;             // earlier records of the chunk this one still waits for
+    int depth;               // longest chain of records it waits for, itself included
+    int32_t next[2];         // the next record of 'accountNumber' and of 'toAccount', or BATCH_NONE
+};
+
+struct BatchChunk {
+    size_t count;
+    struct BatchRecord records[BATCH_CHUNK_RECORDS];
+};
+
+// ring of chunks between the parser thread and the executor
+struct BatchQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    struct BatchChunk *chunks; // BATCH_QUEUE_CHUNKS of them
+    size_t head, tail;         // chunks [head, tail) are parsed and waiting to be executed
+    int done;                  // the parser reached the end of the input
+    int stop;                  // the executor gave up, the parser should stop too
+    FILE *input;
+};
+
+// the latest record of the segment that touches an account
+struct BatchConflict {
+    uint32_t key;      // accountKey() of the account
+    uint32_t segment;  // the entry is only valid while this matches BatchPool.segment
+    int32_t record;
+    int32_t side;      // which of the record's accounts it is, an index into 'next'
+};
+
+// worker threads sharing the records of one segment of a chunk. 'pending', 'next', the ready stack and
+// 'remaining' are only touched under 'lock'
+struct BatchPool {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    struct Bank *bank;
+    struct BatchRecord *records;    // the chunk being run
+    int32_t ready[BATCH_CHUNK_RECORDS]; // records that wait for nothing, taken from the top
+    size_t readyCount;
+    size_t remaining;               // records of the segment not finished yet
+    int quit;
+    int workers;
+    pthread_t threads[BATCH_MAX_WORKERS];
+    uint32_t segment;
+    struct BatchConflict conflicts[BATCH_CONFLICT_SLOTS];
+    // the chunk's transfers as batchPriceTransfers() hands them to computeFees()
+    int64_t amounts[BATCH_CHUNK_RECORDS];
+    int32_t rates[BATCH_CHUNK_RECORDS];
+    int64_t fees[BATCH_CHUNK_RECORDS];
+    int32_t priced[BATCH_CHUNK_RECORDS]; // the record each of them belongs to
+};
+
+// copy the next whitespace separated field into 'out', returns 0 if there is none or it doesn't fit
+int batchField(char **cursor, char *out, size_t size) {
+    char *start = *cursor + strspn(*cursor, " \t");
+    size_t length = strcspn(start, " \t");
+    if (length == 0 || length >= size) return 0;
+    memcpy(out, start, length);
+    out[length] = '\0';
+    *cursor = start + length;
+    return 1;
+}
+
+// turn one input line into a record, the same field rules as the menu apply
+void batchParseLine(char *line, struct BatchRecord *record) {
+    char op[16], amount[MONEY_TEXT_SIZE];
+    char *cursor = line;
+    record->op = BATCH_INVALID;
+    record->error = "unknown operation";
+    if (!batchField(&cursor, op, sizeof(op))) return;
+    for (char *c = op; *c != '\0'; c++) *c = (char)tolower((unsigned char)*c);
+
+    if (strcmp(op, "create") == 0) {
+        struct Account *account = &record->account;
+        char type[10];
+        memset(account, 0, sizeof(*account));
+        record->error = "expected: create <savings|current> <ID> <PIN> <full name>";
+        if (!batchField(&cursor, type, sizeof(type)) || !batchField(&cursor, account->ID, sizeof(account->ID)) ||
+            !batchField(&cursor, account->pin, sizeof(account->pin))) {
+            return;
+        }
+        // the name is the rest of the line
+        cursor += strspn(cursor, " \t");
+        size_t nameLength = strlen(cursor);
+        while (nameLength > 0 && isspace((unsigned char)cursor[nameLength - 1])) nameLength--;
+        if (nameLength == 0 || nameLength >= sizeof(account->name)) return;
+        memcpy(account->name, cursor, nameLength);
+
+        for (char *c = type; *c != '\0'; c++) *c = (char)tolower((unsigned char)*c);
+        if (strcmp(type, "0") == 0 || strcmp(type, "savings") == 0) {
+            strcpy(account->type, "Savings");
+        } else if (strcmp(type, "1") == 0 || strcmp(type, "current") == 0) {
+            strcpy(account->type, "Current");
+        } else {
+            record->error = "invalid account type, expected savings or current";
+            return;
+        }
+        if (!isDigits(account->ID) || strlen(account->ID) < 8) {
+            record->error = "invalid ID, must be 8-12 digits";
+            return;
+        }
+        if (!isDigits(account->pin) || strlen(account->pin) != 4) {
+            record->error = "invalid PIN, must be 4 digits";
+            return;
+        }
+        record->op = BATCH_CREATE;
+        record->error = NULL;
+        return;
+    }
+
+    enum BatchOp parsed;
+    if (strcmp(op, "deposit") == 0) {
+        parsed = BATCH_DEPOSIT;
+        record->error = "expected: deposit <account> <amount>";
+    } else if (strcmp(op, "withdraw") == 0) {
+        parsed = BATCH_WITHDRAW;
+        record->error = "expected: withdraw <account> <amount>";
+    } else if (strcmp(op, "transfer") == 0) {
+        parsed = BATCH_TRANSFER;
+        record->error = "expected: transfer <from account> <to account> <amount>";
+    } else {
+        return;
+    }
+    if (!batchField(&cursor, record->accountNumber, sizeof(record->accountNumber))) return;
+    if (parsed == BATCH_TRANSFER && !batchField(&cursor, record->toAccount, sizeof(record->toAccount))) return;
+    if (!batchField(&cursor, amount, sizeof(amount)) || cursor[strspn(cursor, " \t")] != '\0') return;
+    if (!parseMoney(amount, &record->amount)) {
+        record->error = "invalid amount";
+        return;
+    }
+    record->op = parsed;
+    record->error = NULL;
+}
+
+// parser thread: fill free chunks from the input and hand them to the executor
+void *batchParser(void *arg) {
+    struct BatchQueue *queue = arg;
+    char line[BATCH_LINE_SIZE];
+    unsigned long lineNumber = 0;
+    int finished = 0;
+
+    while (!finished) {
+        // wait for a free chunk, it belongs to this thread until it is published
+        pthread_mutex_lock(&queue->lock);
+        while (queue->tail - queue->head == BATCH_QUEUE_CHUNKS && !queue->stop) {
+            pthread_cond_wait(&queue->changed, &queue->lock);
+        }
+        int stop = queue->stop;
+        struct BatchChunk *chunk = &queue->chunks[queue->tail % BATCH_QUEUE_CHUNKS];
+        pthread_mutex_unlock(&queue->lock);
+        if (stop) break;
+
+        chunk->count = 0;
+        while (chunk->count < BATCH_CHUNK_RECORDS) {
+            if (fgets(line, sizeof(line), queue->input) == NULL) {
+                finished = 1;
+                break;
+            }
+            lineNumber++;
+
+            struct BatchRecord *record = &chunk->records[chunk->count];
+            size_t length = strcspn(line, "\r\n");
+            if (line[length] == '\0' && !feof(queue->input)) {
+                // longer than any valid record, drop the rest of it
+                int ch;
+                while ((ch = fgetc(queue->input)) != '\n' && ch != EOF);
+                record->op = BATCH_INVALID;
+                record->error = "line too long";
+            } else {
+                line[length] = '\0';
+                char *start = line + strspn(line, " \t");
+                if (*start == '\0' || *start == '#') continue;
+                batchParseLine(start, record);
+            }
+            record->line = lineNumber;
+            chunk->count++;
+        }
+
+        // publish the chunk
+        pthread_mutex_lock(&queue->lock);
+        if (chunk->count > 0) queue->tail++;
+        if (finished) queue->done = 1;
+        pthread_cond_broadcast(&queue->changed);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    queue->done = 1;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+// run one parsed record, leaves 'error' NULL and sets 'balance' on success
+void batchExecute(struct Bank *bank, struct BatchRecord *record) {
+    if (record->op == BATCH_INVALID) return;
+
+    enum BankError error;
+    if (record->op == BATCH_CREATE) {
+        error = addAccount(bank, &record->account);
+        if (error == BANK_OK) {
+            strcpy(record->accountNumber, record->account.accountNumber);
+            record->balance = 0;
+        }
+    } else if (record->op == BATCH_TRANSFER) {
+        error = transferFunds(bank, record->accountNumber, record->toAccount, record->amount, record->fee, NULL,
+                              &record->balance);
+        if (error == BANK_INSUFFICIENT_FUNDS) {
+            record->error = "insufficient balance for the amount and fee";
+            return;
+        }
+    } else {
+        char operation = record->op == BATCH_DEPOSIT ? '+' : '-';
+        error = applyBalance(bank, operation, record->amount, record->accountNumber, &record->balance);
+    }
+    if (error != BANK_OK) record->error = bankErrorText(error);
+}
+
+// make 'index' wait for the previous record of the segment that touched 'accountNumber', 'side' says which
+// of its accounts it is. numbers that aren't account numbers can't match an account, so they conflict with
+// nothing
+void batchConflict(struct BatchPool *pool, int32_t index, const char *accountNumber, int32_t side) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key)) return;
+    struct BatchRecord *record = &pool->records[index];
+    uint32_t slot = indexHash(key) >> 20; // the top 12 bits, BATCH_CONFLICT_SLOTS entries
+    for (;; slot = (slot + 1) & (BATCH_CONFLICT_SLOTS - 1)) {
+        struct BatchConflict *conflict = &pool->conflicts[slot];
+        if (conflict->segment != pool->segment) break;
+        if (conflict->key != key) continue;
+        if (conflict->record == index) return; // a transfer from an account to itself
+        struct BatchRecord *previous = &pool->records[conflict->record];
+        previous->next[conflict->side] = index;
+        record->pending++;
+        if (previous->depth + 1 > record->depth) record->depth = previous->depth + 1;
+        break;
+    }
+    pool->conflicts[slot] = (struct BatchConflict){key, pool->segment, index, side};
+}
+
+// take ready records and run them. a worker keeps doing that until the pool quits, the executor until every
+// record of the segment is finished
+void batchWork(struct BatchPool *pool, int executor) {
+    pthread_mutex_lock(&pool->lock);
+    while (executor ? pool->remaining > 0 : !pool->quit) {
+        if (pool->readyCount == 0) {
+            pthread_cond_wait(&pool->changed, &pool->lock);
+            continue;
+        }
+        int32_t index = pool->ready[--pool->readyCount];
+        pthread_mutex_unlock(&pool->lock);
+
+        struct BatchRecord *record = &pool->records[index];
+        batchExecute(pool->bank, record);
+
+        pthread_mutex_lock(&pool->lock);
+        int woken = 0;
+        for (int side = 0; side < 2; side++) {
+            int32_t next = record->next[side];
+            if (next != BATCH_NONE && --pool->records[next].pending == 0) {
+                pool->ready[pool->readyCount++] = next;
+                woken++;
+            }
+        }
+        // this thread takes one of them itself, the others need someone awake
+        for (; woken > 1; woken--) pthread_cond_signal(&pool->changed);
+        if (--pool->remaining == 0) pthread_cond_broadcast(&pool->changed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void *batchWorker(void *arg) {
+    batchWork(arg, 0);
+    return NULL;
+}
+
+// run records [first, last) of the chunk, none of them a create. returns the longest chain of conflicting
+// records among them
+int batchRunSegment(struct BatchPool *pool, size_t first, size_t last) {
+    pool->segment++;
+    int depth = 0;
+    for (size_t i = first; i < last; i++) {
+        struct BatchRecord *record = &pool->records[i];
+        record->pending = 0;
+        record->depth = 1;
+        record->next[0] = record->next[1] = BATCH_NONE;
+        if (record->op != BATCH_INVALID) {
+            batchConflict(pool, (int32_t)i, record->accountNumber, 0);
+            if (record->op == BATCH_TRANSFER) batchConflict(pool, (int32_t)i, record->toAccount, 1);
+        }
+        if (record->depth > depth) depth = record->depth;
+    }
+    if (pool->workers == 0 || depth == (int)(last - first)) {
+        // nothing to run side by side
+        for (size_t i = first; i < last; i++) batchExecute(pool->bank, &pool->records[i]);
+        return depth;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    // pushed last to first, so the workers start near the front of the file
+    for (size_t i = last; i-- > first;) {
+        if (pool->records[i].pending == 0) pool->ready[pool->readyCount++] = (int32_t)i;
+    }
+    pool->remaining = last - first;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+    batchWork(pool, 1);
+    return depth;
+}
+
+// price every transfer of a chunk with one computeFees() call. account types never change, so the rate read
+// here is the one the transfer finds when it runs; a transfer whose accounts aren't there is priced then
+void batchPriceTransfers(struct BatchPool *pool, struct BatchChunk *chunk) {
+    size_t count = 0;
+    for (size_t i = 0; i < chunk->count; i++) {
+        struct BatchRecord *record = &chunk->records[i];
+        record->fee = -1;
+        if (record->op != BATCH_TRANSFER || !(record->amount > 0 && record->amount <= DEPOSIT_LIMIT_SEN)) continue;
+        struct Account sender, receiver;
+        if (cacheRead(pool->bank, record->accountNumber, &sender) < 0 ||
+            cacheRead(pool->bank, record->toAccount, &receiver) < 0 ||
+            !remittanceFee(sender.type, receiver.type, &pool->rates[count])) {
+            continue;
+        }
+        pool->amounts[count] = record->amount;
+        pool->priced[count++] = (int32_t)i;
+    }
+    computeFees(pool->amounts, pool->rates, pool->fees, count);
+    for (size_t i = 0; i < count; i++) {
+        chunk->records[pool->priced[i]].fee = pool->fees[i];
+    }
+}
+
+// run every record of a chunk, returns the number of steps that took when each step runs every record that
+// isn't waiting for another one. called with every lock held
+unsigned long batchRunChunk(struct BatchPool *pool, struct BatchChunk *chunk) {
+    unsigned long waves = 0;
+    batchPriceTransfers(pool, chunk);
+    pool->records = chunk->records;
+    size_t first = 0;
+    while (first < chunk->count) {
+        if (chunk->records[first].op == BATCH_CREATE) {
+            batchExecute(pool->bank, &chunk->records[first++]);
+            waves++;
+            continue;
+        }
+        size_t last = first;
+        while (last < chunk->count && chunk->records[last].op != BATCH_CREATE) last++;
+        waves += (unsigned long)batchRunSegment(pool, first, last);
+        first = last;
+    }
+    return waves;
+}
+
+// start 'workers' threads, fewer if some can't be created
+struct BatchPool *batchStartPool(struct Bank *bank, int workers) {
+    struct BatchPool *pool = calloc(1, sizeof(struct BatchPool));
+    if (pool == NULL) return NULL;
+    pool->bank = bank;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->changed, NULL);
+    while (pool->workers < workers &&
+           pthread_create(&pool->threads[pool->workers], NULL, batchWorker, pool) == 0) {
+        pool->workers++;
+    }
+    return pool;
+}
+
+void batchStopPool(struct BatchPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->workers; i++) pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->changed);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+// run every record of 'inputPath' and write "<line> OK <account> <balance>" or "<line> ERROR <reason>"
+// for each of them to 'outputPath'. the whole database is locked one chunk at a time, so other callers
+// and processes can interleave with a long batch, and the worker threads run inside that lock
+enum BankError bankRunBatch(struct Bank *bank, const char *inputPath, const char *outputPath,
+                            struct BankBatchStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (bank->remoteFd >= 0) return BANK_NOT_SUPPORTED;
+    FILE *input = fopen(inputPath, "r");
+    if (input == NULL) return BANK_IO_ERROR;
+    FILE *output = fopen(outputPath, "w");
+    if (output == NULL) {
+        fclose(input);
+        return BANK_IO_ERROR;
+    }
+
+    struct BatchQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    queue.input = input;
+    queue.chunks = malloc(BATCH_QUEUE_CHUNKS * sizeof(struct BatchChunk));
+    if (queue.chunks == NULL) {
+        fclose(output);
+        fclose(input);
+        return BANK_IO_ERROR;
+    }
+    // the executor runs records too, so one worker less than there are CPUs
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (workers > BATCH_MAX_WORKERS) workers = BATCH_MAX_WORKERS;
+    struct BatchPool *pool = batchStartPool(bank, workers);
+    if (pool == NULL) {
+        free(queue.chunks);
+        fclose(output);
+        fclose(input);
+        return BANK_IO_ERROR;
+    }
+    stats->workers = pool->workers + 1;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.changed, NULL);
+
+    struct timespec started, ended;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    enum BankError error = BANK_OK;
+
+    pthread_t parser;
+    int parserStarted = pthread_create(&parser, NULL, batchParser, &queue) == 0;
+    if (!parserStarted) error = BANK_IO_ERROR;
+    while (error == BANK_OK) {
+        pthread_mutex_lock(&queue.lock);
+        while (queue.head == queue.tail && !queue.done) {
+            pthread_cond_wait(&queue.changed, &queue.lock);
+        }
+        int empty = queue.head == queue.tail;
+        struct BatchChunk *chunk = &queue.chunks[queue.head % BATCH_QUEUE_CHUNKS];
+        pthread_mutex_unlock(&queue.lock);
+        if (empty) break; // parser is done and everything was executed
+
+        // every record reaches journal.wal before its change is applied and the whole chunk shares one fsync.
+        // if that fsync fails the chunk's changes are applied but may not be durable: their results are still
+        // reported, since they are what the store holds, and the run stops there
+        lockAll(bank);
+        unsigned long syncs = bank->journal.syncs;
+        journalBeginBatch(bank);
+        stats->waves += batchRunChunk(pool, chunk);
+        int committed = journalEndBatch(bank);
+        stats->syncs += bank->journal.syncs - syncs;
+        if (committed && needsCheckpoint(bank)) checkpoint(bank);
+        unlockAll(bank);
+        repairIfNeeded(bank);
+        if (!committed) error = BANK_JOURNAL_ERROR;
+
+        for (size_t i = 0; i < chunk->count; i++) {
+            const struct BatchRecord *record = &chunk->records[i];
+            char money[MONEY_TEXT_SIZE];
+            if (record->error == NULL) {
+                fprintf(output, "%lu OK %s %s\n", record->line, record->accountNumber, formatMoney(record->balance, money));
+                stats->succeeded++;
+            } else {
+                fprintf(output, "%lu ERROR %s\n", record->line, record->error);
+            }
+        }
+        stats->records += chunk->count;
+        if (error != BANK_OK) break;
+
+        // hand the chunk back to the parser
+        pthread_mutex_lock(&queue.lock);
+        queue.head++;
+        pthread_cond_broadcast(&queue.changed);
+        pthread_mutex_unlock(&queue.lock);
+    }
+    if (parserStarted) {
+        // after a failed commit the parser may be waiting for a free chunk
+        pthread_mutex_lock(&queue.lock);
+        if (error != BANK_OK) queue.stop = 1;
+        pthread_cond_broadcast(&queue.changed);
+        pthread_mutex_unlock(&queue.lock);
+        pthread_join(parser, NULL);
+    }
+    batchStopPool(pool);
+    clock_gettime(CLOCK_MONOTONIC, &ended);
+    stats->seconds = (ended.tv_sec - started.tv_sec) + (ended.tv_nsec - started.tv_nsec) / 1e9;
+
+    if (ferror(input) && error == BANK_OK) error = BANK_IO_ERROR;
+    if (fclose(output) != 0 && error == BANK_OK) error = BANK_IO_ERROR;
+    fclose(input);
+    pthread_cond_destroy(&queue.changed);
+    pthread_mutex_destroy(&queue.lock);
+    free(queue.chunks);
+    return error;
+}
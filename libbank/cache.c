@@ -0,0 +1,183 @@
+// --- account cache ---
+// each handle keeps the accounts it used most recently, decoded, in a bounded LRU cache keyed by account
+// number. an entry remembers the store slot and the slot's seq at the time it was copied: every write to a
+// slot (from any process) changes its seq, so a hit only has to see the same seq to know the copy is still
+// exact. that skips the index probe and the optimistic copy out of the store. balance changes write the new
+// record through to the cache as well as the store, so an account stays cached across operations.
+// the cache is split into shards by account number, each with its own lock and LRU list, so threads sharing
+// the handle rarely wait on each other
+#include "bank_internal.h"
+
+#define CACHE_SHARDS 64
+#define CACHE_SHARD_ENTRIES (CACHE_ACCOUNTS / CACHE_SHARDS)
+#define CACHE_BUCKETS 128 // hash chains per shard, a power of two
+#define CACHE_NONE (-1)
+
+struct CacheEntry {
+    uint32_t key;     // accountKey() of the account
+    int32_t slot;
+    uint32_t seq;     // the slot's seq when 'account' was copied, always even
+    int16_t newer;    // LRU list, most recently used first
+    int16_t older;
+    int16_t chain;    // next entry in the same hash bucket
+    struct Account account;
+};
+
+struct CacheShard {
+    pthread_mutex_t lock;
+    int16_t newest;
+    int16_t oldest;
+    int16_t used;     // entries [0, used) are in use
+    int16_t buckets[CACHE_BUCKETS];
+    unsigned long hits;
+    unsigned long misses;
+    struct CacheEntry entries[CACHE_SHARD_ENTRIES];
+};
+
+struct AccountCache {
+    struct CacheShard shards[CACHE_SHARDS];
+};
+
+struct AccountCache *cacheCreate(void) {
+    struct AccountCache *cache = calloc(1, sizeof(struct AccountCache));
+    if (cache == NULL) return NULL;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        struct CacheShard *shard = &cache->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->newest = shard->oldest = CACHE_NONE;
+        for (int b = 0; b < CACHE_BUCKETS; b++) shard->buckets[b] = CACHE_NONE;
+    }
+    return cache;
+}
+
+void cacheDestroy(struct AccountCache *cache) {
+    if (cache == NULL) return;
+    for (int i = 0; i < CACHE_SHARDS; i++) pthread_mutex_destroy(&cache->shards[i].lock);
+    free(cache);
+}
+
+// the shard and hash bucket of a key, from different bits of its hash
+struct CacheShard *cacheShard(struct AccountCache *cache, uint32_t key, int *bucket) {
+    uint32_t hash = indexHash(key);
+    *bucket = (int)(hash & (CACHE_BUCKETS - 1));
+    return &cache->shards[hash >> 26];
+}
+
+int cacheFind(struct CacheShard *shard, int bucket, uint32_t key) {
+    int i = shard->buckets[bucket];
+    while (i != CACHE_NONE && shard->entries[i].key != key) i = shard->entries[i].chain;
+    return i;
+}
+
+void cacheUnlinkLru(struct CacheShard *shard, int i) {
+    struct CacheEntry *entry = &shard->entries[i];
+    if (entry->newer != CACHE_NONE) shard->entries[entry->newer].older = entry->older;
+    else shard->newest = entry->older;
+    if (entry->older != CACHE_NONE) shard->entries[entry->older].newer = entry->newer;
+    else shard->oldest = entry->newer;
+}
+
+void cachePushNewest(struct CacheShard *shard, int i) {
+    struct CacheEntry *entry = &shard->entries[i];
+    entry->newer = CACHE_NONE;
+    entry->older = shard->newest;
+    if (shard->newest != CACHE_NONE) shard->entries[shard->newest].newer = (int16_t)i;
+    shard->newest = (int16_t)i;
+    if (shard->oldest == CACHE_NONE) shard->oldest = (int16_t)i;
+}
+
+void cacheUnlinkChain(struct CacheShard *shard, int i) {
+    int bucket = (int)(indexHash(shard->entries[i].key) & (CACHE_BUCKETS - 1));
+    int16_t *link = &shard->buckets[bucket];
+    while (*link != i) link = &shard->entries[*link].chain;
+    *link = shard->entries[i].chain;
+}
+
+// copy a cached account into 'out' (may be NULL) if its slot hasn't been written since it was cached.
+// returns the slot, or -1 on a miss
+int cacheLookup(struct Bank *bank, const char *accountNumber, struct Account *out) {
+    uint32_t key;
+    int bucket;
+    if (bank->cache == NULL || !accountKey(accountNumber, &key)) return -1;
+    struct CacheShard *shard = cacheShard(bank->cache, key, &bucket);
+
+    pthread_mutex_lock(&shard->lock);
+    int i = cacheFind(shard, bucket, key);
+    int slot = -1;
+    if (i != CACHE_NONE && storeSeq(bank, shard->entries[i].slot) == shard->entries[i].seq) {
+        slot = shard->entries[i].slot;
+        if (out != NULL) *out = shard->entries[i].account;
+        if (shard->newest != i) {
+            cacheUnlinkLru(shard, i);
+            cachePushNewest(shard, i);
+        }
+        shard->hits++;
+    } else {
+        shard->misses++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return slot;
+}
+
+// remember 'account' as the contents of 'slot' at 'seq', replacing the least recently used entry when the
+// shard is full. an odd seq means the copy may be torn, so it isn't kept
+void cacheStore(struct Bank *bank, int slot, const struct Account *account, uint32_t seq) {
+    uint32_t key;
+    int bucket;
+    if (bank->cache == NULL || (seq & 1) || !accountKey(account->accountNumber, &key)) return;
+    struct CacheShard *shard = cacheShard(bank->cache, key, &bucket);
+
+    pthread_mutex_lock(&shard->lock);
+    int i = cacheFind(shard, bucket, key);
+    if (i != CACHE_NONE) {
+        cacheUnlinkLru(shard, i);
+    } else {
+        if (shard->used < CACHE_SHARD_ENTRIES) {
+            i = shard->used++;
+        } else {
+            i = shard->oldest;
+            cacheUnlinkLru(shard, i);
+            cacheUnlinkChain(shard, i);
+        }
+        shard->entries[i].key = key;
+        shard->entries[i].chain = shard->buckets[bucket];
+        shard->buckets[bucket] = (int16_t)i;
+    }
+    shard->entries[i].slot = slot;
+    shard->entries[i].seq = seq;
+    shard->entries[i].account = *account;
+    cachePushNewest(shard, i);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// an account's slot and a copy of it, through the cache. the caller holds the account's lock, so the slot
+// can't change while it is read. returns -1 if there is no such account
+int cacheRead(struct Bank *bank, const char *accountNumber, struct Account *out) {
+    int slot = cacheLookup(bank, accountNumber, out);
+    if (slot >= 0) return slot;
+    if (!filterMayContain(bank, accountNumber)) return -1;
+    slot = lookupAccount(bank, accountNumber);
+    if (!storeRead(bank, slot, out)) return -1;
+    cacheStore(bank, slot, out, storeSeq(bank, slot));
+    return slot;
+}
+
+// write a changed balance to the store and through to the cache. the caller holds the account's lock
+int cacheWriteBalance(struct Bank *bank, int slot, struct Account *account) {
+    if (!storeWriteBalance(bank, slot, account->balance)) return 0;
+    cacheStore(bank, slot, account, storeSeq(bank, slot));
+    return 1;
+}
+
+void bankCacheStats(struct Bank *bank, struct BankCacheStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (bank->cache == NULL) return;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        struct CacheShard *shard = &bank->cache->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->entries += (unsigned long)shard->used;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
@@ -0,0 +1,201 @@
+// --- client side of server mode ---
+// a handle from bankConnect() has no database files of its own. the public functions in bank.c hand their
+// calls to these, which send one request to the server and wait for its response
+#include "bank_internal.h"
+
+enum BankError bankConnect(const char *socketPath, struct Bank **out) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) return BANK_IO_ERROR;
+    strcpy(address.sun_path, socketPath);
+
+    struct Bank *bank = calloc(1, sizeof(struct Bank));
+    if (bank == NULL) return BANK_IO_ERROR;
+    bank->remoteFd = wireSocket(-1);
+    if (bank->remoteFd < 0 || connect(bank->remoteFd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        if (bank->remoteFd >= 0) close(bank->remoteFd);
+        free(bank);
+        return BANK_IO_ERROR;
+    }
+    bank->lockFd = -1;
+    bank->store.fd = -1;
+    bank->index.fd = -1;
+    bank->journal.fd = -1;
+    pthread_mutex_init(&bank->remoteLock, NULL);
+    *out = bank;
+    return BANK_OK;
+}
+
+void clientClose(struct Bank *bank) {
+    close(bank->remoteFd);
+    pthread_mutex_destroy(&bank->remoteLock);
+    free(bank);
+}
+
+// send one request and read its response into 'response', which must be exactly 'size' bytes when the
+// status is BANK_OK. returns the status, BANK_IO_ERROR if the server is gone
+enum BankError clientCall(struct Bank *bank, enum WireOp op, const void *request, uint32_t length, void *response,
+                          uint32_t size) {
+    unsigned char payload[WIRE_MAX_PAYLOAD];
+    struct WireHeader header;
+    pthread_mutex_lock(&bank->remoteLock);
+    int ok = wireSend(bank->remoteFd, (uint8_t)op, BANK_OK, request, length) &&
+             wireReceive(bank->remoteFd, &header, payload, sizeof(payload)) && header.op == op;
+    pthread_mutex_unlock(&bank->remoteLock);
+    if (!ok) return BANK_IO_ERROR;
+    if (header.status != BANK_OK) return (enum BankError)header.status;
+    if (header.length != size) return BANK_IO_ERROR;
+    if (size > 0) memcpy(response, payload, size);
+    return BANK_OK;
+}
+
+int clientCount(struct Bank *bank) {
+    uint32_t count;
+    return clientCall(bank, WIRE_COUNT, NULL, 0, &count, sizeof(count)) == BANK_OK ? (int)count : 0;
+}
+
+enum BankError clientLookup(struct Bank *bank, const char *accountNumber, struct Account *out) {
+    struct WireAccountRequest request;
+    struct Account account;
+    memset(&request, 0, sizeof(request));
+    snprintf(request.accountNumber, sizeof(request.accountNumber), "%s", accountNumber);
+    enum BankError error = clientCall(bank, WIRE_LOOKUP, &request, sizeof(request), &account, sizeof(account));
+    if (error == BANK_OK && out != NULL) *out = account;
+    return error;
+}
+
+// WIRE_LIST and WIRE_CUSTOMER send their numbers in batches. the whole list is received before 'visit' runs,
+// so it may call back into the bank
+enum BankError clientStream(struct Bank *bank, enum WireOp op, const void *request, uint32_t length,
+                            void (*visit)(const char *accountNumber, void *context), void *context) {
+    char (*numbers)[13] = NULL;
+    size_t count = 0, capacity = 0;
+    unsigned char payload[WIRE_MAX_PAYLOAD];
+    struct WireHeader header;
+    enum BankError error = BANK_IO_ERROR;
+    int outOfMemory = 0;
+
+    pthread_mutex_lock(&bank->remoteLock);
+    if (wireSend(bank->remoteFd, (uint8_t)op, BANK_OK, request, length)) {
+        // batches of numbers until an empty message, which carries the result
+        while (wireReceive(bank->remoteFd, &header, payload, sizeof(payload)) && header.op == op) {
+            size_t received = header.length / sizeof(numbers[0]);
+            if (received == 0) {
+                error = outOfMemory ? BANK_IO_ERROR : (enum BankError)header.status;
+                break;
+            }
+            if (count + received > capacity && !outOfMemory) {
+                capacity = capacity == 0 ? 4 * WIRE_LIST_BATCH : capacity * 2;
+                void *grown = realloc(numbers, capacity * sizeof(numbers[0]));
+                // keep reading to the end of the list, so the connection stays usable
+                outOfMemory = grown == NULL;
+                if (grown != NULL) numbers = grown;
+            }
+            if (outOfMemory) continue;
+            memcpy(numbers[count], payload, received * sizeof(numbers[0]));
+            count += received;
+        }
+    }
+    pthread_mutex_unlock(&bank->remoteLock);
+
+    for (size_t i = 0; error == BANK_OK && i < count; i++) {
+        numbers[i][sizeof(numbers[i]) - 1] = '\0';
+        visit(numbers[i], context);
+    }
+    free(numbers);
+    return error;
+}
+
+enum BankError clientList(struct Bank *bank, void (*visit)(const char *accountNumber, void *context), void *context) {
+    return clientStream(bank, WIRE_LIST, NULL, 0, visit, context);
+}
+
+enum BankError clientCustomerAccounts(struct Bank *bank, const char *ID,
+                                      void (*visit)(const char *accountNumber, void *context), void *context) {
+    struct WireCustomerRequest request;
+    memset(&request, 0, sizeof(request));
+    snprintf(request.ID, sizeof(request.ID), "%s", ID);
+    return clientStream(bank, WIRE_CUSTOMER, &request, sizeof(request), visit, context);
+}
+
+// one WIRE_LIST_PAGE request per WIRE_LIST_BATCH numbers, each page is visited as soon as it arrives
+enum BankError clientListPage(struct Bank *bank, const struct BankListQuery *query,
+                              void (*visit)(const char *accountNumber, void *context), void *context, char *next) {
+    struct WireListRequest request;
+    memset(&request, 0, sizeof(request));
+    if (query->prefix != NULL) snprintf(request.prefix, sizeof(request.prefix), "%s", query->prefix);
+    if (query->from != NULL) snprintf(request.from, sizeof(request.from), "%s", query->from);
+    if (query->to != NULL) snprintf(request.to, sizeof(request.to), "%s", query->to);
+    if (query->after != NULL) snprintf(request.after, sizeof(request.after), "%s", query->after);
+    if (next != NULL) next[0] = '\0';
+
+    struct WireListResponse *page = malloc(sizeof(*page));
+    if (page == NULL) return BANK_IO_ERROR;
+    int remaining = query->limit;
+    enum BankError error;
+    for (;;) {
+        request.limit = remaining > 0 && remaining < WIRE_LIST_BATCH ? remaining : WIRE_LIST_BATCH;
+        error = clientCall(bank, WIRE_LIST_PAGE, &request, sizeof(request), page, sizeof(*page));
+        if (error != BANK_OK || page->count > WIRE_LIST_BATCH) break;
+        for (uint32_t i = 0; i < page->count; i++) {
+            page->numbers[i][sizeof(page->numbers[i]) - 1] = '\0';
+            visit(page->numbers[i], context);
+        }
+        page->next[sizeof(page->next) - 1] = '\0';
+        if (remaining > 0) remaining -= (int)page->count;
+        if (page->next[0] == '\0' || (query->limit > 0 && remaining <= 0)) {
+            if (next != NULL) strcpy(next, page->next);
+            break;
+        }
+        strcpy(request.after, page->next);
+    }
+    free(page);
+    return error;
+}
+
+enum BankError clientSearchNames(struct Bank *bank, const char *query, struct BankNameMatch *out, int max,
+                                 int *found) {
+    struct WireSearchRequest request;
+    memset(&request, 0, sizeof(request));
+    snprintf(request.query, sizeof(request.query), "%s", query);
+    request.max = max;
+    struct WireSearchResponse *response = malloc(sizeof(*response));
+    if (response == NULL) return BANK_IO_ERROR;
+    enum BankError error = clientCall(bank, WIRE_SEARCH, &request, sizeof(request), response, sizeof(*response));
+    if (error == BANK_OK) {
+        *found = response->count <= (uint32_t)max ? (int)response->count : max;
+        memcpy(out, response->matches, (size_t)*found * sizeof(out[0]));
+    }
+    free(response);
+    return error;
+}
+
+enum BankError clientCreate(struct Bank *bank, struct Account *account) {
+    return clientCall(bank, WIRE_CREATE, account, sizeof(*account), account, sizeof(*account));
+}
+
+enum BankError clientDelete(struct Bank *bank, const char *accountNumber) {
+    struct WireAccountRequest request;
+    memset(&request, 0, sizeof(request));
+    snprintf(request.accountNumber, sizeof(request.accountNumber), "%s", accountNumber);
+    return clientCall(bank, WIRE_DELETE, &request, sizeof(request), NULL, 0);
+}
+
+// deposit, withdraw or transfer. 'feeBps' is only filled in for a transfer, both outputs may be NULL
+enum BankError clientAmount(struct Bank *bank, enum WireOp op, const char *from, const char *to, int64_t amount,
+                            int32_t *feeBps, int64_t *balance) {
+    struct WireAmountRequest request;
+    struct WireAmountResponse response;
+    memset(&request, 0, sizeof(request));
+    request.amount = amount;
+    snprintf(request.accountNumber, sizeof(request.accountNumber), "%s", from);
+    if (to != NULL) snprintf(request.toAccount, sizeof(request.toAccount), "%s", to);
+
+    enum BankError error = clientCall(bank, op, &request, sizeof(request), &response, sizeof(response));
+    if (error == BANK_OK) {
+        if (feeBps != NULL) *feeBps = response.feeBps;
+        if (balance != NULL) *balance = response.balance;
+    }
+    return error;
+}
@@ -0,0 +1,317 @@
+// --- customer index ---
+// open-addressing hash table (linear probing) in customers.dat from a customer ID to the account numbers
+// opened with it. each customer has a head entry, placed by the hash of the ID, that starts a linked chain
+// of one entry per account; the account entries are placed by the hash of the ID and account number
+// together, so a customer with thousands of accounts doesn't turn into one long run of the table. a lookup
+// finds the head and follows the chain: it costs the customer's accounts, not the database's, and adding an
+// account costs the same however many the customer has. a removed account's entry becomes a tombstone that
+// stays linked until the next rebuild. the file is memory mapped at the start of a reserved address range
+// like order.dat. writers hold the structure lock and keep the header's seq odd while they change entries,
+// in the same step as the store and the other indexes; readers copy a customer's chain without a lock and
+// retry if a writer got in between. growing, and clearing out tombstones, rebuilds the table from the store
+// in place
+#include "bank_internal.h"
+
+size_t customerFileSize(uint32_t capacity) {
+    return sizeof(struct CustomerHeader) + (size_t)capacity * sizeof(struct CustomerEntry);
+}
+
+// a customer ID as an index key: its digits with their count in the low 4 bits, so "0012345678" and
+// "012345678" stay different customers. returns 0 if the ID isn't 1-12 digits
+int customerKey(const char *ID, uint64_t *key) {
+    uint64_t value = 0;
+    int digits = 0;
+    while (ID[digits] != '\0') {
+        if (!isdigit((unsigned char)ID[digits]) || digits == 12) return 0;
+        value = value * 10 + (uint64_t)(ID[digits] - '0');
+        digits++;
+    }
+    if (digits == 0) return 0;
+    *key = value * 16 + (uint64_t)digits;
+    return 1;
+}
+
+uint32_t customerHash(uint64_t key) {
+    // the high half of a multiplicative hash, the low digits of IDs are anything but random
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+// where the entry of one account of a customer is placed
+uint32_t customerEntryHash(uint64_t customer, uint32_t account) {
+    return customerHash(customer * 0xFF51AFD7ED558CCDull + account);
+}
+
+// map the first 'size' bytes of customers.dat, replacing any smaller mapping at the same address
+int customerMap(struct Bank *bank, size_t size) {
+    if (bank->customers.header == NULL) {
+        void *reserved = mmap(NULL, CUSTOMER_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED) return 0;
+        bank->customers.header = reserved;
+    }
+    if (size > CUSTOMER_RESERVE ||
+        mmap(bank->customers.header, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, bank->customers.fd, 0) == MAP_FAILED) {
+        return 0;
+    }
+    bank->customers.entries = (struct CustomerEntry *)((unsigned char *)bank->customers.header + sizeof(struct CustomerHeader));
+    __atomic_store_n(&bank->customers.mapSize, size, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// make the file and the mapping big enough for 'capacity' entries. called with the structure lock held
+int customerReserve(struct Bank *bank, uint32_t capacity) {
+    size_t size = customerFileSize(capacity);
+    if (size <= bank->customers.mapSize) return 1;
+    if (ftruncate(bank->customers.fd, (off_t)size) != 0) return 0;
+    pthread_mutex_lock(&bank->mapLock);
+    int ok = customerMap(bank, size);
+    pthread_mutex_unlock(&bank->mapLock);
+    return ok;
+}
+
+// extend the mapping if another handle has grown the file, returns 0 if that failed
+int customerRefresh(struct Bank *bank) {
+    size_t size = customerFileSize(__atomic_load_n(&bank->customers.header->capacity, __ATOMIC_ACQUIRE));
+    if (size <= __atomic_load_n(&bank->customers.mapSize, __ATOMIC_ACQUIRE)) return 1;
+
+    pthread_mutex_lock(&bank->mapLock);
+    int ok = size <= bank->customers.mapSize || customerMap(bank, size);
+    pthread_mutex_unlock(&bank->mapLock);
+    return ok;
+}
+
+// writers bracket every change to the entries with these. seq stays odd if a writer died halfway
+void customerBeginWrite(struct Bank *bank) {
+    __atomic_store_n(&bank->customers.header->seq, bank->customers.header->seq | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void customerEndWrite(struct Bank *bank) {
+    __atomic_store_n(&bank->customers.header->seq, bank->customers.header->seq + 1, __ATOMIC_RELEASE);
+}
+
+// the entry for 'customer' and 'account' (CUSTOMER_HEAD for the head), CUSTOMER_NO_ENTRY if there is none.
+// gives up after 'capacity' probes, a reader may be looking at a table that is being rebuilt
+uint32_t customerFind(struct Bank *bank, uint32_t capacity, uint64_t customer, uint32_t account) {
+    uint32_t mask = capacity - 1;
+    uint32_t i = (account == CUSTOMER_HEAD ? customerHash(customer) : customerEntryHash(customer, account)) & mask;
+    for (uint32_t probes = 0; probes < capacity; probes++, i = (i + 1) & mask) {
+        const struct CustomerEntry *entry = &bank->customers.entries[i];
+        if (entry->customer == CUSTOMER_EMPTY) break;
+        if (entry->customer == customer && entry->account == account) return i;
+    }
+    return CUSTOMER_NO_ENTRY;
+}
+
+// place an entry inside a write in the first empty entry of its run, tombstones are still part of a chain
+uint32_t customerPlace(struct Bank *bank, uint64_t customer, uint32_t account, uint32_t hash) {
+    uint32_t mask = bank->customers.header->capacity - 1;
+    uint32_t i = hash & mask;
+    while (bank->customers.entries[i].customer != CUSTOMER_EMPTY) i = (i + 1) & mask;
+    bank->customers.entries[i].account = account;
+    bank->customers.entries[i].next = CUSTOMER_NO_ENTRY;
+    bank->customers.entries[i].customer = customer;
+    return i;
+}
+
+// link a new entry for 'account' behind the customer's head, adding the head if it is the first one. inside
+// a write, with room for two more entries
+void customerLink(struct Bank *bank, uint64_t customer, uint32_t account) {
+    struct CustomerHeader *header = bank->customers.header;
+    uint32_t head = customerFind(bank, header->capacity, customer, CUSTOMER_HEAD);
+    if (head == CUSTOMER_NO_ENTRY) {
+        head = customerPlace(bank, customer, CUSTOMER_HEAD, customerHash(customer));
+        header->heads++;
+    }
+    uint32_t i = customerPlace(bank, customer, account, customerEntryHash(customer, account));
+    bank->customers.entries[i].next = bank->customers.entries[head].next;
+    bank->customers.entries[head].next = i;
+    header->count++;
+}
+
+// 1 if 'used' entries (heads, live and tombstoned) stay under 70% of 'capacity'
+int customerFits(uint32_t used, uint32_t capacity) {
+    return (uint64_t)used * 10 <= (uint64_t)capacity * 7;
+}
+
+// refill the table from the live slots of the store without tombstones, at a size that leaves it half
+// empty even if every account has a customer of its own. called with the structure lock held (or every lock)
+int customerRebuild(struct Bank *bank) {
+    struct CustomerHeader *header = bank->customers.header;
+    uint32_t capacity = CUSTOMER_INITIAL_CAPACITY;
+    while ((uint64_t)bank->store.header->count * 4 > capacity) capacity *= 2;
+    if (!customerReserve(bank, capacity)) return 0;
+
+    customerBeginWrite(bank);
+    __atomic_store_n(&header->capacity, capacity, __ATOMIC_RELEASE);
+    memset(bank->customers.entries, 0, (size_t)capacity * sizeof(struct CustomerEntry));
+    header->count = 0;
+    header->tombstones = 0;
+    header->heads = 0;
+    for (uint32_t i = 0; i < bank->store.header->used; i++) {
+        const struct AccountSlot *slot = &bank->store.slots[i];
+        uint64_t customer;
+        uint32_t account;
+        if (slot->state == SLOT_USED && customerKey(slot->account.ID, &customer) &&
+            accountKey(slot->account.accountNumber, &account) &&
+            customerFits(header->count + header->heads + 2, capacity)) {
+            customerLink(bank, customer, account);
+        }
+    }
+    customerEndWrite(bank);
+    return 1;
+}
+
+// open customers.dat, rebuilding it from the store if it is new, damaged, left mid-change or out of date
+int customerOpen(struct Bank *bank) {
+    char path[PATH_MAX];
+    bankPath(bank, CUSTOMER_FILE, path);
+    bank->customers.fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (bank->customers.fd < 0 || fstat(bank->customers.fd, &st) != 0) return 0;
+
+    if ((size_t)st.st_size >= sizeof(struct CustomerHeader) && customerMap(bank, (size_t)st.st_size)) {
+        // kept only if it was synced together with the store and nothing was replayed into the store since,
+        // a customer would otherwise be missing accounts. accounts without a digits-only ID aren't in it, so
+        // it may count fewer than the store
+        struct CustomerHeader *header = bank->customers.header;
+        if (header->magic == CUSTOMER_MAGIC && header->version == CUSTOMER_VERSION && header->capacity > 0 &&
+            (header->capacity & (header->capacity - 1)) == 0 &&
+            customerFileSize(header->capacity) <= (size_t)st.st_size && !(header->seq & 1) &&
+            header->count <= bank->store.header->count && header->checkpointLsn == bank->store.header->checkpointLsn) {
+            return 1;
+        }
+    }
+
+    // start over in the same file, never shrinking it under another handle's mapping
+    size_t size = customerFileSize(CUSTOMER_INITIAL_CAPACITY);
+    if ((size_t)st.st_size > size) size = (size_t)st.st_size;
+    if (ftruncate(bank->customers.fd, (off_t)size) != 0 || !customerMap(bank, size)) return 0;
+    bank->customers.header->magic = CUSTOMER_MAGIC;
+    bank->customers.header->version = CUSTOMER_VERSION;
+    bank->customers.header->checkpointLsn = bank->store.header->checkpointLsn;
+    return customerRebuild(bank);
+}
+
+void customerClose(struct Bank *bank) {
+    if (bank->customers.header != NULL) {
+        if (bank->customers.mapSize > 0) msync(bank->customers.header, bank->customers.mapSize, MS_SYNC);
+        munmap(bank->customers.header, CUSTOMER_RESERVE);
+    }
+    if (bank->customers.fd >= 0) close(bank->customers.fd);
+    bank->customers.fd = -1;
+    bank->customers.header = NULL;
+    bank->customers.mapSize = 0;
+}
+
+// add an account under its customer, called with the structure lock held after the account is in the store
+// and before it is in the hash index. adding one that is there already is harmless
+int customerInsert(struct Bank *bank, const struct Account *account) {
+    uint64_t customer;
+    uint32_t key;
+    if (!customerKey(account->ID, &customer) || !accountKey(account->accountNumber, &key)) return 1;
+    struct CustomerHeader *header = bank->customers.header;
+    // a writer died halfway through a change or the table is full, either way the store has every account
+    uint32_t used = header->count + header->tombstones + header->heads;
+    if ((header->seq & 1) || !customerFits(used + 2, header->capacity)) {
+        return customerRebuild(bank);
+    }
+
+    if (customerFind(bank, header->capacity, customer, key) != CUSTOMER_NO_ENTRY) return 1;
+    customerBeginWrite(bank);
+    customerLink(bank, customer, key);
+    customerEndWrite(bank);
+    return 1;
+}
+
+// take an account away from its customer, called with the structure lock held after it left the store
+int customerRemove(struct Bank *bank, const struct Account *account) {
+    uint64_t customer;
+    uint32_t key;
+    if (!customerKey(account->ID, &customer) || !accountKey(account->accountNumber, &key)) return 1;
+    struct CustomerHeader *header = bank->customers.header;
+    if (header->seq & 1) return customerRebuild(bank);
+
+    uint32_t i = customerFind(bank, header->capacity, customer, key);
+    if (i == CUSTOMER_NO_ENTRY) return 1;
+    // the entry keeps its place in the chain, so the ones behind it stay reachable
+    customerBeginWrite(bank);
+    bank->customers.entries[i].customer = CUSTOMER_TOMBSTONE;
+    header->count--;
+    header->tombstones++;
+    customerEndWrite(bank);
+    return 1;
+}
+
+// copy the account keys of 'customer' into 'out', up to 'max' of them. returns how many the customer has,
+// which may be more than were copied, or -1 if the table looked inconsistent
+int customerCopy(struct Bank *bank, uint64_t customer, uint32_t *out, uint32_t max) {
+    uint32_t capacity = __atomic_load_n(&bank->customers.header->capacity, __ATOMIC_ACQUIRE);
+    if (capacity == 0 || customerFileSize(capacity) > __atomic_load_n(&bank->customers.mapSize, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    uint32_t head = customerFind(bank, capacity, customer, CUSTOMER_HEAD);
+    if (head == CUSTOMER_NO_ENTRY) return 0;
+
+    uint32_t found = 0, steps = 0;
+    for (uint32_t i = bank->customers.entries[head].next; i != CUSTOMER_NO_ENTRY; i = bank->customers.entries[i].next) {
+        // a chain torn by a writer can point anywhere, or in a circle
+        if (i >= capacity || ++steps > capacity) return -1;
+        if (bank->customers.entries[i].customer != customer) continue;
+        if (found < max) out[found] = bank->customers.entries[i].account;
+        found++;
+    }
+    return (int)found;
+}
+
+// like customerCopy(), without a lock: the copy is retried if a writer changed the table meanwhile, and
+// after a few collisions the structure lock is taken instead
+int customerRead(struct Bank *bank, uint64_t customer, uint32_t *out, uint32_t max) {
+    struct CustomerHeader *header = bank->customers.header;
+    for (int attempt = 0; attempt < 8; attempt++) {
+        uint32_t seq = __atomic_load_n(&header->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        if (!customerRefresh(bank)) break;
+        int found = customerCopy(bank, customer, out, max);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (found >= 0 && __atomic_load_n(&header->seq, __ATOMIC_RELAXED) == seq) return found;
+    }
+
+    lockStructure(bank);
+    customerRefresh(bank);
+    int found = ((header->seq & 1) && !customerRebuild(bank)) ? -1 : customerCopy(bank, customer, out, max);
+    unlockStructure(bank);
+    return found;
+}
+
+int compareAccountKeys(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+enum BankError bankCustomerAccounts(struct Bank *bank, const char *ID,
+                                    void (*visit)(const char *accountNumber, void *context), void *context) {
+    if (bank->remoteFd >= 0) return clientCustomerAccounts(bank, ID, visit, context);
+    uint64_t customer;
+    if (!customerKey(ID, &customer)) return BANK_INVALID_ACCOUNT;
+
+    // a customer has a handful of accounts, a bigger buffer is only needed for one with more
+    uint32_t small[CUSTOMER_READ_ACCOUNTS];
+    uint32_t *keys = small, max = CUSTOMER_READ_ACCOUNTS;
+    int found;
+    while ((found = customerRead(bank, customer, keys, max)) > (int)max) {
+        if (keys != small) free(keys);
+        max = (uint32_t)found * 2;
+        keys = malloc(max * sizeof(uint32_t));
+        if (keys == NULL) return BANK_IO_ERROR;
+    }
+    if (found >= 0) {
+        qsort(keys, (size_t)found, sizeof(uint32_t), compareAccountKeys);
+        for (int i = 0; i < found; i++) {
+            char accountNumber[13];
+            snprintf(accountNumber, sizeof(accountNumber), "%u", keys[i]);
+            visit(accountNumber, context);
+        }
+    }
+    if (keys != small) free(keys);
+    return found >= 0 ? BANK_OK : BANK_IO_ERROR;
+}
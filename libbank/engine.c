@@ -0,0 +1,313 @@
+// --- sharded execution engine ---
+// once bankStartEngine() has run, deposits, withdrawals and transfers no longer run on the caller's thread.
+// accounts are split into shards by lock stripe, and each shard is one thread that alone runs the balance
+// changes of its accounts, through a handle of its own. callers post a task to the shard's queue (lock-free,
+// many producers and one consumer) and wait for the answer, so a hot account is a queue instead of a lock
+// every thread fights over.
+// a shard takes whatever is queued, runs it and then fsyncs once for the whole group before answering
+// (group commit). each change still reaches the journal file before its stripe lock is released, so the
+// journal keeps the order the changes were made in.
+// a transfer between two shards goes to the lower one, which asks the other to park: the other shard
+// finishes what it is running, stops and waits, and the transfer runs with both accounts to itself. a
+// parking shard never waits on a higher one, so two transfers can't wait on each other
+#include "bank_internal.h"
+#include <sched.h>
+
+#define ENGINE_MAX_SHARDS 64
+#define ENGINE_GROUP_TASKS 256 // tasks run between two fsyncs at most
+
+struct EngineTask {
+    struct EngineTask *next; // queue link
+    enum EngineOp op;
+    const char *from;        // the account of a deposit or withdrawal, the sender of a transfer
+    const char *to;
+    int64_t amount;
+    int32_t feeBps;
+    int64_t balance;
+    enum BankError error;
+    int done;                // set under 'lock' once the result is in
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+// Vyukov's intrusive queue: producers swap themselves in at 'head', the shard takes from 'tail'
+struct EngineQueue {
+    struct EngineTask *head;
+    struct EngineTask *tail;
+    struct EngineTask stub;
+};
+
+struct EngineShard {
+    struct Engine *engine;
+    int index;
+    struct Bank *bank;       // this shard's own handle on the database
+    pthread_t thread;
+    struct EngineQueue queue;
+    int sleeping;            // set while the thread waits for tasks, producers then signal 'wake'
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    struct EngineTask *parkedFor; // the park request this shard is stopped for, under 'lock'
+    pthread_cond_t parkChanged;   // 'parkedFor' was set or cleared
+};
+
+struct Engine {
+    int shards;
+    int groupSync; // fsync once per group, for BANK_DURABILITY_BATCH
+    struct EngineShard shard[ENGINE_MAX_SHARDS];
+};
+
+// --- queue ---
+void engineQueueInit(struct EngineQueue *queue) {
+    queue->stub.next = NULL;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+}
+
+// any thread
+void engineQueuePush(struct EngineQueue *queue, struct EngineTask *task) {
+    __atomic_store_n(&task->next, NULL, __ATOMIC_RELAXED);
+    struct EngineTask *previous = __atomic_exchange_n(&queue->head, task, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&previous->next, task, __ATOMIC_RELEASE);
+}
+
+// shard thread only. returns NULL if the queue is empty, or if a producer is halfway through a push (the
+// queue's head has moved past the tail then, see engineQueueIdle())
+struct EngineTask *engineQueuePop(struct EngineQueue *queue) {
+    struct EngineTask *tail = queue->tail;
+    struct EngineTask *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &queue->stub) {
+        if (next == NULL) return NULL;
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST)) return NULL;
+
+    // 'tail' is the last task, put the stub behind it so it can be handed out
+    engineQueuePush(queue, &queue->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next == NULL) return NULL;
+    queue->tail = next;
+    return tail;
+}
+
+// 1 if nothing was pushed since the last pop came back empty
+int engineQueueIdle(struct EngineQueue *queue) {
+    return __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST) == queue->tail;
+}
+
+// --- tasks ---
+int engineShardOf(struct Engine *engine, const char *accountNumber) {
+    return stripeOf(accountNumber) % engine->shards;
+}
+
+void enginePost(struct EngineShard *shard, struct EngineTask *task) {
+    engineQueuePush(&shard->queue, task);
+    if (__atomic_load_n(&shard->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&shard->lock);
+        pthread_cond_signal(&shard->wake);
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+void engineFinish(struct EngineTask *task) {
+    pthread_mutex_lock(&task->lock);
+    task->done = 1;
+    pthread_cond_signal(&task->changed);
+    pthread_mutex_unlock(&task->lock);
+}
+
+// run a transfer whose receiver belongs to the higher shard 'other'
+enum BankError engineCrossTransfer(struct EngineShard *shard, struct EngineShard *other, struct EngineTask *task) {
+    struct EngineTask park;
+    memset(&park, 0, sizeof(park));
+    park.op = ENGINE_PARK;
+    enginePost(other, &park);
+
+    pthread_mutex_lock(&other->lock);
+    while (other->parkedFor != &park) {
+        pthread_cond_wait(&other->parkChanged, &other->lock);
+    }
+    pthread_mutex_unlock(&other->lock);
+
+    enum BankError error = bankTransfer(shard->bank, task->from, task->to, task->amount, &task->feeBps, &task->balance);
+
+    pthread_mutex_lock(&other->lock);
+    other->parkedFor = NULL;
+    pthread_cond_broadcast(&other->parkChanged);
+    pthread_mutex_unlock(&other->lock);
+    return error;
+}
+
+// stop until the shard that posted 'park' clears 'parkedFor'. 'park' lives on that shard's stack, so it is
+// only compared, never read
+void enginePark(struct EngineShard *shard, struct EngineTask *park) {
+    pthread_mutex_lock(&shard->lock);
+    shard->parkedFor = park;
+    pthread_cond_broadcast(&shard->parkChanged);
+    while (shard->parkedFor == park) {
+        pthread_cond_wait(&shard->parkChanged, &shard->lock);
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void engineRun(struct EngineShard *shard, struct EngineTask *task) {
+    struct Bank *bank = shard->bank;
+    if (task->op == ENGINE_DEPOSIT) {
+        task->error = bankDeposit(bank, task->from, task->amount, &task->balance);
+    } else if (task->op == ENGINE_WITHDRAW) {
+        task->error = bankWithdraw(bank, task->from, task->amount, &task->balance);
+    } else {
+        // this is the lower of the two shards, the other one may own either side
+        int other = engineShardOf(shard->engine, task->from);
+        if (other == shard->index) other = engineShardOf(shard->engine, task->to);
+        task->error = other == shard->index
+                          ? bankTransfer(bank, task->from, task->to, task->amount, &task->feeBps, &task->balance)
+                          : engineCrossTransfer(shard, &shard->engine->shard[other], task);
+    }
+}
+
+void *engineShard(void *arg) {
+    struct EngineShard *shard = arg;
+    struct EngineTask *group[ENGINE_GROUP_TASKS];
+    int stop = 0;
+    while (!stop) {
+        size_t count = 0;
+        struct EngineTask *task;
+        while (count < ENGINE_GROUP_TASKS && (task = engineQueuePop(&shard->queue)) != NULL) {
+            if (task->op == ENGINE_STOP) {
+                stop = 1;
+                break;
+            }
+            if (task->op == ENGINE_PARK) {
+                enginePark(shard, task);
+                continue;
+            }
+            engineRun(shard, task);
+            group[count++] = task;
+        }
+
+        // one fsync makes the whole group durable before anyone hears back. if it fails, nobody in the group
+        // is told their change is durable: it is applied and in the journal file, but may not survive a crash
+        int synced = count == 0 || !shard->engine->groupSync || journalFlush(shard->bank, 1);
+        for (size_t i = 0; i < count; i++) {
+            if (!synced && group[i]->error == BANK_OK) group[i]->error = BANK_JOURNAL_ERROR;
+            engineFinish(group[i]);
+        }
+        if (count > 0 || stop) continue;
+
+        if (!engineQueueIdle(&shard->queue)) {
+            // a producer is between its two steps of a push
+            sched_yield();
+            continue;
+        }
+        pthread_mutex_lock(&shard->lock);
+        __atomic_store_n(&shard->sleeping, 1, __ATOMIC_SEQ_CST);
+        while (engineQueueIdle(&shard->queue)) {
+            pthread_cond_wait(&shard->wake, &shard->lock);
+        }
+        __atomic_store_n(&shard->sleeping, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&shard->lock);
+    }
+    return NULL;
+}
+
+// hand a balance change to the shard that owns 'from' (the lower shard of a transfer) and wait for it
+enum BankError engineSubmit(struct Bank *bank, enum EngineOp op, const char *from, const char *to, int64_t amount,
+                            int32_t *feeBps, int64_t *balance) {
+    struct Engine *engine = bank->engine;
+    struct EngineTask task;
+    memset(&task, 0, sizeof(task));
+    task.op = op;
+    task.from = from;
+    task.to = to;
+    task.amount = amount;
+    pthread_mutex_init(&task.lock, NULL);
+    pthread_cond_init(&task.changed, NULL);
+
+    int shard = engineShardOf(engine, from);
+    if (to != NULL && engineShardOf(engine, to) < shard) shard = engineShardOf(engine, to);
+    enginePost(&engine->shard[shard], &task);
+
+    pthread_mutex_lock(&task.lock);
+    while (!task.done) {
+        pthread_cond_wait(&task.changed, &task.lock);
+    }
+    pthread_mutex_unlock(&task.lock);
+    pthread_cond_destroy(&task.changed);
+    pthread_mutex_destroy(&task.lock);
+
+    if (feeBps != NULL) *feeBps = task.feeBps;
+    if (balance != NULL) *balance = task.balance;
+    return task.error;
+}
+
+// --- starting and stopping ---
+void engineStop(struct Bank *bank) {
+    struct Engine *engine = bank->engine;
+    if (engine == NULL) return;
+    bank->engine = NULL;
+
+    // the shards stop one after the other, so they can share one stop task
+    struct EngineTask stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.op = ENGINE_STOP;
+    for (int i = 0; i < engine->shards; i++) {
+        struct EngineShard *shard = &engine->shard[i];
+        enginePost(shard, &stop);
+        pthread_join(shard->thread, NULL);
+        bankClose(shard->bank);
+        pthread_cond_destroy(&shard->parkChanged);
+        pthread_cond_destroy(&shard->wake);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(engine);
+}
+
+enum BankError bankStartEngine(struct Bank *bank, int shards) {
+    if (bank->remoteFd >= 0) return BANK_NOT_SUPPORTED;
+    if (bank->engine != NULL) return BANK_OK;
+    if (shards <= 0) shards = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (shards < 1) shards = 1;
+    if (shards > ENGINE_MAX_SHARDS) shards = ENGINE_MAX_SHARDS;
+
+    struct Engine *engine = calloc(1, sizeof(struct Engine));
+    if (engine == NULL) return BANK_IO_ERROR;
+    engine->shards = shards;
+    // under 'batch' the shards write each change at once and fsync per group instead
+    enum BankDurability durability = bank->journal.sync;
+    engine->groupSync = durability == BANK_DURABILITY_BATCH;
+    if (engine->groupSync) durability = BANK_DURABILITY_NONE;
+
+    enum BankError error = BANK_OK;
+    int opened = 0;
+    for (; opened < shards && error == BANK_OK; opened++) {
+        struct EngineShard *shard = &engine->shard[opened];
+        shard->engine = engine;
+        shard->index = opened;
+        engineQueueInit(&shard->queue);
+        pthread_mutex_init(&shard->lock, NULL);
+        pthread_cond_init(&shard->wake, NULL);
+        pthread_cond_init(&shard->parkChanged, NULL);
+        error = bankOpen(bank->directory, durability, &shard->bank);
+        if (error == BANK_OK) shard->bank->log = bank->log; // the shards' changes are logged like the caller's
+        if (error == BANK_OK && pthread_create(&shard->thread, NULL, engineShard, shard) != 0) {
+            bankClose(shard->bank);
+            error = BANK_IO_ERROR;
+        }
+        if (error != BANK_OK) {
+            pthread_cond_destroy(&shard->parkChanged);
+            pthread_cond_destroy(&shard->wake);
+            pthread_mutex_destroy(&shard->lock);
+            break;
+        }
+    }
+    engine->shards = opened;
+    bank->engine = engine;
+    if (error != BANK_OK) engineStop(bank);
+    return error;
+}
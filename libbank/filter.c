@@ -0,0 +1,258 @@
+// --- account number filter ---
+// a cuckoo filter over every live account's key in filter.dat: each key leaves a 16-bit fingerprint in one
+// of its two buckets. a number whose fingerprint is in neither bucket is certainly not an account, so lookups
+// of mistyped numbers are turned away without probing the index; a match only means the index has to be
+// asked, which an unknown number causes about once in 8000. unlike a Bloom filter, a deleted account's
+// fingerprint can be taken out again.
+// the file is memory mapped at the start of a reserved address range like order.dat. writers hold the
+// structure lock and keep the header's seq odd while they move fingerprints; a reader that sees seq change
+// doesn't trust a miss and asks the index instead
+#include "bank_internal.h"
+
+size_t filterFileSize(uint32_t buckets) {
+    return sizeof(struct FilterHeader) + (size_t)buckets * FILTER_BUCKET_SLOTS * sizeof(uint16_t);
+}
+
+// map the first 'size' bytes of filter.dat, replacing any smaller mapping at the same address
+int filterMap(struct Bank *bank, size_t size) {
+    if (bank->filter.header == NULL) {
+        void *reserved = mmap(NULL, FILTER_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED) return 0;
+        bank->filter.header = reserved;
+    }
+    if (size > FILTER_RESERVE ||
+        mmap(bank->filter.header, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, bank->filter.fd, 0) == MAP_FAILED) {
+        return 0;
+    }
+    bank->filter.slots = (uint16_t *)((unsigned char *)bank->filter.header + sizeof(struct FilterHeader));
+    __atomic_store_n(&bank->filter.mapSize, size, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// make the file and the mapping big enough for 'buckets' buckets. called with the structure lock held
+int filterReserve(struct Bank *bank, uint32_t buckets) {
+    size_t size = filterFileSize(buckets);
+    if (size <= bank->filter.mapSize) return 1;
+    if (ftruncate(bank->filter.fd, (off_t)size) != 0) return 0;
+    pthread_mutex_lock(&bank->mapLock);
+    int ok = filterMap(bank, size);
+    pthread_mutex_unlock(&bank->mapLock);
+    return ok;
+}
+
+// extend the mapping if another handle has grown the file, returns 0 if that failed
+int filterRefresh(struct Bank *bank) {
+    size_t size = filterFileSize(__atomic_load_n(&bank->filter.header->buckets, __ATOMIC_ACQUIRE));
+    if (size <= __atomic_load_n(&bank->filter.mapSize, __ATOMIC_ACQUIRE)) return 1;
+
+    pthread_mutex_lock(&bank->mapLock);
+    int ok = size <= bank->filter.mapSize || filterMap(bank, size);
+    pthread_mutex_unlock(&bank->mapLock);
+    return ok;
+}
+
+// writers bracket every change to the fingerprints with these. seq stays odd if a writer died halfway or
+// the filter couldn't be rebuilt, readers then ask the index until a later writer manages to rebuild it
+void filterBeginWrite(struct Bank *bank) {
+    __atomic_store_n(&bank->filter.header->seq, bank->filter.header->seq | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void filterEndWrite(struct Bank *bank) {
+    __atomic_store_n(&bank->filter.header->seq, bank->filter.header->seq + 1, __ATOMIC_RELEASE);
+}
+
+// a key's first bucket and its fingerprint, which is never 0 since that marks an empty slot
+uint32_t filterBucket(uint32_t key, uint32_t mask, uint16_t *fingerprint) {
+    // splitmix64's finalizer, so the bucket and the fingerprint come from unrelated bits
+    uint64_t hash = key + 0x9E3779B97F4A7C15ull;
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+    *fingerprint = (uint16_t)(hash >> 48);
+    if (*fingerprint == 0) *fingerprint = 1;
+    return (uint32_t)hash & mask;
+}
+
+// the other bucket a fingerprint can be in. it only needs the fingerprint, so a fingerprint can be moved
+// without knowing its key, and it works both ways
+uint32_t filterAlternate(uint32_t bucket, uint16_t fingerprint, uint32_t mask) {
+    return (bucket ^ (fingerprint * 0x5BD1E995u)) & mask;
+}
+
+// put a fingerprint into a free slot of 'bucket', returns 0 if the bucket is full
+int filterPut(uint16_t *slots, uint32_t bucket, uint16_t fingerprint) {
+    uint16_t *slot = &slots[(size_t)bucket * FILTER_BUCKET_SLOTS];
+    for (int i = 0; i < FILTER_BUCKET_SLOTS; i++) {
+        if (slot[i] == 0) {
+            slot[i] = fingerprint;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// add a key inside a write. if both its buckets are full, fingerprints are pushed on to their other bucket
+// until one lands in a free slot. returns 0 if none did, a fingerprint is lost then and the filter has to
+// be rebuilt
+int filterPlace(struct Bank *bank, uint32_t key) {
+    uint16_t *slots = bank->filter.slots;
+    uint32_t mask = bank->filter.header->buckets - 1;
+    uint16_t fingerprint;
+    uint32_t bucket = filterBucket(key, mask, &fingerprint);
+    if (filterPut(slots, bucket, fingerprint)) return 1;
+
+    bucket = filterAlternate(bucket, fingerprint, mask);
+    for (int kick = 0; kick < FILTER_MAX_KICKS; kick++) {
+        if (filterPut(slots, bucket, fingerprint)) return 1;
+        uint16_t *victim = &slots[(size_t)bucket * FILTER_BUCKET_SLOTS + (kick + fingerprint) % FILTER_BUCKET_SLOTS];
+        uint16_t evicted = *victim;
+        *victim = fingerprint;
+        fingerprint = evicted;
+        bucket = filterAlternate(bucket, fingerprint, mask);
+    }
+    return 0;
+}
+
+// 1 if 'count' fingerprints in 'buckets' buckets stay under 90% load, past that inserts need long chains of moves
+int filterFits(uint32_t count, uint32_t buckets) {
+    return (uint64_t)count * 10 <= (uint64_t)buckets * FILTER_BUCKET_SLOTS * 9;
+}
+
+// refill the filter from the live slots of the store, with at least 'buckets' buckets and more if the
+// accounts don't fit. called with the structure lock held (or every lock)
+int filterRebuild(struct Bank *bank, uint32_t buckets) {
+    struct FilterHeader *header = bank->filter.header;
+    while (!filterFits(bank->store.header->count, buckets)) buckets *= 2;
+    for (;;) {
+        filterBeginWrite(bank);
+        if (!filterReserve(bank, buckets)) return 0;
+        __atomic_store_n(&header->buckets, buckets, __ATOMIC_RELEASE);
+        memset(bank->filter.slots, 0, (size_t)buckets * FILTER_BUCKET_SLOTS * sizeof(uint16_t));
+        uint32_t count = 0;
+        int placed = 1;
+        for (uint32_t i = 0; i < bank->store.header->used && placed; i++) {
+            uint32_t key;
+            if (bank->store.slots[i].state == SLOT_USED && accountKey(bank->store.slots[i].account.accountNumber, &key)) {
+                placed = filterPlace(bank, key);
+                count++;
+            }
+        }
+        header->count = count;
+        filterEndWrite(bank);
+        if (placed) return 1;
+        buckets *= 2;
+    }
+}
+
+// open filter.dat, rebuilding it from the store if it is new, damaged, left mid-change or out of date
+int filterOpen(struct Bank *bank) {
+    char path[PATH_MAX];
+    bankPath(bank, FILTER_FILE, path);
+    bank->filter.fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (bank->filter.fd < 0 || fstat(bank->filter.fd, &st) != 0) return 0;
+
+    if ((size_t)st.st_size >= sizeof(struct FilterHeader) && filterMap(bank, (size_t)st.st_size)) {
+        // a filter that missed a single account would hide it, so it is only kept if it was synced together
+        // with the store and nothing was replayed into the store since
+        struct FilterHeader *header = bank->filter.header;
+        if (header->magic == FILTER_MAGIC && header->version == FILTER_VERSION && header->buckets > 0 &&
+            (header->buckets & (header->buckets - 1)) == 0 && filterFileSize(header->buckets) <= (size_t)st.st_size &&
+            !(header->seq & 1) && header->count == bank->store.header->count &&
+            header->checkpointLsn == bank->store.header->checkpointLsn) {
+            return 1;
+        }
+    }
+
+    // start over in the same file, never shrinking it under another handle's mapping
+    size_t size = filterFileSize(FILTER_INITIAL_BUCKETS);
+    if ((size_t)st.st_size > size) size = (size_t)st.st_size;
+    if (ftruncate(bank->filter.fd, (off_t)size) != 0 || !filterMap(bank, size)) return 0;
+    bank->filter.header->magic = FILTER_MAGIC;
+    bank->filter.header->version = FILTER_VERSION;
+    bank->filter.header->checkpointLsn = bank->store.header->checkpointLsn;
+    return filterRebuild(bank, FILTER_INITIAL_BUCKETS);
+}
+
+void filterClose(struct Bank *bank) {
+    if (bank->filter.header != NULL) {
+        if (bank->filter.mapSize > 0) msync(bank->filter.header, bank->filter.mapSize, MS_SYNC);
+        munmap(bank->filter.header, FILTER_RESERVE);
+    }
+    if (bank->filter.fd >= 0) close(bank->filter.fd);
+    bank->filter.fd = -1;
+    bank->filter.header = NULL;
+    bank->filter.mapSize = 0;
+}
+
+// add an account number, called with the structure lock held after the account is in the store and before
+// it is in the index. if that fails the filter is left switched off rather than missing the account
+int filterInsert(struct Bank *bank, const char *accountNumber) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key)) return 1; // never a hit either
+    struct FilterHeader *header = bank->filter.header;
+    // a writer died halfway through a change or the filter is full, either way the store has every account
+    if ((header->seq & 1) || !filterFits(header->count + 1, header->buckets)) {
+        return filterRebuild(bank, header->buckets);
+    }
+
+    filterBeginWrite(bank);
+    int placed = filterPlace(bank, key);
+    if (placed) header->count++;
+    filterEndWrite(bank);
+    return placed || filterRebuild(bank, header->buckets * 2);
+}
+
+// remove an account number, called with the structure lock held after the account left the store
+int filterRemove(struct Bank *bank, const char *accountNumber) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key)) return 1;
+    struct FilterHeader *header = bank->filter.header;
+    if (header->seq & 1) return filterRebuild(bank, header->buckets);
+
+    uint32_t mask = header->buckets - 1;
+    uint16_t fingerprint;
+    uint32_t bucket = filterBucket(key, mask, &fingerprint);
+    for (int side = 0; side < 2; side++) {
+        // another key with the same fingerprint and buckets left a copy of its own, so taking any one is right
+        uint16_t *slot = &bank->filter.slots[(size_t)bucket * FILTER_BUCKET_SLOTS];
+        for (int i = 0; i < FILTER_BUCKET_SLOTS; i++) {
+            if (slot[i] == fingerprint) {
+                filterBeginWrite(bank);
+                slot[i] = 0;
+                header->count--;
+                filterEndWrite(bank);
+                return 1;
+            }
+        }
+        bucket = filterAlternate(bucket, fingerprint, mask);
+    }
+    return 1;
+}
+
+// 0 if 'accountNumber' is certainly not an account, 1 if it may be one. takes no lock: a miss only counts if
+// no writer touched the filter meanwhile, otherwise the caller asks the index like it would without a filter
+int filterMayContain(struct Bank *bank, const char *accountNumber) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key)) return 0;
+    struct FilterHeader *header = bank->filter.header;
+    uint32_t seq = __atomic_load_n(&header->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) return 1;
+    uint32_t buckets = __atomic_load_n(&header->buckets, __ATOMIC_RELAXED);
+    if (!filterRefresh(bank) || filterFileSize(buckets) > __atomic_load_n(&bank->filter.mapSize, __ATOMIC_ACQUIRE)) {
+        return 1;
+    }
+
+    uint32_t mask = buckets - 1;
+    uint16_t fingerprint;
+    uint32_t bucket = filterBucket(key, mask, &fingerprint);
+    const uint16_t *first = &bank->filter.slots[(size_t)bucket * FILTER_BUCKET_SLOTS];
+    const uint16_t *second = &bank->filter.slots[(size_t)filterAlternate(bucket, fingerprint, mask) * FILTER_BUCKET_SLOTS];
+    int found = 0;
+    for (int i = 0; i < FILTER_BUCKET_SLOTS; i++) {
+        found |= (first[i] == fingerprint) | (second[i] == fingerprint);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return found || __atomic_load_n(&header->seq, __ATOMIC_RELAXED) != seq;
+}
@@ -0,0 +1,368 @@
+// --- transaction history ---
+// history.dat is a header followed by fixed-size records in the order they were logged. each record links
+// back to the previous record of its account (and of the receiver, for a transfer), and history.idx is an
+// open-addressing table from account to its newest record, so an account statement follows one chain
+// instead of reading the file. the appender never lets a record's time go below the one before it, so the
+// file is sorted by time and a time range starts with a binary search.
+// the table is updated before a batch of records is written. 'pending' marks that window: if the writer
+// dies inside it, the next one to take the lock rebuilds the table from the records
+#include "bank_internal.h"
+
+#define HISTORY_CHUNK 256 // records per read while scanning
+
+off_t historyOffset(uint64_t record) {
+    return (off_t)(sizeof(struct HistoryHeader) + record * sizeof(struct HistoryRecord));
+}
+
+// number of whole records in history.dat
+uint64_t historyCount(struct History *history) {
+    struct stat st;
+    if (fstat(history->fd, &st) != 0 || (size_t)st.st_size < sizeof(struct HistoryHeader)) return 0;
+    return ((uint64_t)st.st_size - sizeof(struct HistoryHeader)) / sizeof(struct HistoryRecord);
+}
+
+// read records [first, first + count), returns 1 if they were all there
+int historyRead(struct History *history, uint64_t first, struct HistoryRecord *out, size_t count) {
+    ssize_t size = (ssize_t)(count * sizeof(*out));
+    return pread(history->fd, out, (size_t)size, historyOffset(first)) == size;
+}
+
+// --- account index (history.idx) ---
+size_t historyIndexSize(uint32_t capacity) {
+    return sizeof(struct HistoryIndexHeader) + (size_t)capacity * sizeof(struct HistoryIndexEntry);
+}
+
+struct HistoryIndexEntry *historyEntries(struct History *history) {
+    return (struct HistoryIndexEntry *)(history->index + 1);
+}
+
+void historyUnmapIndex(struct History *history) {
+    if (history->index != NULL) munmap(history->index, history->indexSize);
+    history->index = NULL;
+    history->indexSize = 0;
+}
+
+// put 'key' into a table known to have room for it
+void historyPlace(struct History *history, uint32_t key, uint64_t newest) {
+    struct HistoryIndexEntry *entries = historyEntries(history);
+    uint32_t mask = history->index->capacity - 1;
+    uint32_t i = indexHash(key) & mask;
+    while (entries[i].key != INDEX_EMPTY && entries[i].key != key) i = (i + 1) & mask;
+    if (entries[i].key == INDEX_EMPTY) history->index->count++;
+    entries[i].key = key;
+    entries[i].newest = newest;
+}
+
+// replace history.idx with a table of 'capacity' entries, holding the current entries if 'keep' and
+// nothing otherwise (historyCatchUp() then links every record again). called with the flock held
+int historyResize(struct History *history, uint32_t capacity, int keep) {
+    struct HistoryIndexHeader header;
+    struct HistoryIndexEntry *old = NULL;
+    uint32_t oldCapacity = 0;
+    memset(&header, 0, sizeof(header));
+    if (keep) {
+        header = *history->index;
+        oldCapacity = header.capacity;
+        old = malloc((size_t)oldCapacity * sizeof(*old));
+        if (old == NULL) return 0;
+        memcpy(old, historyEntries(history), (size_t)oldCapacity * sizeof(*old));
+    }
+
+    // truncating to nothing first leaves every entry of the new size zeroed, i.e. INDEX_EMPTY
+    historyUnmapIndex(history);
+    size_t size = historyIndexSize(capacity);
+    void *base = MAP_FAILED;
+    if (ftruncate(history->indexFd, 0) == 0 && ftruncate(history->indexFd, (off_t)size) == 0) {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, history->indexFd, 0);
+    }
+    if (base == MAP_FAILED) {
+        free(old);
+        return 0;
+    }
+    history->index = base;
+    history->indexSize = size;
+
+    header.magic = HISTORY_INDEX_MAGIC;
+    header.version = HISTORY_VERSION;
+    header.capacity = capacity;
+    header.count = 0;
+    *history->index = header;
+    for (uint32_t i = 0; i < oldCapacity; i++) {
+        if (old[i].key != INDEX_EMPTY) historyPlace(history, old[i].key, old[i].newest);
+    }
+    free(old);
+    return 1;
+}
+
+// map history.idx as it is now, called with the flock held since another process may have replaced it.
+// a writer starts a missing or damaged table over. returns 1 if the table can be used
+int historyMapIndex(struct History *history) {
+    struct stat st;
+    if (history->indexFd < 0 || fstat(history->indexFd, &st) != 0) return 0;
+    if (history->index == NULL || history->indexSize != (size_t)st.st_size) {
+        historyUnmapIndex(history);
+        if ((size_t)st.st_size >= sizeof(struct HistoryIndexHeader)) {
+            void *base = mmap(NULL, (size_t)st.st_size, history->writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                              MAP_SHARED, history->indexFd, 0);
+            if (base != MAP_FAILED) {
+                history->index = base;
+                history->indexSize = (size_t)st.st_size;
+            }
+        }
+    }
+
+    struct HistoryIndexHeader *header = history->index;
+    int valid = header != NULL && header->magic == HISTORY_INDEX_MAGIC && header->version == HISTORY_VERSION &&
+                header->capacity > 0 && (header->capacity & (header->capacity - 1)) == 0 &&
+                history->indexSize == historyIndexSize(header->capacity);
+    if (valid || !history->writable) return valid;
+    return historyResize(history, HISTORY_INDEX_CAPACITY, 0);
+}
+
+// newest record of an account, HISTORY_NONE if it has none in the table
+uint64_t historyNewest(struct History *history, const char *accountNumber) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key)) return HISTORY_NONE;
+    struct HistoryIndexEntry *entries = historyEntries(history);
+    uint32_t mask = history->index->capacity - 1;
+    for (uint32_t i = indexHash(key) & mask, probes = 0; probes <= mask; i = (i + 1) & mask, probes++) {
+        if (entries[i].key == key) return entries[i].newest;
+        if (entries[i].key == INDEX_EMPTY) break;
+    }
+    return HISTORY_NONE;
+}
+
+// make 'record' the newest of an account, growing the table once it is half full
+int historyLink(struct History *history, const char *accountNumber, uint64_t record) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key)) return 1; // not an account number, it just isn't indexed
+    if ((history->index->count + 1) * 2 > history->index->capacity &&
+        !historyResize(history, history->index->capacity * 2, 1)) {
+        return 0;
+    }
+    historyPlace(history, key, record);
+    return 1;
+}
+
+// link the records [covered, count) into the table: ones from a writer that died before it finished, or
+// every record if the table was started over. called with the exclusive flock held
+int historyCatchUp(struct History *history, uint64_t count) {
+    if (history->index->pending != 0) {
+        if (count >= history->index->pending) {
+            history->index->covered = history->index->pending;
+            history->index->pending = 0;
+        } else if (!historyResize(history, HISTORY_INDEX_CAPACITY, 0)) {
+            return 0; // the table may point into records that were never written
+        }
+    }
+    if (history->index->covered > count && !historyResize(history, HISTORY_INDEX_CAPACITY, 0)) return 0;
+
+    struct HistoryRecord chunk[HISTORY_CHUNK];
+    while (history->index->covered < count) {
+        uint64_t first = history->index->covered;
+        size_t n = count - first < HISTORY_CHUNK ? (size_t)(count - first) : HISTORY_CHUNK;
+        if (!historyRead(history, first, chunk, n)) return 0;
+        for (size_t i = 0; i < n; i++) {
+            if (!historyLink(history, chunk[i].account, first + i) ||
+                (chunk[i].other[0] != '\0' && !historyLink(history, chunk[i].other, first + i))) {
+                return 0;
+            }
+            if (chunk[i].time > history->index->lastTime) history->index->lastTime = chunk[i].time;
+        }
+        history->index->covered = first + n;
+    }
+    return 1;
+}
+
+// --- appending ---
+// chain 'records' onto their accounts and append them as one write. their times are raised to the last
+// record's if the clock went backwards or another process logged a later event first
+int historyAppend(struct History *history, struct HistoryRecord *records, size_t count) {
+    if (count == 0) return 1;
+    if (flock(history->indexFd, LOCK_EX) != 0) return 0;
+    uint64_t first = historyCount(history);
+    int ok = historyMapIndex(history) && historyCatchUp(history, first);
+    int64_t lastTime = ok ? history->index->lastTime : 0;
+    if (ok) history->index->pending = first + count;
+
+    for (size_t i = 0; ok && i < count; i++) {
+        struct HistoryRecord *record = &records[i];
+        if (record->time < lastTime) record->time = lastTime;
+        lastTime = record->time;
+        record->previous = historyNewest(history, record->account);
+        record->otherPrevious = record->other[0] != '\0' ? historyNewest(history, record->other) : HISTORY_NONE;
+        ok = historyLink(history, record->account, first + i) &&
+             (record->other[0] == '\0' || historyLink(history, record->other, first + i));
+    }
+
+    ssize_t size = (ssize_t)(count * sizeof(*records));
+    ok = ok && pwrite(history->fd, records, (size_t)size, historyOffset(first)) == size;
+    if (ok) {
+        history->index->covered = first + count;
+        history->index->lastTime = lastTime;
+        history->index->pending = 0;
+    }
+    flock(history->indexFd, LOCK_UN);
+    return ok;
+}
+
+// open history.dat and history.idx in 'directory'. a writer creates them, a reader also gets on without
+// history.idx (or with a history.dat that is still empty)
+int historyOpen(struct History *history, const char *directory, int writable) {
+    char path[PATH_MAX];
+    memset(history, 0, sizeof(*history));
+    history->writable = writable;
+    history->indexFd = -1;
+    snprintf(path, sizeof(path), "%s/%s", directory, HISTORY_FILE);
+    history->fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (history->fd < 0) return 0;
+    snprintf(path, sizeof(path), "%s/%s", directory, HISTORY_INDEX_FILE);
+    history->indexFd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (writable && history->indexFd < 0) {
+        historyClose(history);
+        return 0;
+    }
+
+    // a new file gets its header before anything is appended, an existing one must be in this format
+    struct HistoryHeader header;
+    if (history->indexFd >= 0) flock(history->indexFd, writable ? LOCK_EX : LOCK_SH);
+    ssize_t got = pread(history->fd, &header, sizeof(header), 0);
+    int ok;
+    if (got == 0) {
+        memset(&header, 0, sizeof(header));
+        header.magic = HISTORY_MAGIC;
+        header.version = HISTORY_VERSION;
+        header.recordSize = sizeof(struct HistoryRecord);
+        ok = !writable || pwrite(history->fd, &header, sizeof(header), 0) == sizeof(header);
+    } else {
+        ok = got == sizeof(header) && header.magic == HISTORY_MAGIC && header.version == HISTORY_VERSION &&
+             header.recordSize == sizeof(struct HistoryRecord);
+        if (!ok) errno = EINVAL;
+    }
+    if (history->indexFd >= 0) flock(history->indexFd, LOCK_UN);
+
+    if (!ok) historyClose(history);
+    return ok;
+}
+
+void historyClose(struct History *history) {
+    historyUnmapIndex(history);
+    if (history->indexFd >= 0) close(history->indexFd);
+    if (history->fd >= 0) close(history->fd);
+    history->indexFd = -1;
+    history->fd = -1;
+}
+
+// --- queries ---
+void historyReport(const struct HistoryRecord *record, void (*visit)(const struct BankLogRecord *record, void *context),
+                   void *context) {
+    struct BankLogRecord out;
+    out.time = record->time;
+    out.event = (enum BankLogEvent)record->event;
+    memcpy(out.account, record->account, sizeof(out.account));
+    memcpy(out.other, record->other, sizeof(out.other));
+    out.amount = record->amount;
+    out.fee = record->fee;
+    out.balance = record->balance;
+    visit(&out, context);
+}
+
+// every record logged in [from, to], oldest first, starting from a binary search for 'from'
+int historyScanTime(struct History *history, int64_t from, int64_t to,
+                    void (*visit)(const struct BankLogRecord *record, void *context), void *context) {
+    struct HistoryRecord chunk[HISTORY_CHUNK];
+    uint64_t count = historyCount(history), low = 0, high = count;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (!historyRead(history, middle, chunk, 1)) return 0;
+        if (chunk[0].time < from) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    for (uint64_t first = low; first < count; first += HISTORY_CHUNK) {
+        size_t n = count - first < HISTORY_CHUNK ? (size_t)(count - first) : HISTORY_CHUNK;
+        if (!historyRead(history, first, chunk, n)) return 0;
+        for (size_t i = 0; i < n; i++) {
+            if (chunk[i].time > to) return 1;
+            historyReport(&chunk[i], visit, context);
+        }
+    }
+    return 1;
+}
+
+int historyInvolves(const struct HistoryRecord *record, const char *accountNumber) {
+    return strcmp(record->account, accountNumber) == 0 || strcmp(record->other, accountNumber) == 0;
+}
+
+// add 'record' to a growing array, returns 0 if out of memory
+int historyKeep(struct HistoryRecord **found, size_t *count, size_t *capacity, const struct HistoryRecord *record) {
+    if (*count == *capacity) {
+        size_t grown = *capacity == 0 ? 64 : *capacity * 2;
+        void *larger = realloc(*found, grown * sizeof(**found));
+        if (larger == NULL) return 0;
+        *found = larger;
+        *capacity = grown;
+    }
+    (*found)[(*count)++] = *record;
+    return 1;
+}
+
+// the records of one account logged in [from, to], oldest first. records the table doesn't cover yet are
+// checked one by one, then the account's chain is followed back until it is older than 'from'
+int historyScanAccount(struct History *history, const char *accountNumber, int64_t from, int64_t to,
+                       void (*visit)(const struct BankLogRecord *record, void *context), void *context) {
+    uint64_t count, covered = 0, next = HISTORY_NONE;
+    int locked = history->indexFd >= 0 && flock(history->indexFd, LOCK_SH) == 0;
+    count = historyCount(history);
+    if (locked && historyMapIndex(history) &&
+        (history->index->pending == 0 || count >= history->index->pending)) {
+        covered = history->index->pending != 0 ? history->index->pending : history->index->covered;
+        if (covered > count) covered = 0;
+        next = covered > 0 ? historyNewest(history, accountNumber) : HISTORY_NONE;
+    }
+    if (locked) flock(history->indexFd, LOCK_UN);
+
+    // collected newest first, reported oldest first
+    struct HistoryRecord *found = NULL;
+    size_t foundCount = 0, capacity = 0;
+    struct HistoryRecord chunk[HISTORY_CHUNK];
+    int ok = 1, done = 0;
+    for (uint64_t end = count; ok && !done && end > covered;) {
+        size_t n = end - covered < HISTORY_CHUNK ? (size_t)(end - covered) : HISTORY_CHUNK;
+        end -= n;
+        ok = historyRead(history, end, chunk, n);
+        for (size_t i = n; ok && i-- > 0;) {
+            if (chunk[i].time < from) {
+                done = 1;
+                break;
+            }
+            if (chunk[i].time > to || !historyInvolves(&chunk[i], accountNumber)) continue;
+            ok = historyKeep(&found, &foundCount, &capacity, &chunk[i]);
+        }
+    }
+
+    while (ok && !done && next != HISTORY_NONE && next < covered) {
+        struct HistoryRecord record;
+        ok = historyRead(history, next, &record, 1) && historyInvolves(&record, accountNumber);
+        if (!ok || record.time < from) break;
+        if (record.time <= to) ok = historyKeep(&found, &foundCount, &capacity, &record);
+        next = strcmp(record.account, accountNumber) == 0 ? record.previous : record.otherPrevious;
+    }
+
+    for (size_t i = foundCount; ok && i-- > 0;) historyReport(&found[i], visit, context);
+    free(found);
+    return ok;
+}
+
+enum BankError bankHistory(const char *directory, const char *accountNumber, int64_t from, int64_t to,
+                           void (*visit)(const struct BankLogRecord *record, void *context), void *context) {
+    struct History history;
+    if (!historyOpen(&history, directory, 0)) return errno == ENOENT ? BANK_OK : BANK_IO_ERROR; // nothing logged yet
+    int ok = accountNumber != NULL ? historyScanAccount(&history, accountNumber, from, to, visit, context)
+                                   : historyScanTime(&history, from, to, visit, context);
+    historyClose(&history);
+    return ok ? BANK_OK : BANK_IO_ERROR;
+}
@@ -0,0 +1,239 @@
+// --- account number hash index ---
+// open-addressing hash table (linear probing) from account number to store slot, kept in index.dat
+// the file is memory mapped so it loads at startup without parsing and every change is written in place.
+// entries are published with a single store of their key, so lookups need no lock. a rebuild writes a new
+// file and renames it over index.dat, bumping the lock table's generation so other handles remap it
+#include "bank_internal.h"
+
+// convert an account number string into its index key, returns 0 if it isn't a valid account number.
+// numbers never start with a 0, so every key has exactly one spelling and a hit needs no string compare
+int accountKey(const char *accountNumber, uint32_t *key) {
+    if (accountNumber[0] == '0') return 0;
+    uint32_t value = 0;
+    int digits = 0;
+    while (accountNumber[digits] != '\0') {
+        if (!isdigit((unsigned char)accountNumber[digits]) || digits == 9) return 0;
+        value = value * 10 + (uint32_t)(accountNumber[digits] - '0');
+        digits++;
+    }
+    if (digits == 0 || value <= INDEX_TOMBSTONE) return 0;
+
+    *key = value;
+    return 1;
+}
+
+uint32_t indexHash(uint32_t key) {
+    // multiplicative hashing spreads the sequential-looking account numbers across the table
+    return key * 2654435761u;
+}
+
+size_t indexFileSize(uint32_t capacity) {
+    return sizeof(struct IndexHeader) + (size_t)capacity * sizeof(struct IndexEntry);
+}
+
+// map index.dat (opened as 'fd') at the start of the reserved address range, replacing any current mapping
+int indexMap(struct Bank *bank, int fd, size_t size) {
+    if (bank->index.header == NULL) {
+        void *reserved = mmap(NULL, INDEX_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED) return 0;
+        bank->index.header = reserved;
+    }
+    if (size > INDEX_RESERVE ||
+        mmap(bank->index.header, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        return 0;
+    }
+
+    if (bank->index.fd >= 0) close(bank->index.fd);
+    bank->index.fd = fd;
+    bank->index.mapSize = size;
+    bank->index.entries = (struct IndexEntry *)((unsigned char *)bank->index.header + sizeof(struct IndexHeader));
+    return 1;
+}
+
+// create a new empty index file of the given capacity under a temporary name and map it, replacing any
+// current mapping. indexRebuild() renames it into place once it is filled
+int indexCreate(struct Bank *bank, uint32_t capacity) {
+    char path[PATH_MAX];
+    bankPath(bank, INDEX_TEMP_FILE, path);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return 0;
+
+    size_t size = indexFileSize(capacity);
+    pthread_mutex_lock(&bank->mapLock);
+    int ok = ftruncate(fd, (off_t)size) == 0 && indexMap(bank, fd, size);
+    pthread_mutex_unlock(&bank->mapLock);
+    if (!ok) {
+        close(fd);
+        return 0;
+    }
+
+    // a fresh file is zero filled, so every entry already reads as INDEX_EMPTY
+    bank->index.header->magic = INDEX_MAGIC;
+    bank->index.header->version = INDEX_VERSION;
+    bank->index.header->capacity = capacity;
+    bank->index.header->count = 0;
+    bank->index.header->tombstones = 0;
+    return 1;
+}
+
+// find the entry holding 'key', or -1
+int indexFindEntry(struct Bank *bank, uint32_t key) {
+    // the capacity is read once, a lock-free reader may race with a remap and must stay inside the table
+    uint32_t capacity = __atomic_load_n(&bank->index.header->capacity, __ATOMIC_ACQUIRE);
+    uint32_t mask = capacity - 1;
+    uint32_t i = indexHash(key) & mask;
+    for (uint32_t probes = 0; probes < capacity; probes++) {
+        uint32_t found = __atomic_load_n(&bank->index.entries[i].key, __ATOMIC_ACQUIRE);
+        if (found == key) return (int)i;
+        if (found == INDEX_EMPTY) break;
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+// place a key that is known not to be in the table
+void indexPlace(struct Bank *bank, uint32_t key, uint32_t slot) {
+    uint32_t mask = bank->index.header->capacity - 1;
+    uint32_t i = indexHash(key) & mask;
+    while (bank->index.entries[i].key != INDEX_EMPTY && bank->index.entries[i].key != INDEX_TOMBSTONE) {
+        i = (i + 1) & mask;
+    }
+    if (bank->index.entries[i].key == INDEX_TOMBSTONE) bank->index.header->tombstones--;
+    bank->index.entries[i].slot = slot;
+    __atomic_store_n(&bank->index.entries[i].key, key, __ATOMIC_RELEASE);
+    bank->index.header->count++;
+}
+
+// rebuild the whole index from the live slots of the account store. called with every lock held
+int indexRebuild(struct Bank *bank, uint32_t capacity) {
+    while ((size_t)capacity * 7 < (size_t)bank->store.header->count * 10) capacity *= 2;
+    // never shrink a mapped table, a lock-free reader may still be probing it with the old capacity
+    if (bank->index.fd >= 0 && bank->index.header->magic == INDEX_MAGIC && capacity < bank->index.header->capacity) {
+        capacity = bank->index.header->capacity;
+    }
+    // odd while the new file is being filled, lock-free readers retry until it is even again
+    __atomic_add_fetch(&bank->locks->indexGeneration, 1, __ATOMIC_ACQ_REL);
+    int ok = indexCreate(bank, capacity);
+
+    for (uint32_t i = 0; ok && i < bank->store.header->used; i++) {
+        uint32_t key;
+        if (bank->store.slots[i].state == SLOT_USED && accountKey(bank->store.slots[i].account.accountNumber, &key)) {
+            indexPlace(bank, key, i);
+        }
+    }
+
+    char tempPath[PATH_MAX], path[PATH_MAX];
+    bankPath(bank, INDEX_TEMP_FILE, tempPath);
+    bankPath(bank, INDEX_FILE, path);
+    ok = ok && rename(tempPath, path) == 0;
+    bank->index.generation = __atomic_add_fetch(&bank->locks->indexGeneration, 1, __ATOMIC_ACQ_REL);
+    return ok;
+}
+
+// remap index.dat if another handle has rebuilt it since this one mapped it, returns 0 if that failed
+int indexRefresh(struct Bank *bank) {
+    uint32_t generation = __atomic_load_n(&bank->locks->indexGeneration, __ATOMIC_ACQUIRE);
+    if (generation == __atomic_load_n(&bank->index.generation, __ATOMIC_ACQUIRE) || (generation & 1)) return 1;
+
+    pthread_mutex_lock(&bank->mapLock);
+    int ok = 1;
+    if (generation != bank->index.generation) {
+        char path[PATH_MAX];
+        bankPath(bank, INDEX_FILE, path);
+        int fd = open(path, O_RDWR);
+        struct stat st;
+        ok = fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct IndexHeader) &&
+             indexMap(bank, fd, (size_t)st.st_size);
+        if (ok) {
+            __atomic_store_n(&bank->index.generation, generation, __ATOMIC_RELEASE);
+        } else if (fd >= 0) {
+            close(fd);
+        }
+    }
+    pthread_mutex_unlock(&bank->mapLock);
+    return ok;
+}
+
+// open index.dat, rebuilding it from the store if it is missing or out of date
+int indexOpen(struct Bank *bank) {
+    char path[PATH_MAX];
+    bankPath(bank, INDEX_FILE, path);
+    bank->index.generation = bank->locks->indexGeneration;
+    int fd = open(path, O_RDWR);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct IndexHeader) &&
+            indexMap(bank, fd, (size_t)st.st_size)) {
+            struct IndexHeader *header = bank->index.header;
+            if (header->magic == INDEX_MAGIC && header->version == INDEX_VERSION &&
+                indexFileSize(header->capacity) <= (size_t)st.st_size && header->count == bank->store.header->count) {
+                return 1;
+            }
+        } else {
+            close(fd);
+        }
+    }
+    return indexRebuild(bank, INDEX_MIN_CAPACITY);
+}
+
+void indexClose(struct Bank *bank) {
+    if (bank->index.fd < 0) return;
+    msync(bank->index.header, bank->index.mapSize, MS_SYNC);
+    munmap(bank->index.header, INDEX_RESERVE);
+    close(bank->index.fd);
+    bank->index.fd = -1;
+    bank->index.header = NULL;
+}
+
+// store slot of an account number, -1 if there is no such account
+int lookupAccount(struct Bank *bank, const char *accountNumber) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key)) return -1;
+
+    int entry = indexFindEntry(bank, key);
+    return entry < 0 ? -1 : (int)bank->index.entries[entry].slot;
+}
+
+// add an account number -> slot mapping, growing the table past 70% load
+int indexInsert(struct Bank *bank, const char *accountNumber, int slot) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key) || indexFindEntry(bank, key) >= 0) return 0;
+
+    if (!indexHasRoom(bank)) {
+        if (!indexMakeRoom(bank)) return 0;
+        // the rebuild may already contain the new account if it was stored first
+        if (indexFindEntry(bank, key) >= 0) return 1;
+    }
+
+    indexPlace(bank, key, (uint32_t)slot);
+    return 1;
+}
+
+// 1 if one more key fits without going past 70% load
+int indexHasRoom(struct Bank *bank) {
+    struct IndexHeader *header = bank->index.header;
+    return (size_t)(header->count + header->tombstones + 1) * 10 <= (size_t)header->capacity * 7;
+}
+
+// rebuild the table so another key fits. callers without every lock check indexHasRoom() first
+int indexMakeRoom(struct Bank *bank) {
+    // rebuilding drops tombstones, only double when the live keys need the room
+    uint32_t capacity = bank->index.header->capacity;
+    if ((size_t)(bank->index.header->count + 1) * 10 > (size_t)capacity * 5) capacity *= 2;
+    return indexRebuild(bank, capacity);
+}
+
+// remove an account number, leaving a tombstone so later keys in the probe chain stay reachable
+int indexRemove(struct Bank *bank, const char *accountNumber) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key)) return 0;
+
+    int entry = indexFindEntry(bank, key);
+    if (entry < 0) return 0;
+
+    __atomic_store_n(&bank->index.entries[entry].key, INDEX_TOMBSTONE, __ATOMIC_RELEASE);
+    bank->index.header->count--;
+    bank->index.header->tombstones++;
+    return 1;
+}
+
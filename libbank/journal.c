@@ -0,0 +1,245 @@
+// --- write-ahead journal ---
+// every change is appended to journal.wal and committed before it is applied to the store.
+// records are buffered and written with one write() per commit; how often the journal is fsync'd depends on
+// the durability level. the store header remembers the last record it durably contains (checkpointLsn), and
+// at startup only records after that are replayed.
+// each handle buffers its own records; LSNs are stamped when the buffer is written, under the journal lock
+// shared by every process, so the file always holds consecutive LSNs whoever wrote them
+#include "bank_internal.h"
+
+uint32_t journalChecksum(const struct JournalRecord *record) {
+    // FNV-1a over the record after the checksum field
+    const unsigned char *bytes = (const unsigned char *)record + offsetof(struct JournalRecord, lsn);
+    size_t length = sizeof(struct JournalRecord) - offsetof(struct JournalRecord, lsn);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// cut the file back to the records the lock table knows were written completely
+int journalTruncate(struct Bank *bank) {
+    return ftruncate(bank->journal.fd, (off_t)(bank->locks->journalRecords * sizeof(struct JournalRecord))) == 0;
+}
+
+// write out the buffered records, and fsync them if 'durable' is set
+int journalFlush(struct Bank *bank, int durable) {
+    pthread_mutex_lock(&bank->journalLock);
+    size_t used = bank->journal.used;
+    int ok = 1;
+    if (used > 0) {
+        struct LockTable *locks = bank->locks;
+        // a process that died mid-append may have left a partial record, cut it off before appending after it
+        if (lockMutex(bank, &locks->journal) && !journalTruncate(bank)) ok = 0;
+
+        uint64_t firstLsn = locks->nextLsn;
+        for (size_t offset = 0; offset < used; offset += sizeof(struct JournalRecord)) {
+            struct JournalRecord *record = (struct JournalRecord *)(bank->journal.buffer + offset);
+            record->lsn = locks->nextLsn++;
+            record->checksum = journalChecksum(record);
+        }
+
+        size_t written = 0;
+        while (ok && written < used) {
+            ssize_t n = write(bank->journal.fd, bank->journal.buffer + written, used - written);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                ok = 0;
+                break;
+            }
+            written += (size_t)n;
+        }
+        if (ok) {
+            locks->journalRecords += used / sizeof(struct JournalRecord);
+        } else {
+            // nothing of this buffer was committed, hand its LSNs back and drop whatever part reached the file
+            locks->nextLsn = firstLsn;
+            journalTruncate(bank);
+        }
+        pthread_mutex_unlock(&locks->journal);
+
+        if (ok) bank->journal.unsynced = 1;
+        bank->journal.used = 0;
+    }
+
+    // the fsync happens outside the shared lock, so other processes keep appending while this one waits
+    if (ok && durable && bank->journal.unsynced) {
+        if (fsync(bank->journal.fd) != 0) {
+            ok = 0;
+        } else {
+            bank->journal.unsynced = 0;
+            bank->journal.syncs++;
+        }
+    }
+    pthread_mutex_unlock(&bank->journalLock);
+    return ok;
+}
+
+// add a record to the buffer, it reaches the file at the next commit
+int journalAppend(struct Bank *bank, struct JournalRecord *record) {
+    record->magic = JOURNAL_MAGIC;
+    pthread_mutex_lock(&bank->journalLock);
+    while (bank->journal.used + sizeof(*record) > sizeof(bank->journal.buffer)) {
+        pthread_mutex_unlock(&bank->journalLock);
+        if (!journalFlush(bank, 0)) return 0;
+        pthread_mutex_lock(&bank->journalLock);
+    }
+    memcpy(bank->journal.buffer + bank->journal.used, record, sizeof(*record));
+    bank->journal.used += sizeof(*record);
+    pthread_mutex_unlock(&bank->journalLock);
+    return 1;
+}
+
+// commit point of one operation, must succeed before the operation is applied to the store
+int journalCommit(struct Bank *bank) {
+    if (bank->journal.sync == BANK_DURABILITY_OP) return journalFlush(bank, 1);
+    // inside a batch the record is still written before the change is applied, the batch shares one fsync
+    // at journalEndBatch
+    if (bank->journal.batchDepth > 0) return journalFlush(bank, 0);
+    return journalFlush(bank, bank->journal.sync == BANK_DURABILITY_BATCH);
+}
+
+// group the commits of several operations so they share a single fsync
+void journalBeginBatch(struct Bank *bank) {
+    bank->journal.batchDepth++;
+}
+
+int journalEndBatch(struct Bank *bank) {
+    if (bank->journal.batchDepth > 0) bank->journal.batchDepth--;
+    if (bank->journal.batchDepth > 0) return 1;
+    return journalFlush(bank, bank->journal.sync != BANK_DURABILITY_NONE);
+}
+
+// log a balance change and commit it
+int journalBalance(struct Bank *bank, const char *accountNumber, int64_t amount, int64_t balance) {
+    struct JournalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = JOURNAL_BALANCE;
+    record.amount = amount;
+    record.balance = balance;
+    strcpy(record.account.accountNumber, accountNumber);
+    return journalAppend(bank, &record) && journalCommit(bank);
+}
+
+// log a whole account for JOURNAL_CREATE or JOURNAL_DELETE and commit it
+int journalAccount(struct Bank *bank, enum JournalType type, const struct Account *account) {
+    struct JournalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = (uint32_t)type;
+    record.account = *account;
+    // replay moves the allocator past every number it gave out, even one deleted again before a crash
+    if (type == JOURNAL_CREATE) record.allocCursor = bank->store.header->allocCursor;
+    return journalAppend(bank, &record) && journalCommit(bank);
+}
+
+// redo one journal record against the store and index. records carry resulting values, so replaying
+// a record that was already applied is harmless
+void journalRedo(struct Bank *bank, const struct JournalRecord *record) {
+    int slot = lookupAccount(bank, record->account.accountNumber);
+    if (record->type == JOURNAL_CREATE && record->allocCursor > bank->store.header->allocCursor) {
+        bank->store.header->allocCursor = record->allocCursor;
+    }
+
+    if (record->type == JOURNAL_BALANCE) {
+        storeWriteBalance(bank, slot, record->balance);
+    } else if (record->type == JOURNAL_TRANSFER) {
+        storeWriteBalance(bank, slot, record->balance);
+        storeWriteBalance(bank, lookupAccount(bank, record->toAccount), record->toBalance);
+    } else if (record->type == JOURNAL_CREATE && slot < 0) {
+        slot = storeInsert(bank, &record->account);
+        if (slot >= 0) {
+            filterInsert(bank, record->account.accountNumber);
+            orderInsert(bank, record->account.accountNumber, slot);
+            customerInsert(bank, &record->account);
+            indexInsert(bank, record->account.accountNumber, slot);
+        }
+    } else if (record->type == JOURNAL_DELETE && slot >= 0) {
+        indexRemove(bank, record->account.accountNumber);
+        storeRemove(bank, slot);
+        orderRemove(bank, record->account.accountNumber);
+        filterRemove(bank, record->account.accountNumber);
+        customerRemove(bank, &record->account);
+    }
+}
+
+// make everything up to the last journal record durable in the store itself, so startup can skip those records
+void journalSyncStore(struct Bank *bank) {
+    msync(bank->store.base, bank->store.mapSize, MS_SYNC);
+    msync(bank->index.header, bank->index.mapSize, MS_SYNC);
+    msync(bank->order.header, bank->order.mapSize, MS_SYNC);
+    // the filter and the customer index are marked first, a crash before the store header is synced leaves
+    // them different
+    if (bank->filter.mapSize > 0) {
+        bank->filter.header->checkpointLsn = bank->locks->nextLsn - 1;
+        msync(bank->filter.header, bank->filter.mapSize, MS_SYNC);
+    }
+    if (bank->customers.mapSize > 0) {
+        bank->customers.header->checkpointLsn = bank->locks->nextLsn - 1;
+        msync(bank->customers.header, bank->customers.mapSize, MS_SYNC);
+    }
+    bank->store.header->checkpointLsn = bank->locks->nextLsn - 1;
+    msync(bank->store.base, sizeof(struct StoreHeader), MS_SYNC);
+}
+
+// replay the records the store doesn't have yet (an unfinished session), returns the number replayed or -1
+int journalRecover(struct Bank *bank) {
+    int replayed = 0;
+    struct JournalRecord record;
+    off_t offset = 0;
+
+    // records are fixed size with consecutive LSNs, so jump straight past the ones the store already has
+    if (pread(bank->journal.fd, &record, sizeof(record), 0) == (ssize_t)sizeof(record) &&
+        record.magic == JOURNAL_MAGIC && record.checksum == journalChecksum(&record) &&
+        record.lsn <= bank->store.header->checkpointLsn) {
+        offset = (off_t)(bank->store.header->checkpointLsn + 1 - record.lsn) * (off_t)sizeof(record);
+    }
+
+    while (pread(bank->journal.fd, &record, sizeof(record), offset) == (ssize_t)sizeof(record)) {
+        // stop at the first incomplete or corrupt record, it was never committed
+        if (record.magic != JOURNAL_MAGIC || record.checksum != journalChecksum(&record)) break;
+        if (record.lsn > bank->store.header->checkpointLsn) {
+            journalRedo(bank, &record);
+            replayed++;
+        }
+        if (record.lsn >= bank->locks->nextLsn) bank->locks->nextLsn = record.lsn + 1;
+        offset += (off_t)sizeof(record);
+    }
+
+    // cut off a torn tail so new records are appended right after the last good one
+    if (ftruncate(bank->journal.fd, offset) != 0) return -1;
+    bank->locks->journalRecords = (uint64_t)offset / sizeof(record);
+
+    if (replayed > 0) {
+        // a process that died may have left the filter and the customer index behind the store, and neither
+        // may miss an account, so they are rebuilt from the store rather than trusted
+        filterRebuild(bank, bank->filter.header->buckets);
+        customerRebuild(bank);
+        journalSyncStore(bank);
+    }
+    return replayed;
+}
+
+// open the journal (after the store and index). with 'recover' set the caller has the database to itself and
+// any unfinished session is replayed, otherwise the LSN counters in the lock table are already live
+int journalOpen(struct Bank *bank, enum BankDurability sync, int recover) {
+    char path[PATH_MAX];
+    bankPath(bank, JOURNAL_FILE, path);
+    bank->journal.fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (bank->journal.fd < 0) return 0;
+
+    bank->journal.sync = sync;
+    if (!recover) return 1;
+    bank->locks->nextLsn = bank->store.header->checkpointLsn + 1;
+    return journalRecover(bank) >= 0;
+}
+
+// flush everything and sync the store and index. the journal itself is kept until the next snapshot,
+// since restoring from the snapshot needs every record written after it
+void journalClose(struct Bank *bank) {
+    if (bank->journal.fd < 0) return;
+    journalFlush(bank, bank->journal.sync != BANK_DURABILITY_NONE);
+    journalSyncStore(bank);
+    close(bank->journal.fd);
+    bank->journal.fd = -1;
+}
@@ -0,0 +1,49 @@
+// --- the old text layout ---
+// before accounts.dat existed, index.txt listed the account numbers and each account had its own
+// <accountNumber>.txt file. both are only read by the import now, listing goes through order.dat
+#include "bank_internal.h"
+
+// import the old one-file-per-account layout (index.txt + <accountNumber>.txt) into the store
+// accounts that are already in the store are skipped, so running it twice is harmless. returns number imported
+int convertLegacyDatabase(struct Bank *bank) {
+    char path[PATH_MAX];
+    bankPath(bank, ACCOUNT_LIST_FILE, path);
+    FILE *indexFile = fopen(path, "r");
+    if (!indexFile) return 0;
+
+    // the whole import is one journal batch, so it costs a single fsync
+    journalBeginBatch(bank);
+    int imported = 0;
+    char number[13];
+    while (fscanf(indexFile, "%12s", number) == 1) {
+        // skip tombstone lines of deleted accounts and accounts already in the store
+        if (number[0] == '-' || lookupAccount(bank, number) >= 0) continue;
+
+        char name[20], filename[PATH_MAX];
+        sprintf(name, "%s.txt", number);
+        bankPath(bank, name, filename);
+        struct Account legacy;
+        if (!readAccountFile(filename, &legacy)) continue;
+
+        if (!journalAccount(bank, JOURNAL_CREATE, &legacy)) break;
+        int slot = storeInsert(bank, &legacy);
+        if (slot >= 0) {
+            filterInsert(bank, legacy.accountNumber);
+            orderInsert(bank, legacy.accountNumber, slot);
+            customerInsert(bank, &legacy);
+        }
+        if (slot >= 0 && indexInsert(bank, legacy.accountNumber, slot)) imported++;
+    }
+
+    journalEndBatch(bank);
+    fclose(indexFile);
+    return imported;
+}
+
+// remove the old text file of an account, which would otherwise come back with the next import
+void removeLegacyFile(struct Bank *bank, const char *accountNumber) {
+    char name[20], filename[PATH_MAX];
+    sprintf(name, "%s.txt", accountNumber);
+    bankPath(bank, name, filename);
+    remove(filename);
+}
@@ -0,0 +1,165 @@
+// --- shared locks ---
+// several processes (and threads) can work on the same database at once. a balance change only locks the
+// stripe its account hashes to, so tellers working on different accounts run in parallel. creating and
+// deleting accounts also take the structure lock, and whole-database work (snapshots, compaction, index
+// rebuilds, batch chunks) takes every lock. locks are always taken in the same order, stripes in ascending
+// order and then the structure lock, so two callers can never wait on each other.
+// the mutexes are robust: if a process dies holding one, the next caller takes it over and the journal is
+// replayed under every lock, which finishes whatever the dead process had committed
+#include "bank_internal.h"
+
+int stripeOf(const char *accountNumber) {
+    uint32_t key = 0;
+    for (const char *c = accountNumber; *c != '\0'; c++) key = key * 10 + (uint32_t)(*c - '0');
+    return (int)(((key * 2654435761u) >> 16) % LOCK_STRIPES);
+}
+
+// lock 'mutex', returns 1 if it had to be taken over from a process that died holding it
+int lockMutex(struct Bank *bank, pthread_mutex_t *mutex) {
+    if (pthread_mutex_lock(mutex) != EOWNERDEAD) return 0;
+    pthread_mutex_consistent(mutex);
+    __atomic_store_n(&bank->locks->repair, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// pick up files another handle grew or replaced while this one wasn't holding a lock
+void lockRefresh(struct Bank *bank) {
+    if (bank->store.fd >= 0) storeRefresh(bank);
+    if (bank->index.fd >= 0) indexRefresh(bank);
+    if (bank->order.fd >= 0) orderRefresh(bank);
+    if (bank->filter.fd >= 0) filterRefresh(bank);
+    if (bank->customers.fd >= 0) customerRefresh(bank);
+}
+
+int lockInitMutex(pthread_mutex_t *mutex) {
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    int ok = pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED) == 0 &&
+             pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST) == 0 &&
+             pthread_mutex_init(mutex, &attributes) == 0;
+    pthread_mutexattr_destroy(&attributes);
+    return ok;
+}
+
+// map locks.dat, setting it up if no other process has the database open ('alone' is set then, and the
+// caller keeps the database to itself until lockShare()). returns 1 on success
+int lockOpen(struct Bank *bank, int *alone) {
+    char path[PATH_MAX];
+    bankPath(bank, LOCK_FILE, path);
+    bank->lockFd = open(path, O_RDWR | O_CREAT, 0644);
+    if (bank->lockFd < 0) return 0;
+
+    // every open handle holds a shared flock, so getting it exclusively means nobody else is using the
+    // files. a process that comes in while the table is being set up waits on its shared flock
+    *alone = flock(bank->lockFd, LOCK_EX | LOCK_NB) == 0;
+    struct stat st;
+    void *base = MAP_FAILED;
+    if ((*alone || flock(bank->lockFd, LOCK_SH) == 0) &&
+        (!*alone || ftruncate(bank->lockFd, sizeof(struct LockTable)) == 0) && fstat(bank->lockFd, &st) == 0 &&
+        (size_t)st.st_size >= sizeof(struct LockTable)) {
+        base = mmap(NULL, sizeof(struct LockTable), PROT_READ | PROT_WRITE, MAP_SHARED, bank->lockFd, 0);
+    }
+    if (base == MAP_FAILED) {
+        close(bank->lockFd);
+        bank->lockFd = -1;
+        return 0;
+    }
+    bank->locks = base;
+
+    if (*alone) {
+        // left over from the last run, any lock still marked as held belongs to a process that is gone
+        memset(bank->locks, 0, sizeof(*bank->locks));
+        int ok = lockInitMutex(&bank->locks->structure) && lockInitMutex(&bank->locks->journal);
+        for (int i = 0; ok && i < LOCK_STRIPES; i++) {
+            ok = lockInitMutex(&bank->locks->stripes[i]);
+        }
+        bank->locks->magic = ok ? LOCK_MAGIC : 0;
+        bank->locks->version = LOCK_VERSION;
+    }
+    if (bank->locks->magic != LOCK_MAGIC || bank->locks->version != LOCK_VERSION) {
+        lockClose(bank);
+        return 0;
+    }
+    return 1;
+}
+
+// let other processes in once the handle that opened the database alone has finished setting it up
+void lockShare(struct Bank *bank) {
+    flock(bank->lockFd, LOCK_SH);
+}
+
+void lockClose(struct Bank *bank) {
+    if (bank->lockFd < 0) return;
+    munmap(bank->locks, sizeof(struct LockTable));
+    flock(bank->lockFd, LOCK_UN);
+    close(bank->lockFd);
+    bank->lockFd = -1;
+    bank->locks = NULL;
+}
+
+// --- per-account locks ---
+void lockAccount(struct Bank *bank, const char *accountNumber) {
+    lockMutex(bank, &bank->locks->stripes[stripeOf(accountNumber)]);
+    lockRefresh(bank);
+}
+
+void unlockAccount(struct Bank *bank, const char *accountNumber) {
+    pthread_mutex_unlock(&bank->locks->stripes[stripeOf(accountNumber)]);
+}
+
+// both sides of a transfer, lower stripe first so two opposite transfers can't deadlock
+void lockAccountPair(struct Bank *bank, const char *first, const char *second) {
+    int a = stripeOf(first), b = stripeOf(second);
+    lockMutex(bank, &bank->locks->stripes[a < b ? a : b]);
+    if (a != b) lockMutex(bank, &bank->locks->stripes[a < b ? b : a]);
+    lockRefresh(bank);
+}
+
+void unlockAccountPair(struct Bank *bank, const char *first, const char *second) {
+    int a = stripeOf(first), b = stripeOf(second);
+    if (a != b) pthread_mutex_unlock(&bank->locks->stripes[a < b ? b : a]);
+    pthread_mutex_unlock(&bank->locks->stripes[a < b ? a : b]);
+}
+
+// --- structure and whole-database locks ---
+// taken after any stripe lock the caller needs
+void lockStructure(struct Bank *bank) {
+    lockMutex(bank, &bank->locks->structure);
+    lockRefresh(bank);
+}
+
+void unlockStructure(struct Bank *bank) {
+    pthread_mutex_unlock(&bank->locks->structure);
+}
+
+// every stripe and the structure lock: nobody else is reading or changing anything until unlockAll()
+void lockAll(struct Bank *bank) {
+    for (int i = 0; i < LOCK_STRIPES; i++) {
+        lockMutex(bank, &bank->locks->stripes[i]);
+    }
+    lockMutex(bank, &bank->locks->structure);
+    lockRefresh(bank);
+}
+
+void unlockAll(struct Bank *bank) {
+    pthread_mutex_unlock(&bank->locks->structure);
+    for (int i = LOCK_STRIPES - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&bank->locks->stripes[i]);
+    }
+}
+
+// after a process died holding a lock, its last operation may be committed to the journal but only half
+// applied. replaying the journal tail under every lock finishes it. call with no locks held
+void repairIfNeeded(struct Bank *bank) {
+    if (!__atomic_load_n(&bank->locks->repair, __ATOMIC_ACQUIRE)) return;
+    lockAll(bank);
+    if (bank->locks->repair && journalFlush(bank, 0) && journalRecover(bank) >= 0) {
+        storeResetSeq(bank);
+        // the dead process may have been changing pages of the tree
+        if (bank->order.header->seq & 1) orderRebuild(bank);
+        if (bank->filter.header->seq & 1) filterRebuild(bank, bank->filter.header->buckets);
+        if (bank->customers.header->seq & 1) customerRebuild(bank);
+        bank->locks->repair = 0;
+    }
+    unlockAll(bank);
+}
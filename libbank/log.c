@@ -0,0 +1,175 @@
+// --- transaction log pipeline ---
+// bankLogEvent() only stamps the time and copies the event into a fixed-size record in a ring buffer, so a
+// teller never waits on file I/O. one writer thread drains the ring in batches and appends each batch to the
+// history (history.c) with a single write.
+// the ring is Vyukov's bounded queue: every slot carries a sequence number that says whether it is free for
+// the producer holding that ticket or filled for the writer, so producers only contend on one atomic
+// counter. when the ring is full a producer wakes the writer and yields until a slot frees up, which keeps
+// a burst from growing memory or dropping events
+#include "bank_internal.h"
+#include <sched.h>
+
+#define LOG_RING_SLOTS 4096 // power of two
+#define LOG_WAKE_AT (LOG_RING_SLOTS / 4) // entries queued before a producer wakes the writer early
+#define LOG_IDLE_MS 100 // the writer looks at the ring at least this often
+#define LOG_BATCH 1024 // records appended with one write at most
+
+struct LogSlot {
+    uint64_t sequence; // == ticket: free for that producer, == ticket + 1: filled for the writer
+    struct HistoryRecord record;
+};
+
+struct BankLog {
+    struct History history;
+    uint64_t enqueued __attribute__((aligned(64))); // next producer ticket
+    uint64_t dequeued __attribute__((aligned(64))); // next ticket the writer reads, only it writes this
+    int sleeping;      // set while the writer waits on 'wake', producers then signal it
+    int stopping;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    struct LogSlot slots[LOG_RING_SLOTS];
+    struct HistoryRecord batch[LOG_BATCH]; // what the writer took off the ring and is appending
+};
+
+const char *bankLogEventText(enum BankLogEvent event) {
+    switch (event) {
+    case BANK_LOG_SESSION_START: return "Session start";
+    case BANK_LOG_SESSION_END: return "Session end";
+    case BANK_LOG_SERVER_START: return "Server start";
+    case BANK_LOG_SERVER_STOP: return "Server stop";
+    case BANK_LOG_CREATING: return "Creating account";
+    case BANK_LOG_CREATE: return "Create";
+    case BANK_LOG_DELETE: return "Delete";
+    case BANK_LOG_DEPOSIT: return "Deposit";
+    case BANK_LOG_WITHDRAW: return "Withdraw";
+    case BANK_LOG_TRANSFER: return "Transfer";
+    case BANK_LOG_BATCH: return "Batch";
+    }
+    return "Unknown";
+}
+
+void logWake(struct BankLog *log) {
+    pthread_mutex_lock(&log->lock);
+    pthread_cond_signal(&log->wake);
+    pthread_mutex_unlock(&log->lock);
+}
+
+void bankLogEvent(struct BankLog *log, enum BankLogEvent event, const char *account, const char *other,
+                  int64_t amount, int64_t fee, int64_t balance) {
+    if (log == NULL) return;
+    struct LogSlot *slot;
+    uint64_t ticket = __atomic_load_n(&log->enqueued, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &log->slots[ticket & (LOG_RING_SLOTS - 1)];
+        int64_t lag = (int64_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - ticket);
+        if (lag == 0) {
+            if (__atomic_compare_exchange_n(&log->enqueued, &ticket, ticket + 1, 1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (lag < 0) {
+            // full: the writer is still on this slot's previous round
+            logWake(log);
+            sched_yield();
+            ticket = __atomic_load_n(&log->enqueued, __ATOMIC_RELAXED);
+        } else {
+            ticket = __atomic_load_n(&log->enqueued, __ATOMIC_RELAXED);
+        }
+    }
+
+    struct HistoryRecord *record = &slot->record;
+    memset(record, 0, sizeof(*record));
+    record->time = (int64_t)time(NULL);
+    record->amount = amount;
+    record->fee = fee;
+    record->balance = balance;
+    record->event = (uint8_t)event;
+    snprintf(record->account, sizeof(record->account), "%s", account != NULL ? account : "");
+    snprintf(record->other, sizeof(record->other), "%s", other != NULL ? other : "");
+    __atomic_store_n(&slot->sequence, ticket + 1, __ATOMIC_RELEASE);
+
+    // the writer batches on its own, it is only woken early once a good part of the ring is waiting
+    if (__atomic_load_n(&log->sleeping, __ATOMIC_SEQ_CST) &&
+        ticket + 1 - __atomic_load_n(&log->dequeued, __ATOMIC_RELAXED) >= LOG_WAKE_AT) {
+        logWake(log);
+    }
+}
+
+// take up to LOG_BATCH queued records and append them, returns the number taken
+size_t logDrain(struct BankLog *log) {
+    size_t taken = 0;
+    while (taken < LOG_BATCH) {
+        struct LogSlot *slot = &log->slots[log->dequeued & (LOG_RING_SLOTS - 1)];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != log->dequeued + 1) break;
+        log->batch[taken++] = slot->record;
+        // hand the slot back to the producer that gets it on the ring's next round
+        __atomic_store_n(&slot->sequence, log->dequeued + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+        __atomic_store_n(&log->dequeued, log->dequeued + 1, __ATOMIC_RELAXED);
+    }
+    // nowhere to report a failed append, the events are lost like a failed fopen() used to lose them
+    historyAppend(&log->history, log->batch, taken);
+    return taken;
+}
+
+void *logWriter(void *arg) {
+    struct BankLog *log = arg;
+    for (;;) {
+        if (logDrain(log) > 0) continue;
+        if (__atomic_load_n(&log->stopping, __ATOMIC_ACQUIRE)) {
+            // producers are gone by now, this catches anything queued since the last drain
+            while (logDrain(log) > 0) {
+            }
+            break;
+        }
+
+        pthread_mutex_lock(&log->lock);
+        __atomic_store_n(&log->sleeping, 1, __ATOMIC_SEQ_CST);
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += LOG_IDLE_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        if (!__atomic_load_n(&log->stopping, __ATOMIC_ACQUIRE)) pthread_cond_timedwait(&log->wake, &log->lock, &until);
+        __atomic_store_n(&log->sleeping, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&log->lock);
+    }
+    return NULL;
+}
+
+enum BankError bankLogOpen(const char *directory, struct BankLog **out) {
+    struct BankLog *log = calloc(1, sizeof(struct BankLog));
+    if (log == NULL) return BANK_IO_ERROR;
+    if (!historyOpen(&log->history, directory, 1)) {
+        free(log);
+        return BANK_IO_ERROR;
+    }
+    for (uint64_t i = 0; i < LOG_RING_SLOTS; i++) {
+        log->slots[i].sequence = i;
+    }
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->wake, NULL);
+    if (pthread_create(&log->thread, NULL, logWriter, log) != 0) {
+        pthread_cond_destroy(&log->wake);
+        pthread_mutex_destroy(&log->lock);
+        historyClose(&log->history);
+        free(log);
+        return BANK_IO_ERROR;
+    }
+    *out = log;
+    return BANK_OK;
+}
+
+// write out everything still queued and stop the writer. no thread may log to 'log' any more
+void bankLogClose(struct BankLog *log) {
+    if (log == NULL) return;
+    __atomic_store_n(&log->stopping, 1, __ATOMIC_RELEASE);
+    logWake(log);
+    pthread_join(log->thread, NULL);
+    pthread_cond_destroy(&log->wake);
+    pthread_mutex_destroy(&log->lock);
+    historyClose(&log->history);
+    free(log);
+}
@@ -0,0 +1,79 @@
+// --- money ---
+// balances and amounts are whole sen (1/100 RM) in 64-bit integers, so no cents are lost to rounding.
+// text is only converted at input (parseMoney) and output (formatMoney)
+#include "bank_internal.h"
+
+// parse the 'length' bytes at 'text' as "123", "123.4" or "123.45" into sen without going through floating
+// point, returns 0 if malformed. the text doesn't need to be terminated, so a field can be parsed in place
+int parseMoneyText(const char *text, size_t length, int64_t *sen) {
+    int64_t whole = 0;
+    int digits = 0;
+    const char *p = text, *end = text + length;
+    while (p < end && isdigit((unsigned char)*p)) {
+        if (digits == 15) return 0; // keeps whole * 100 far from overflowing
+        whole = whole * 10 + (*p - '0');
+        digits++;
+        p++;
+    }
+
+    int64_t cents = 0;
+    int decimals = 0;
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && isdigit((unsigned char)*p)) {
+            if (decimals == 2) return 0; // sen is the smallest unit
+            cents = cents * 10 + (*p - '0');
+            decimals++;
+            p++;
+        }
+        if (decimals == 1) cents *= 10; // "1.5" is 1.50
+    }
+    if (p != end || (digits == 0 && decimals == 0)) return 0;
+
+    *sen = whole * 100 + cents;
+    return 1;
+}
+
+int parseMoney(const char *text, int64_t *sen) {
+    return parseMoneyText(text, strlen(text), sen);
+}
+
+// format sen as "1234.56" into 'out' (MONEY_TEXT_SIZE bytes), returns 'out' so it can go straight into printf
+char *formatMoney(int64_t sen, char *out) {
+    char digits[MONEY_TEXT_SIZE];
+    uint64_t value = sen < 0 ? (uint64_t)(-(sen + 1)) + 1 : (uint64_t)sen;
+    int n = 0;
+    // write the digits backwards, the decimal point goes after the two cent digits
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+        if (n == 2) digits[n++] = '.';
+    } while (value > 0 || n < 4);
+
+    int i = 0;
+    if (sen < 0) out[i++] = '-';
+    while (n > 0) out[i++] = digits[--n];
+    out[i] = '\0';
+    return out;
+}
+
+// remittance fees for a batch of transfers: fees[i] = amounts[i] * rateBps[i] / 10000 rounded half up,
+// where rates are in basis points (200 = 2%). a branch-free loop over plain arrays, so the compiler can
+// vectorize it. a batch run prices each chunk's transfers in one call, a single transfer is a batch of one
+void computeFees(const int64_t *restrict amounts, const int32_t *restrict rateBps, int64_t *restrict fees, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        fees[i] = (amounts[i] * rateBps[i] + 5000) / 10000;
+    }
+}
+
+// remittance fee rate in basis points from sender to receiver type, returns 0 if the pair isn't allowed
+int remittanceFee(const char *senderType, const char *receiverType, int32_t *rateBps) {
+    if (strcmp(senderType, "Savings") == 0 && strcmp(receiverType, "Current") == 0) {
+        *rateBps = 200; // 2% fee
+    } else if (strcmp(senderType, "Current") == 0 && strcmp(receiverType, "Savings") == 0) {
+        *rateBps = 300; // 3% fee
+    } else {
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,415 @@
+// --- name search ---
+// each handle keeps an in-memory trigram index over the account holders' names. a name is split into words
+// of letters and digits, and every word, padded as "  word ", gives its trigrams, so the start of a word
+// counts for as much as the middle and a misspelt letter only spoils the three trigrams around it. a list
+// per trigram holds the store slots of the names that contain it, in slot order. a query is scored against
+// every name that shares at least half of its trigrams, by counting over the lists, rarest first; the best
+// few are then checked against the names in the store, which is also what drops accounts that have been
+// deleted or whose slot has been reused since they were indexed.
+// the index is built by the first search on the handle. creates and deletes made through the handle keep it
+// current; accounts created by other processes are picked up by the next search, which only reads the
+// store slots that were added since (and rebuilds the index if the account number allocator shows that
+// some of them went into reused slots instead)
+#include "bank_internal.h"
+
+#define NAME_CODES 38 // padding and separators, a-z, 0-9, and any byte outside ASCII
+#define NAME_TRIGRAMS (NAME_CODES * NAME_CODES * NAME_CODES)
+#define NAME_MAX_TRIGRAMS 104 // a 100-byte name has at most one trigram per byte plus the last word's end
+#define NAME_READ_RETRIES 1000 // optimistic reads of a slot before a writer is assumed to have died in it
+
+struct NameList {
+    uint32_t *slots; // ascending, each slot once
+    uint32_t count;
+    uint32_t capacity;
+};
+
+struct NameIndex {
+    pthread_mutex_t lock;  // the whole index, a search holds it while counting
+    int built;
+    uint32_t cursor;       // the store's allocCursor when the index last caught up
+    uint32_t used;         // store slots [0, used) have been indexed
+    uint32_t reused;       // accounts this handle created in slots below 'used' since the last catch-up
+    uint64_t entries;      // slots in all lists, including those of removed names
+    uint64_t dead;         // entries left behind by names removed through this handle
+    struct NameList *lists; // NAME_TRIGRAMS of them, allocated by the first build
+    uint32_t capacity;     // slots the arrays below have room for
+    uint8_t *sizes;        // distinct trigrams of each slot's name, 0 if the slot isn't indexed
+    uint8_t *shared;       // per search: trigrams each slot shares with the query
+    uint32_t *touched;     // per search: slots with a nonzero 'shared'
+};
+
+// --- trigrams ---
+uint32_t nameCode(unsigned char c) {
+    if (c >= 'a' && c <= 'z') return c - 'a' + 1;
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 1;
+    if (c >= '0' && c <= '9') return c - '0' + 27;
+    return c >= 0x80 ? 37 : 0;
+}
+
+// the distinct trigrams of the first 100 bytes of 'text' into 'out' (NAME_MAX_TRIGRAMS), in no particular
+// order. returns how many there are
+int nameTrigrams(const char *text, uint16_t *out) {
+    // repeats are dropped through a small hash set, a name has a few dozen trigrams at most
+    uint16_t seen[128];
+    memset(seen, 0xFF, sizeof(seen));
+    int count = 0, inWord = 0;
+    uint32_t first = 0, second = 0; // the two codes before this one, 0 pads the start of a word
+    for (int i = 0; i <= 100; i++) {
+        unsigned char c = i < 100 ? (unsigned char)text[i] : '\0';
+        uint32_t code = nameCode(c);
+        if (code == 0 && !inWord) {
+            if (c == '\0') break;
+            continue;
+        }
+        uint16_t trigram = (uint16_t)((first * NAME_CODES + second) * NAME_CODES + code);
+        uint32_t at = (trigram * 40503u >> 8) & 127;
+        while (seen[at] != 0xFFFF && seen[at] != trigram) at = (at + 1) & 127;
+        if (seen[at] == 0xFFFF) {
+            seen[at] = trigram;
+            out[count++] = trigram;
+        }
+        // a separator ends the word with a padded trigram and starts the next one from scratch
+        first = code == 0 ? 0 : second;
+        second = code;
+        inWord = code != 0;
+        if (c == '\0') break;
+    }
+    return count;
+}
+
+int compareTrigrams(const void *a, const void *b) {
+    return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+// 0-100: three parts how much of the query is in the name, one part how alike the two are overall (Dice),
+// so a name that contains the query ranks above one that only resembles it and shorter names rank first
+int nameScore(int shared, int query, int name) {
+    return (int)((int64_t)shared * (75 * (query + name) + 50 * query) / ((int64_t)query * (query + name)));
+}
+
+// trigrams of 'name' that are also in 'query', which is sorted
+int nameShared(const uint16_t *query, int queryCount, const uint16_t *name, int nameCount) {
+    int shared = 0;
+    for (int i = 0; i < nameCount; i++) {
+        int low = 0, high = queryCount;
+        while (low < high) {
+            int middle = (low + high) / 2;
+            if (query[middle] < name[i]) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        if (low < queryCount && query[low] == name[i]) shared++;
+    }
+    return shared;
+}
+
+// position of the first entry of 'list' that isn't below 'slot'
+uint32_t nameLowerBound(const struct NameList *list, uint32_t slot) {
+    uint32_t low = 0, high = list->count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (list->slots[middle] < slot) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// --- building and updating ---
+struct NameIndex *nameCreate(void) {
+    struct NameIndex *names = calloc(1, sizeof(struct NameIndex));
+    if (names != NULL) pthread_mutex_init(&names->lock, NULL);
+    return names;
+}
+
+void nameFreeLists(struct NameIndex *names) {
+    if (names->lists == NULL) return;
+    for (uint32_t i = 0; i < NAME_TRIGRAMS; i++) free(names->lists[i].slots);
+    free(names->lists);
+    names->lists = NULL;
+}
+
+void nameDestroy(struct NameIndex *names) {
+    if (names == NULL) return;
+    nameFreeLists(names);
+    free(names->sizes);
+    free(names->shared);
+    free(names->touched);
+    pthread_mutex_destroy(&names->lock);
+    free(names);
+}
+
+// make the per-slot arrays big enough for 'slots' slots
+int nameReserve(struct NameIndex *names, uint32_t slots) {
+    if (slots <= names->capacity) return 1;
+    uint32_t capacity = names->capacity == 0 ? 1024 : names->capacity;
+    while (capacity < slots) capacity *= 2;
+
+    uint8_t *sizes = realloc(names->sizes, capacity);
+    if (sizes != NULL) names->sizes = sizes;
+    uint8_t *shared = realloc(names->shared, capacity);
+    if (shared != NULL) names->shared = shared;
+    uint32_t *touched = realloc(names->touched, (size_t)capacity * sizeof(uint32_t));
+    if (touched != NULL) names->touched = touched;
+    if (sizes == NULL || shared == NULL || touched == NULL) return 0;
+
+    memset(names->sizes + names->capacity, 0, capacity - names->capacity);
+    memset(names->shared + names->capacity, 0, capacity - names->capacity);
+    names->capacity = capacity;
+    return 1;
+}
+
+// put 'slot' in the list of every trigram of 'name'. returns 0 if memory ran out, the index is then only
+// fit to be rebuilt
+int nameAdd(struct NameIndex *names, uint32_t slot, const char *name) {
+    uint16_t trigrams[NAME_MAX_TRIGRAMS];
+    int count = nameTrigrams(name, trigrams);
+    if (!nameReserve(names, slot + 1)) return 0;
+
+    for (int i = 0; i < count; i++) {
+        struct NameList *list = &names->lists[trigrams[i]];
+        // slots are mostly added in ascending order, a reused slot goes in its place
+        uint32_t at = list->count > 0 && list->slots[list->count - 1] >= slot ? nameLowerBound(list, slot)
+                                                                               : list->count;
+        if (at < list->count && list->slots[at] == slot) continue;
+        if (list->count == list->capacity) {
+            uint32_t capacity = list->capacity == 0 ? 8 : list->capacity * 2;
+            uint32_t *grown = realloc(list->slots, (size_t)capacity * sizeof(uint32_t));
+            if (grown == NULL) return 0;
+            list->slots = grown;
+            list->capacity = capacity;
+        }
+        memmove(&list->slots[at + 1], &list->slots[at], (size_t)(list->count - at) * sizeof(uint32_t));
+        list->slots[at] = slot;
+        list->count++;
+        names->entries++;
+    }
+    names->sizes[slot] = (uint8_t)count;
+    return 1;
+}
+
+// copy the account in 'slot' if it is live, 0 if it isn't (or a writer never finished with it)
+int nameReadSlot(struct Bank *bank, uint32_t slot, struct Account *out) {
+    for (int attempt = 0; attempt < NAME_READ_RETRIES; attempt++) {
+        int result = storeReadOptimistic(bank, (int)slot, out, NULL);
+        if (result >= 0) {
+            out->name[sizeof(out->name) - 1] = '\0';
+            return result;
+        }
+    }
+    return 0;
+}
+
+// index the live accounts in store slots [from, to), returns how many there were or -1 if memory ran out
+int64_t nameScan(struct Bank *bank, uint32_t from, uint32_t to) {
+    struct NameIndex *names = bank->names;
+    int64_t found = 0;
+    for (uint32_t slot = from; slot < to; slot++) {
+        struct Account account;
+        if (!nameReadSlot(bank, slot, &account)) continue;
+        found++;
+        // an account this handle created there has already been added
+        if (slot < names->capacity && names->sizes[slot] != 0) continue;
+        if (!nameAdd(names, slot, account.name)) return -1;
+    }
+    return found;
+}
+
+// index every live account of the store from scratch, 'cursor' and 'used' are the store's at the start
+int nameRebuild(struct Bank *bank, uint32_t cursor, uint32_t used) {
+    struct NameIndex *names = bank->names;
+    if (names->lists == NULL) {
+        names->lists = calloc(NAME_TRIGRAMS, sizeof(struct NameList));
+        if (names->lists == NULL) return 0;
+    }
+    for (uint32_t i = 0; i < NAME_TRIGRAMS; i++) names->lists[i].count = 0;
+    if (names->capacity > 0) memset(names->sizes, 0, names->capacity);
+    names->entries = 0;
+    names->dead = 0;
+    names->reused = 0;
+
+    names->built = nameReserve(names, used) && nameScan(bank, 0, used) >= 0;
+    names->cursor = cursor;
+    names->used = used;
+    if (!names->built) nameFreeLists(names);
+    return names->built;
+}
+
+// bring the index up to date with the store, called with the index's lock held
+int nameCatchUp(struct Bank *bank, uint32_t cursor, uint32_t used) {
+    struct NameIndex *names = bank->names;
+    // removed names fill half the lists, or other processes deleted a good share of the accounts
+    if (!names->built || names->dead * 2 > names->entries || cursor < names->cursor || used < names->used ||
+        names->entries > 64 * ((uint64_t)__atomic_load_n(&bank->store.header->count, __ATOMIC_RELAXED) + 1024)) {
+        return nameRebuild(bank, cursor, used);
+    }
+    if (cursor == names->cursor && used == names->used) return 1;
+
+    // every account number handed out since went into one of the new slots, unless this handle knows of it
+    int64_t found = nameScan(bank, names->used, used);
+    if (found < 0 || (uint64_t)found + names->reused < (uint64_t)(cursor - names->cursor)) {
+        return nameRebuild(bank, cursor, used);
+    }
+    names->cursor = cursor;
+    names->used = used;
+    names->reused = 0;
+    return 1;
+}
+
+// add an account this handle just put in 'slot', called with the structure lock held. slots at or past
+// 'used' are left to the next search, which reads them anyway
+void nameInsert(struct Bank *bank, int slot, const struct Account *account) {
+    struct NameIndex *names = bank->names;
+    if (names == NULL) return;
+    pthread_mutex_lock(&names->lock);
+    if (names->built && (uint32_t)slot < names->used) {
+        if (nameAdd(names, (uint32_t)slot, account->name)) {
+            names->reused++;
+        } else {
+            names->built = 0;
+        }
+    }
+    pthread_mutex_unlock(&names->lock);
+}
+
+// forget the name of an account this handle deleted from 'slot'. its list entries stay until the next rebuild
+void nameRemove(struct Bank *bank, int slot) {
+    struct NameIndex *names = bank->names;
+    if (names == NULL) return;
+    pthread_mutex_lock(&names->lock);
+    if (names->built && (uint32_t)slot < names->capacity) {
+        names->dead += names->sizes[slot];
+        names->sizes[slot] = 0;
+    }
+    pthread_mutex_unlock(&names->lock);
+}
+
+// --- searching ---
+// a scored slot, best first in the arrays below
+struct NameCandidate {
+    uint32_t slot; // store slot, or where bankSearchNames() copied the account
+    int score;
+    uint32_t key; // accountKey(), orders equal scores
+};
+
+// keep the 'max' best candidates in 'best' (sorted, '*count' of them so far)
+void nameKeep(struct NameCandidate *best, int *count, int max, struct NameCandidate candidate) {
+    int at = *count;
+    while (at > 0 && (best[at - 1].score < candidate.score ||
+                      (best[at - 1].score == candidate.score && best[at - 1].key > candidate.key))) {
+        at--;
+    }
+    if (at >= max) return;
+    int last = *count < max ? *count : max - 1;
+    memmove(&best[at + 1], &best[at], (size_t)(last - at) * sizeof(best[0]));
+    best[at] = candidate;
+    if (*count < max) (*count)++;
+}
+
+// count the trigrams each indexed name shares with the query and keep the 'max' best estimates. called with
+// the index's lock held, every 'shared' is back at 0 when it returns
+int nameCount(struct NameIndex *names, const uint16_t *trigrams, int count, struct NameCandidate *best, int max) {
+    // rarest lists first: a name first met in list i shares at most count - i trigrams, so once that is below
+    // the threshold the remaining (longest) lists only add to the names already met
+    int order[NAME_MAX_TRIGRAMS];
+    for (int i = 0; i < count; i++) {
+        int at = i;
+        while (at > 0 && names->lists[trigrams[order[at - 1]]].count > names->lists[trigrams[i]].count) {
+            order[at] = order[at - 1];
+            at--;
+        }
+        order[at] = i;
+    }
+
+    int threshold = (count + 1) / 2;
+    uint32_t touched = 0;
+    for (int i = 0; i < count; i++) {
+        const struct NameList *list = &names->lists[trigrams[order[i]]];
+        if (count - i >= threshold) {
+            for (uint32_t j = 0; j < list->count; j++) {
+                uint32_t slot = list->slots[j];
+                if (names->sizes[slot] == 0) continue;
+                if (names->shared[slot]++ == 0) names->touched[touched++] = slot;
+            }
+        } else if ((uint64_t)touched * 32 < list->count) {
+            // few names left in the running, look each one up instead of reading the whole list
+            for (uint32_t j = 0; j < touched; j++) {
+                uint32_t slot = names->touched[j];
+                uint32_t at = nameLowerBound(list, slot);
+                if (at < list->count && list->slots[at] == slot) names->shared[slot]++;
+            }
+        } else {
+            for (uint32_t j = 0; j < list->count; j++) {
+                if (names->shared[list->slots[j]] != 0) names->shared[list->slots[j]]++;
+            }
+        }
+    }
+
+    int kept = 0;
+    for (uint32_t j = 0; j < touched; j++) {
+        uint32_t slot = names->touched[j];
+        if (names->shared[slot] >= threshold) {
+            struct NameCandidate candidate = { slot, nameScore(names->shared[slot], count, names->sizes[slot]), slot };
+            nameKeep(best, &kept, max, candidate);
+        }
+        names->shared[slot] = 0;
+    }
+    return kept;
+}
+
+enum BankError bankSearchNames(struct Bank *bank, const char *query, struct BankNameMatch *out, int max,
+                               int *found) {
+    *found = 0;
+    if (max > BANK_SEARCH_MAX) max = BANK_SEARCH_MAX;
+    if (bank->remoteFd >= 0) return clientSearchNames(bank, query, out, max, found);
+    if (bank->names == NULL) return BANK_IO_ERROR;
+
+    uint16_t trigrams[NAME_MAX_TRIGRAMS];
+    int count = nameTrigrams(query, trigrams);
+    if (count == 0 || max <= 0) return BANK_OK;
+    qsort(trigrams, (size_t)count, sizeof(uint16_t), compareTrigrams);
+
+    // the allocator position and the slots in use, as of a moment when no account is halfway created
+    lockStructure(bank);
+    uint32_t cursor = bank->store.header->allocCursor;
+    uint32_t used = bank->store.header->used;
+    unlockStructure(bank);
+
+    // more candidates than asked for, the estimates of reused slots can be off until they are checked
+    struct NameCandidate estimates[2 * BANK_SEARCH_MAX + 8];
+    int estimated = 0;
+    pthread_mutex_lock(&bank->names->lock);
+    int ok = storeRefresh(bank) && nameCatchUp(bank, cursor, used);
+    if (ok) estimated = nameCount(bank->names, trigrams, count, estimates, 2 * max + 8);
+    pthread_mutex_unlock(&bank->names->lock);
+    if (!ok) return BANK_IO_ERROR;
+
+    // score the candidates again on the names in the store, the index may be behind them
+    struct NameCandidate best[BANK_SEARCH_MAX];
+    struct Account accounts[2 * BANK_SEARCH_MAX + 8];
+    int kept = 0;
+    for (int i = 0; i < estimated; i++) {
+        struct Account *account = &accounts[i];
+        uint16_t name[NAME_MAX_TRIGRAMS];
+        uint32_t key;
+        if (!nameReadSlot(bank, estimates[i].slot, account) || !accountKey(account->accountNumber, &key)) continue;
+        int size = nameTrigrams(account->name, name);
+        int shared = nameShared(trigrams, count, name, size);
+        if (shared < (count + 1) / 2) continue;
+        struct NameCandidate candidate = { (uint32_t)i, nameScore(shared, count, size), key };
+        nameKeep(best, &kept, max, candidate);
+    }
+
+    for (int i = 0; i < kept; i++) {
+        const struct Account *account = &accounts[best[i].slot];
+        snprintf(out[i].accountNumber, sizeof(out[i].accountNumber), "%s", account->accountNumber);
+        snprintf(out[i].name, sizeof(out[i].name), "%s", account->name);
+        out[i].score = best[i].score;
+    }
+    *found = kept;
+    return BANK_OK;
+}
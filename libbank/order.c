@@ -0,0 +1,510 @@
+// --- sorted account tree ---
+// a B+tree in order.dat from every live account's key (see accountKey()) to its store slot. nodes are
+// pages of ORDER_PAGE_SIZE bytes and a page holds up to 510 keys, so even millions of accounts are three
+// levels deep: a lookup, or the start of a range, reads one page per level, and a listing then follows the
+// leaves' links, whether or not the file fits in memory. the file is memory mapped at the start of a reserved
+// address range like the store, so growing it never moves it.
+// writers hold the structure lock and keep the header's seq odd while they change pages; readers walk the
+// tree without a lock and retry if a writer got in between. deleting only takes the key out of its leaf,
+// leaves are never merged: compaction rebuilds the tree packed instead
+#include "bank_internal.h"
+
+size_t orderFileSize(uint32_t pages) {
+    return (size_t)pages * ORDER_PAGE_SIZE;
+}
+
+struct OrderNode *orderPage(struct Bank *bank, uint32_t page) {
+    return (struct OrderNode *)((unsigned char *)bank->order.header + orderFileSize(page));
+}
+
+// map the first 'size' bytes of order.dat, replacing any smaller mapping at the same address
+int orderMap(struct Bank *bank, size_t size) {
+    if (bank->order.header == NULL) {
+        void *reserved = mmap(NULL, ORDER_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED) return 0;
+        bank->order.header = reserved;
+    }
+    if (size > ORDER_RESERVE ||
+        mmap(bank->order.header, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, bank->order.fd, 0) == MAP_FAILED) {
+        return 0;
+    }
+    __atomic_store_n(&bank->order.mapSize, size, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// make room for at least 'pages' pages, doubling the file. called with the structure lock held
+int orderReserve(struct Bank *bank, uint32_t pages) {
+    uint32_t newCapacity = bank->order.header->capacity;
+    if (pages <= newCapacity) return 1;
+    while (newCapacity < pages) newCapacity *= 2;
+
+    size_t size = orderFileSize(newCapacity);
+    if (ftruncate(bank->order.fd, (off_t)size) != 0) return 0;
+    pthread_mutex_lock(&bank->mapLock);
+    int ok = orderMap(bank, size);
+    pthread_mutex_unlock(&bank->mapLock);
+    if (ok) __atomic_store_n(&bank->order.header->capacity, newCapacity, __ATOMIC_RELEASE);
+    return ok;
+}
+
+// extend the mapping if another handle has grown the file, returns 0 if that failed
+int orderRefresh(struct Bank *bank) {
+    size_t size = orderFileSize(__atomic_load_n(&bank->order.header->capacity, __ATOMIC_ACQUIRE));
+    if (size <= __atomic_load_n(&bank->order.mapSize, __ATOMIC_ACQUIRE)) return 1;
+
+    pthread_mutex_lock(&bank->mapLock);
+    int ok = size <= bank->order.mapSize || orderMap(bank, size);
+    pthread_mutex_unlock(&bank->mapLock);
+    return ok;
+}
+
+// writers bracket every change to the pages with these. seq stays odd if a writer died halfway
+void orderBeginWrite(struct Bank *bank) {
+    __atomic_store_n(&bank->order.header->seq, bank->order.header->seq | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void orderEndWrite(struct Bank *bank) {
+    __atomic_store_n(&bank->order.header->seq, bank->order.header->seq + 1, __ATOMIC_RELEASE);
+}
+
+// position of the first key >= 'key' among the first 'count'
+uint32_t orderLowerBound(const uint32_t *keys, uint32_t count, uint32_t key) {
+    uint32_t low = 0, high = count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (keys[middle] < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// the child of an inner node whose keys 'key' belongs to: the one after every separator <= 'key'
+uint32_t orderChild(const struct OrderNode *node, uint32_t count, uint32_t key) {
+    uint32_t at = orderLowerBound(node->keys, count, key);
+    if (at < count && node->keys[at] == key) at++;
+    return at;
+}
+
+// a page number read from the tree, or 0 if it can't be one. a lock-free reader may see half-written pages,
+// so it checks every link before following it
+uint32_t orderCheckPage(struct Bank *bank, uint32_t page) {
+    size_t mapped = __atomic_load_n(&bank->order.mapSize, __ATOMIC_ACQUIRE);
+    return page > 0 && orderFileSize(page) < mapped ? page : 0;
+}
+
+// the leaf 'key' belongs in, 0 if the tree looks inconsistent. the pages on the way down go into 'path'
+// and the child taken in each into 'slots', if they are given
+uint32_t orderDescend(struct Bank *bank, uint32_t key, uint32_t *path, uint32_t *slots) {
+    struct OrderHeader *header = bank->order.header;
+    uint32_t height = __atomic_load_n(&header->height, __ATOMIC_RELAXED);
+    uint32_t page = orderCheckPage(bank, __atomic_load_n(&header->root, __ATOMIC_RELAXED));
+    if (height == 0 || height > ORDER_MAX_HEIGHT) return 0;
+    for (uint32_t level = 1; page != 0 && level < height; level++) {
+        const struct OrderNode *node = orderPage(bank, page);
+        uint32_t count = node->count < ORDER_NODE_KEYS ? node->count : ORDER_NODE_KEYS;
+        uint32_t child = orderChild(node, count, key);
+        if (path != NULL) path[level - 1] = page;
+        if (slots != NULL) slots[level - 1] = child;
+        page = orderCheckPage(bank, node->values[child]);
+    }
+    return page;
+}
+
+// copy up to 'max' keys >= 'from' into 'out', following the leaf links. returns how many, or -1 if the
+// tree looked inconsistent
+int orderCopy(struct Bank *bank, uint32_t from, uint32_t *out, uint32_t max) {
+    uint32_t page = orderDescend(bank, from, NULL, NULL);
+    if (page == 0) return -1;
+    const struct OrderNode *leaf = orderPage(bank, page);
+    uint32_t count = leaf->count < ORDER_NODE_KEYS ? leaf->count : ORDER_NODE_KEYS;
+    uint32_t at = orderLowerBound(leaf->keys, count, from);
+    uint32_t n = 0;
+    // a walk can't visit more leaves than there are pages, whatever the links say meanwhile
+    uint32_t hops = (uint32_t)(__atomic_load_n(&bank->order.mapSize, __ATOMIC_ACQUIRE) / ORDER_PAGE_SIZE);
+    while (n < max) {
+        if (at < count) {
+            out[n++] = leaf->keys[at++];
+            continue;
+        }
+        if (leaf->next == 0) break;
+        if (hops-- == 0 || (page = orderCheckPage(bank, leaf->next)) == 0) return -1;
+        leaf = orderPage(bank, page);
+        count = leaf->count < ORDER_NODE_KEYS ? leaf->count : ORDER_NODE_KEYS;
+        at = 0;
+    }
+    return (int)n;
+}
+
+int compareEntries(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// refill the tree from the live slots of the store, called with the structure lock held (or every lock).
+// the pages are written bottom up and packed to 90%, so the next inserts don't split every leaf at once
+int orderRebuild(struct Bank *bank) {
+    struct OrderHeader *header = bank->order.header;
+    uint32_t count = 0, fill = ORDER_NODE_KEYS * 9 / 10;
+    // (key, slot) pairs, sorted by key
+    uint32_t *entries = malloc(((size_t)bank->store.header->count + 1) * 2 * sizeof(uint32_t));
+    if (entries == NULL) return 0;
+    for (uint32_t i = 0; i < bank->store.header->used && count <= bank->store.header->count; i++) {
+        uint32_t key;
+        if (bank->store.slots[i].state == SLOT_USED && accountKey(bank->store.slots[i].account.accountNumber, &key)) {
+            entries[count * 2] = key;
+            entries[count * 2 + 1] = i;
+            count++;
+        }
+    }
+    qsort(entries, count, 2 * sizeof(uint32_t), compareEntries);
+
+    // one page per 'fill' keys at the bottom, one per fill + 1 children above that
+    uint32_t leaves = count == 0 ? 1 : (count + fill - 1) / fill, pages = 1 + leaves;
+    for (uint32_t nodes = leaves; nodes > 1;) {
+        nodes = (nodes + fill) / (fill + 1);
+        pages += nodes;
+    }
+    // each level's first key and page, to build the level above from
+    uint32_t *level = malloc((size_t)leaves * 2 * sizeof(uint32_t));
+    if (level == NULL || !orderReserve(bank, pages)) {
+        free(level);
+        free(entries);
+        return 0;
+    }
+
+    orderBeginWrite(bank);
+    uint32_t page = 1;
+    for (uint32_t i = 0; i < leaves; i++, page++) {
+        struct OrderNode *leaf = orderPage(bank, page);
+        uint32_t first = i * fill, n = count - first < fill ? count - first : fill;
+        leaf->leaf = 1;
+        leaf->count = (uint16_t)n;
+        leaf->next = i + 1 < leaves ? page + 1 : 0;
+        for (uint32_t k = 0; k < n; k++) {
+            leaf->keys[k] = entries[(first + k) * 2];
+            leaf->values[k] = entries[(first + k) * 2 + 1];
+        }
+        level[i * 2] = n > 0 ? leaf->keys[0] : 0;
+        level[i * 2 + 1] = page;
+    }
+    header->firstLeaf = 1;
+
+    uint32_t nodes = leaves, height = 1;
+    while (nodes > 1) {
+        uint32_t parents = 0;
+        for (uint32_t first = 0; first < nodes; first += fill + 1, page++) {
+            struct OrderNode *node = orderPage(bank, page);
+            uint32_t n = nodes - first < fill + 1 ? nodes - first : fill + 1;
+            node->leaf = 0;
+            node->count = (uint16_t)(n - 1);
+            node->next = 0;
+            for (uint32_t k = 0; k < n; k++) {
+                if (k > 0) node->keys[k - 1] = level[(first + k) * 2];
+                node->values[k] = level[(first + k) * 2 + 1];
+            }
+            // written over the level being read, but always behind it
+            level[parents * 2] = level[first * 2];
+            level[parents * 2 + 1] = page;
+            parents++;
+        }
+        nodes = parents;
+        height++;
+    }
+    header->root = level[1];
+    header->height = height;
+    header->pages = page;
+    header->count = count;
+    orderEndWrite(bank);
+    free(level);
+    free(entries);
+    return 1;
+}
+
+// open order.dat, rebuilding it from the store if it is new, damaged, out of date or was left mid-change
+int orderOpen(struct Bank *bank) {
+    char path[PATH_MAX];
+    bankPath(bank, ORDER_FILE, path);
+    bank->order.fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (bank->order.fd < 0 || fstat(bank->order.fd, &st) != 0) return 0;
+
+    if ((size_t)st.st_size >= ORDER_PAGE_SIZE && orderMap(bank, (size_t)st.st_size)) {
+        struct OrderHeader *header = bank->order.header;
+        if (header->magic == ORDER_MAGIC && header->version == ORDER_VERSION && header->pageSize == ORDER_PAGE_SIZE &&
+            orderFileSize(header->capacity) <= (size_t)st.st_size && header->pages <= header->capacity &&
+            !(header->seq & 1) && header->count == bank->store.header->count) {
+            return 1;
+        }
+    }
+
+    // start over in the same file, never shrinking it under another handle's mapping
+    size_t size = orderFileSize(ORDER_INITIAL_PAGES);
+    if ((size_t)st.st_size > size) size = (size_t)st.st_size;
+    if (ftruncate(bank->order.fd, (off_t)size) != 0 || !orderMap(bank, size)) return 0;
+    struct OrderHeader *header = bank->order.header;
+    header->magic = ORDER_MAGIC;
+    header->version = ORDER_VERSION;
+    header->pageSize = ORDER_PAGE_SIZE;
+    header->capacity = (uint32_t)(size / ORDER_PAGE_SIZE);
+    return orderRebuild(bank);
+}
+
+void orderClose(struct Bank *bank) {
+    if (bank->order.header != NULL) {
+        if (bank->order.mapSize > 0) msync(bank->order.header, bank->order.mapSize, MS_SYNC);
+        munmap(bank->order.header, ORDER_RESERVE);
+    }
+    if (bank->order.fd >= 0) close(bank->order.fd);
+    bank->order.fd = -1;
+    bank->order.header = NULL;
+    bank->order.mapSize = 0;
+}
+
+// put 'key' and 'value' at position 'at' of a node's first 'count' keys. values are shifted from 'at' in a
+// leaf and from at + 1 in an inner node, where 'value' is the child right of 'key'
+void orderShiftIn(struct OrderNode *node, uint32_t count, uint32_t at, uint32_t key, uint32_t value) {
+    uint32_t valueAt = node->leaf ? at : at + 1, values = node->leaf ? count : count + 1;
+    memmove(&node->keys[at + 1], &node->keys[at], (size_t)(count - at) * sizeof(uint32_t));
+    memmove(&node->values[valueAt + 1], &node->values[valueAt], (size_t)(values - valueAt) * sizeof(uint32_t));
+    node->keys[at] = key;
+    node->values[valueAt] = value;
+    node->count = (uint16_t)(count + 1);
+}
+
+// add an account number and its slot, called with the structure lock held once the account is in the store.
+// a number that is in the tree already just gets the new slot
+int orderInsert(struct Bank *bank, const char *accountNumber, int slot) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key) || slot < 0) return 0;
+    struct OrderHeader *header = bank->order.header;
+    // a writer died halfway through a change, the store has the whole truth
+    if (header->seq & 1) return orderRebuild(bank);
+    // a split on every level and a new root at most
+    if (!orderReserve(bank, header->pages + header->height + 1)) return 0;
+
+    uint32_t path[ORDER_MAX_HEIGHT], slots[ORDER_MAX_HEIGHT];
+    uint32_t page = orderDescend(bank, key, path, slots);
+    if (page == 0) return orderRebuild(bank);
+    struct OrderNode *leaf = orderPage(bank, page);
+    uint32_t at = orderLowerBound(leaf->keys, leaf->count, key);
+
+    orderBeginWrite(bank);
+    if (at < leaf->count && leaf->keys[at] == key) {
+        leaf->values[at] = (uint32_t)slot;
+        orderEndWrite(bank);
+        return 1;
+    }
+
+    // insert into the leaf, and while a node is full split it and push its middle key into the parent
+    struct OrderNode *node = leaf;
+    uint32_t level = header->height, value = (uint32_t)slot;
+    for (;;) {
+        if (node->count < ORDER_NODE_KEYS) {
+            orderShiftIn(node, node->count, at, key, value);
+            break;
+        }
+
+        uint32_t rightPage = header->pages++;
+        struct OrderNode *right = orderPage(bank, rightPage);
+        uint32_t half = ORDER_NODE_KEYS / 2;
+        right->leaf = node->leaf;
+        if (node->leaf) {
+            // the upper half moves to a new leaf that comes next in the chain, its first key separates them
+            right->count = (uint16_t)(ORDER_NODE_KEYS - half);
+            memcpy(right->keys, &node->keys[half], right->count * sizeof(uint32_t));
+            memcpy(right->values, &node->values[half], right->count * sizeof(uint32_t));
+            right->next = node->next;
+            node->next = rightPage;
+            node->count = (uint16_t)half;
+            if (at <= half) {
+                orderShiftIn(node, half, at, key, value);
+            } else {
+                orderShiftIn(right, right->count, at - half, key, value);
+            }
+            key = right->keys[0];
+        } else {
+            // the key in the middle moves up, the keys after it and their children move right
+            uint32_t up = node->keys[half];
+            right->count = (uint16_t)(ORDER_NODE_KEYS - half - 1);
+            right->next = 0;
+            memcpy(right->keys, &node->keys[half + 1], right->count * sizeof(uint32_t));
+            memcpy(right->values, &node->values[half + 1], (right->count + 1) * sizeof(uint32_t));
+            node->count = (uint16_t)half;
+            if (at <= half) {
+                orderShiftIn(node, half, at, key, value);
+            } else {
+                orderShiftIn(right, right->count, at - half - 1, key, value);
+            }
+            key = up;
+        }
+        value = rightPage;
+
+        if (--level == 0) {
+            // the root split, a new root goes on top
+            uint32_t rootPage = header->pages++;
+            struct OrderNode *root = orderPage(bank, rootPage);
+            root->leaf = 0;
+            root->count = 1;
+            root->next = 0;
+            root->keys[0] = key;
+            root->values[0] = header->root;
+            root->values[1] = rightPage;
+            header->root = rootPage;
+            header->height++;
+            break;
+        }
+        node = orderPage(bank, path[level - 1]);
+        at = slots[level - 1];
+    }
+    header->count++;
+    orderEndWrite(bank);
+    return 1;
+}
+
+// remove an account number, called with the structure lock held after the account left the store
+int orderRemove(struct Bank *bank, const char *accountNumber) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key)) return 0;
+    if (bank->order.header->seq & 1) return orderRebuild(bank);
+    uint32_t page = orderDescend(bank, key, NULL, NULL);
+    if (page == 0) return orderRebuild(bank);
+    struct OrderNode *leaf = orderPage(bank, page);
+    uint32_t count = leaf->count;
+    uint32_t at = orderLowerBound(leaf->keys, count, key);
+    if (at == count || leaf->keys[at] != key) return 1;
+
+    orderBeginWrite(bank);
+    memmove(&leaf->keys[at], &leaf->keys[at + 1], (size_t)(count - at - 1) * sizeof(uint32_t));
+    memmove(&leaf->values[at], &leaf->values[at + 1], (size_t)(count - at - 1) * sizeof(uint32_t));
+    leaf->count = (uint16_t)(count - 1);
+    bank->order.header->count--;
+    orderEndWrite(bank);
+    return 1;
+}
+
+// the store slot of an account number, -1 if it isn't in the tree or ORDER_BUSY if a writer got in the way.
+// takes no lock
+int orderFind(struct Bank *bank, const char *accountNumber) {
+    uint32_t key;
+    if (!accountKey(accountNumber, &key)) return -1;
+    struct OrderHeader *header = bank->order.header;
+    uint32_t seq = __atomic_load_n(&header->seq, __ATOMIC_ACQUIRE);
+    if ((seq & 1) || !orderRefresh(bank)) return ORDER_BUSY;
+
+    int slot = ORDER_BUSY;
+    uint32_t page = orderDescend(bank, key, NULL, NULL);
+    if (page != 0) {
+        const struct OrderNode *leaf = orderPage(bank, page);
+        uint32_t count = leaf->count < ORDER_NODE_KEYS ? leaf->count : ORDER_NODE_KEYS;
+        uint32_t at = orderLowerBound(leaf->keys, count, key);
+        slot = at < count && leaf->keys[at] == key ? (int)leaf->values[at] : -1;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&header->seq, __ATOMIC_RELAXED) == seq ? slot : ORDER_BUSY;
+}
+
+// copy up to 'max' keys >= 'from' into 'out', in order, returns how many. lock-free like findAccount(): the
+// copy is retried if a writer changed the tree meanwhile, and after a few collisions the structure lock is
+// taken instead. a writer that died mid-change leaves seq odd, the tree is rebuilt under the lock then
+uint32_t orderRead(struct Bank *bank, uint32_t from, uint32_t *out, uint32_t max) {
+    struct OrderHeader *header = bank->order.header;
+    for (int attempt = 0; attempt < 8; attempt++) {
+        uint32_t seq = __atomic_load_n(&header->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        if (!orderRefresh(bank)) break;
+        int n = orderCopy(bank, from, out, max);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (n >= 0 && __atomic_load_n(&header->seq, __ATOMIC_RELAXED) == seq) return (uint32_t)n;
+    }
+
+    lockStructure(bank);
+    orderRefresh(bank);
+    int n = ((header->seq & 1) && !orderRebuild(bank)) ? 0 : orderCopy(bank, from, out, max);
+    unlockStructure(bank);
+    return n < 0 ? 0 : (uint32_t)n;
+}
+
+// --- listing ---
+// the inclusive key range of every account number that starts with 'prefix' and has 'extra' more digits.
+// returns 0 if there is none
+int prefixRange(const char *prefix, int extra, uint64_t *low, uint64_t *high) {
+    uint64_t value = 0, scale = 1;
+    size_t length = strlen(prefix);
+    if (length + (size_t)extra > 9 || (length > 0 && prefix[0] == '0')) return 0;
+    for (size_t i = 0; i < length; i++) {
+        if (!isdigit((unsigned char)prefix[i])) return 0;
+        value = value * 10 + (uint64_t)(prefix[i] - '0');
+    }
+    for (int i = 0; i < extra; i++) scale *= 10;
+    *low = value * scale;
+    *high = (value + 1) * scale - 1;
+    if (length == 0) *low = scale / 10; // no leading zeros either
+    return 1;
+}
+
+// the bound an account number given in a query stands for, 0 if it isn't one
+int queryKey(const char *accountNumber, uint64_t *key) {
+    uint32_t value;
+    if (!accountKey(accountNumber, &value)) return 0;
+    *key = value;
+    return 1;
+}
+
+enum BankError listPage(struct Bank *bank, const struct BankListQuery *query,
+                        void (*visit)(const char *accountNumber, void *context), void *context, char *next) {
+    uint64_t low = INDEX_TOMBSTONE + 1, high = UINT32_MAX, bound;
+    if (query->from != NULL && query->from[0] != '\0') {
+        if (!queryKey(query->from, &bound)) return BANK_INVALID_ACCOUNT;
+        if (bound > low) low = bound;
+    }
+    if (query->after != NULL && query->after[0] != '\0') {
+        if (!queryKey(query->after, &bound)) return BANK_INVALID_ACCOUNT;
+        if (bound + 1 > low) low = bound + 1;
+    }
+    if (query->to != NULL && query->to[0] != '\0') {
+        if (!queryKey(query->to, &bound)) return BANK_INVALID_ACCOUNT;
+        if (bound < high) high = bound;
+    }
+    const char *prefix = query->prefix != NULL ? query->prefix : "";
+    if (next != NULL) next[0] = '\0';
+
+    // the numbers with a prefix are one key range per length (12, 120-129, 1200-1299, ...), in ascending order.
+    // without a prefix the ranges are just the numbers of each length
+    uint32_t keys[ORDER_READ_CHUNK];
+    int visited = 0;
+    uint32_t last = 0;
+    for (int extra = prefix[0] == '\0' ? 1 : 0; extra <= 9; extra++) {
+        uint64_t rangeLow, rangeHigh;
+        if (!prefixRange(prefix, extra, &rangeLow, &rangeHigh)) continue;
+        if (rangeLow < low) rangeLow = low;
+        if (rangeHigh > high) rangeHigh = high;
+
+        uint64_t from = rangeLow;
+        while (from <= rangeHigh) {
+            uint32_t n = orderRead(bank, (uint32_t)from, keys, ORDER_READ_CHUNK);
+            for (uint32_t i = 0; i < n; i++) {
+                if (keys[i] > rangeHigh) {
+                    n = 0;
+                    break;
+                }
+                if (query->limit > 0 && visited == query->limit) {
+                    // there is more, the last account visited is where the next page starts
+                    if (next != NULL) snprintf(next, 13, "%u", last);
+                    return BANK_OK;
+                }
+                char accountNumber[13];
+                snprintf(accountNumber, sizeof(accountNumber), "%u", keys[i]);
+                visit(accountNumber, context);
+                visited++;
+                last = keys[i];
+            }
+            if (n < ORDER_READ_CHUNK) break;
+            from = (uint64_t)keys[n - 1] + 1;
+        }
+    }
+    return BANK_OK;
+}
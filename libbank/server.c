@@ -0,0 +1,523 @@
+// --- server mode ---
+// bankServe() lets one process own the database and answer many local clients over a Unix-domain socket.
+// a poll() loop watches the listening socket and every idle connection, and reads requests without blocking
+// as their bytes arrive. once a request is complete, the connection is handed to a pool of worker threads,
+// which run it against the shared handle, answer it and give the connection back. a client has at most one
+// request in flight, so a connection is either being polled or owned by exactly one worker. the socket only
+// lets the owner of the server connect
+#include "bank_internal.h"
+#include <poll.h>
+
+#define SERVER_MAX_CLIENTS 1024
+#define SERVER_MAX_WORKERS 64
+#define SERVER_TIMEOUT_SECONDS 5 // a client that stalls halfway through a request or an answer is dropped
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS has no such flag, wireSocket() sets SO_NOSIGPIPE instead
+#endif
+
+union ServerRequest {
+    struct Account account;
+    struct WireAccountRequest target;
+    struct WireAmountRequest amount;
+    struct WireListRequest list;
+    struct WireCustomerRequest customer;
+    struct WireSearchRequest search;
+};
+
+// a client connection and the request being read from it
+struct ServerConnection {
+    int fd;
+    size_t received;                // bytes of the header and then the payload read so far
+    time_t started;                 // when the first of them arrived
+    struct WireHeader header;
+    union ServerRequest request;
+};
+
+struct Server {
+    struct Bank *bank;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    struct ServerConnection *ready[SERVER_MAX_CLIENTS];    // connections with a complete request, taken by the
+    size_t readyHead, readyCount;                          // workers in order
+    struct ServerConnection *returned[SERVER_MAX_CLIENTS]; // connections the workers are done with, for the poll
+                                                           // loop to watch again
+    size_t returnedCount;
+    size_t connections;               // open connections, wherever they are
+    int wake[2];                      // a worker writes to this pipe so poll() picks up returned connections
+    int stop;
+};
+
+// --- framing ---
+// a new Unix-domain stream socket (or an accepted one when 'fd' >= 0) that isn't inherited by child
+// processes and doesn't raise SIGPIPE when the other end is gone
+int wireSocket(int fd) {
+    if (fd < 0) fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    return fd;
+}
+
+int wireWrite(int fd, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    while (length > 0) {
+        ssize_t n = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        bytes += n;
+        length -= (size_t)n;
+    }
+    return 1;
+}
+
+int wireRead(int fd, void *data, size_t length) {
+    unsigned char *bytes = data;
+    while (length > 0) {
+        ssize_t n = recv(fd, bytes, length, 0);
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        bytes += n;
+        length -= (size_t)n;
+    }
+    return 1;
+}
+
+// send one message, header and payload in a single write. returns 0 if the connection is gone
+int wireSend(int fd, uint8_t op, uint8_t status, const void *payload, uint32_t length) {
+    unsigned char message[sizeof(struct WireHeader) + WIRE_MAX_PAYLOAD];
+    if (length > WIRE_MAX_PAYLOAD) return 0;
+
+    struct WireHeader header = { WIRE_MAGIC, op, status, 0, length };
+    memcpy(message, &header, sizeof(header));
+    if (length > 0) memcpy(message + sizeof(header), payload, length);
+    return wireWrite(fd, message, sizeof(header) + length);
+}
+
+// read one message whose payload fits in 'size' bytes. returns 0 if the connection is gone or the message
+// is malformed
+int wireReceive(int fd, struct WireHeader *header, void *payload, uint32_t size) {
+    if (!wireRead(fd, header, sizeof(*header)) || header->magic != WIRE_MAGIC || header->length > size) return 0;
+    return wireRead(fd, payload, header->length);
+}
+
+// --- requests ---
+// strings from the wire aren't trusted to be terminated
+void serverTerminate(char *text, size_t size) {
+    text[size - 1] = '\0';
+}
+
+void serverTerminateAccount(struct Account *account) {
+    serverTerminate(account->name, sizeof(account->name));
+    serverTerminate(account->ID, sizeof(account->ID));
+    serverTerminate(account->accountNumber, sizeof(account->accountNumber));
+    serverTerminate(account->type, sizeof(account->type));
+    serverTerminate(account->pin, sizeof(account->pin));
+}
+
+// WIRE_LIST and WIRE_CUSTOMER stream the account numbers in batches of WIRE_LIST_BATCH
+struct ServerList {
+    int fd;
+    uint8_t op;
+    int ok;
+    uint32_t count;
+    char numbers[WIRE_LIST_BATCH][13];
+};
+
+void serverListAccount(const char *accountNumber, void *context) {
+    struct ServerList *list = context;
+    if (!list->ok) return;
+    snprintf(list->numbers[list->count], sizeof(list->numbers[0]), "%s", accountNumber);
+    if (++list->count == WIRE_LIST_BATCH) {
+        list->ok = wireSend(list->fd, list->op, BANK_OK, list->numbers, list->count * sizeof(list->numbers[0]));
+        list->count = 0;
+    }
+}
+
+// WIRE_LIST_PAGE collects one page into the response
+void serverListPageAccount(const char *accountNumber, void *context) {
+    struct WireListResponse *page = context;
+    snprintf(page->numbers[page->count], sizeof(page->numbers[0]), "%s", accountNumber);
+    page->count++;
+}
+
+// payload size of each request, -1 for an unknown op
+int serverRequestSize(uint8_t op) {
+    switch (op) {
+    case WIRE_COUNT:
+    case WIRE_LIST: return 0;
+    case WIRE_LOOKUP:
+    case WIRE_DELETE: return sizeof(struct WireAccountRequest);
+    case WIRE_CREATE: return sizeof(struct Account);
+    case WIRE_DEPOSIT:
+    case WIRE_WITHDRAW:
+    case WIRE_TRANSFER: return sizeof(struct WireAmountRequest);
+    case WIRE_LIST_PAGE: return sizeof(struct WireListRequest);
+    case WIRE_CUSTOMER: return sizeof(struct WireCustomerRequest);
+    case WIRE_SEARCH: return sizeof(struct WireSearchRequest);
+    }
+    return -1;
+}
+
+// read whatever has arrived of the next request on 'connection' without blocking. returns 1 once the request
+// is complete, 0 if more is to come and -1 if the connection should be closed
+int serverReceive(struct ServerConnection *connection) {
+    for (;;) {
+        unsigned char *into;
+        size_t wanted;
+        if (connection->received < sizeof(connection->header)) {
+            into = (unsigned char *)&connection->header + connection->received;
+            wanted = sizeof(connection->header) - connection->received;
+        } else {
+            size_t payload = connection->received - sizeof(connection->header);
+            if (payload == connection->header.length) return 1;
+            into = (unsigned char *)&connection->request + payload;
+            wanted = connection->header.length - payload;
+        }
+
+        ssize_t n = recv(connection->fd, into, wanted, MSG_DONTWAIT);
+        if (n == 0) return -1;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        if (connection->received == 0) connection->started = time(NULL);
+        connection->received += (size_t)n;
+        // a header is checked as soon as it is complete, so the payload always fits
+        if (connection->received == sizeof(connection->header) &&
+            (connection->header.magic != WIRE_MAGIC ||
+             (int)connection->header.length != serverRequestSize(connection->header.op))) {
+            return -1;
+        }
+    }
+}
+
+// answer the request read from 'connection', returns 0 if the connection should be closed
+int serverHandle(struct Bank *bank, struct ServerConnection *connection) {
+    int fd = connection->fd;
+    struct WireHeader header = connection->header;
+    union ServerRequest *request = &connection->request;
+    enum BankError error;
+    switch (header.op) {
+    case WIRE_COUNT: {
+        uint32_t count = (uint32_t)bankCount(bank);
+        return wireSend(fd, header.op, BANK_OK, &count, sizeof(count));
+    }
+    case WIRE_LOOKUP: {
+        struct Account account;
+        serverTerminate(request->target.accountNumber, sizeof(request->target.accountNumber));
+        error = bankLookup(bank, request->target.accountNumber, &account);
+        return wireSend(fd, header.op, error, &account, error == BANK_OK ? sizeof(account) : 0);
+    }
+    case WIRE_LIST:
+    case WIRE_CUSTOMER: {
+        struct ServerList *list = malloc(sizeof(*list));
+        if (list == NULL) return wireSend(fd, header.op, BANK_IO_ERROR, NULL, 0);
+        list->fd = fd;
+        list->op = header.op;
+        list->ok = 1;
+        list->count = 0;
+        if (header.op == WIRE_LIST) {
+            error = bankListAccounts(bank, serverListAccount, list);
+        } else {
+            serverTerminate(request->customer.ID, sizeof(request->customer.ID));
+            error = bankCustomerAccounts(bank, request->customer.ID, serverListAccount, list);
+        }
+        int ok = list->ok;
+        if (ok && list->count > 0) {
+            ok = wireSend(fd, header.op, BANK_OK, list->numbers, list->count * sizeof(list->numbers[0]));
+        }
+        free(list);
+        // the empty message that ends the list carries the result
+        return ok && wireSend(fd, header.op, error, NULL, 0);
+    }
+    case WIRE_LIST_PAGE: {
+        struct WireListRequest *list = &request->list;
+        struct WireListResponse *page = calloc(1, sizeof(*page));
+        if (page == NULL) return wireSend(fd, header.op, BANK_IO_ERROR, NULL, 0);
+        serverTerminate(list->prefix, sizeof(list->prefix));
+        serverTerminate(list->from, sizeof(list->from));
+        serverTerminate(list->to, sizeof(list->to));
+        serverTerminate(list->after, sizeof(list->after));
+        struct BankListQuery query = { list->prefix, list->from, list->to, list->after, list->limit };
+        if (query.limit <= 0 || query.limit > WIRE_LIST_BATCH) query.limit = WIRE_LIST_BATCH;
+        error = bankListPage(bank, &query, serverListPageAccount, page, page->next);
+        int ok = wireSend(fd, header.op, error, page, error == BANK_OK ? sizeof(*page) : 0);
+        free(page);
+        return ok;
+    }
+    case WIRE_SEARCH: {
+        struct WireSearchResponse *response = calloc(1, sizeof(*response));
+        if (response == NULL) return wireSend(fd, header.op, BANK_IO_ERROR, NULL, 0);
+        serverTerminate(request->search.query, sizeof(request->search.query));
+        int found;
+        error = bankSearchNames(bank, request->search.query, response->matches, request->search.max, &found);
+        response->count = (uint32_t)found;
+        int ok = wireSend(fd, header.op, error, response, error == BANK_OK ? sizeof(*response) : 0);
+        free(response);
+        return ok;
+    }
+    case WIRE_CREATE:
+        serverTerminateAccount(&request->account);
+        error = bankCreate(bank, &request->account);
+        return wireSend(fd, header.op, error, &request->account, error == BANK_OK ? sizeof(request->account) : 0);
+    case WIRE_DELETE:
+        serverTerminate(request->target.accountNumber, sizeof(request->target.accountNumber));
+        return wireSend(fd, header.op, bankDelete(bank, request->target.accountNumber), NULL, 0);
+    case WIRE_DEPOSIT:
+    case WIRE_WITHDRAW:
+    case WIRE_TRANSFER: {
+        struct WireAmountRequest *amount = &request->amount;
+        struct WireAmountResponse response = { 0, 0 };
+        serverTerminate(amount->accountNumber, sizeof(amount->accountNumber));
+        serverTerminate(amount->toAccount, sizeof(amount->toAccount));
+        if (header.op == WIRE_DEPOSIT) {
+            error = bankDeposit(bank, amount->accountNumber, amount->amount, &response.balance);
+        } else if (header.op == WIRE_WITHDRAW) {
+            error = bankWithdraw(bank, amount->accountNumber, amount->amount, &response.balance);
+        } else {
+            error = bankTransfer(bank, amount->accountNumber, amount->toAccount, amount->amount, &response.feeBps,
+                                 &response.balance);
+        }
+        return wireSend(fd, header.op, error, &response, error == BANK_OK ? sizeof(response) : 0);
+    }
+    }
+    return 0;
+}
+
+// --- workers ---
+void serverWake(struct Server *server) {
+    char byte = 0;
+    // a full pipe means the poll loop is already due to wake up
+    while (write(server->wake[1], &byte, 1) < 0 && errno == EINTR);
+}
+
+// close a connection and forget it. while the workers run, the caller holds the lock
+void serverDrop(struct Server *server, struct ServerConnection *connection) {
+    close(connection->fd);
+    free(connection);
+    server->connections--;
+}
+
+void *serverWorker(void *arg) {
+    struct Server *server = arg;
+    for (;;) {
+        pthread_mutex_lock(&server->lock);
+        while (server->readyCount == 0 && !server->stop) {
+            pthread_cond_wait(&server->changed, &server->lock);
+        }
+        // requests that already arrived are still answered when the server stops
+        if (server->readyCount == 0) {
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+        struct ServerConnection *connection = server->ready[server->readyHead];
+        server->readyHead = (server->readyHead + 1) % SERVER_MAX_CLIENTS;
+        server->readyCount--;
+        pthread_mutex_unlock(&server->lock);
+
+        int keep = serverHandle(server->bank, connection);
+        connection->received = 0;
+
+        pthread_mutex_lock(&server->lock);
+        if (keep) {
+            server->returned[server->returnedCount++] = connection;
+        } else {
+            serverDrop(server, connection);
+        }
+        pthread_mutex_unlock(&server->lock);
+        if (keep) serverWake(server);
+    }
+    return NULL;
+}
+
+// --- poll loop ---
+// create the listening socket, returns -1 if it can't be set up or another server answers on it
+int serverListen(const char *socketPath) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) return -1;
+    strcpy(address.sun_path, socketPath);
+
+    // a socket file nobody answers on was left behind by a server that didn't shut down cleanly
+    int probe = wireSocket(-1);
+    if (probe < 0) return -1;
+    int served = connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+    close(probe);
+    if (served) return -1;
+    unlink(socketPath);
+
+    // connecting needs write permission on the socket file, so only the owner gets in. nobody can connect
+    // before listen(), which leaves no window with the default permissions
+    int listener = wireSocket(-1);
+    if (listener < 0) return -1;
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(listener);
+        return -1;
+    }
+    if (chmod(socketPath, S_IRUSR | S_IWUSR) != 0 || listen(listener, 128) != 0) {
+        close(listener);
+        unlink(socketPath);
+        return -1;
+    }
+    return listener;
+}
+
+enum BankError bankServe(struct Bank *bank, const char *socketPath, int workers, const volatile sig_atomic_t *stop) {
+    if (bank->remoteFd >= 0) return BANK_NOT_SUPPORTED;
+    if (workers <= 0) workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    if (workers > SERVER_MAX_WORKERS) workers = SERVER_MAX_WORKERS;
+
+    // requests from many clients are in flight at once, balance changes go through the shards
+    enum BankError error = bankStartEngine(bank, workers);
+    if (error != BANK_OK) return error;
+
+    struct Server *server = calloc(1, sizeof(struct Server));
+    if (server == NULL) return BANK_IO_ERROR;
+    server->bank = bank;
+    int listener = serverListen(socketPath);
+    if (listener < 0 || pipe(server->wake) != 0) {
+        if (listener >= 0) {
+            close(listener);
+            unlink(socketPath);
+        }
+        free(server);
+        return BANK_IO_ERROR;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(server->wake[i], F_SETFD, FD_CLOEXEC);
+        fcntl(server->wake[i], F_SETFL, O_NONBLOCK);
+    }
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->changed, NULL);
+
+    // the workers block every signal, so the caller's handlers run on this thread and interrupt poll()
+    pthread_t threads[SERVER_MAX_WORKERS];
+    int started = 0;
+    sigset_t blocked, previous;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    while (started < workers && pthread_create(&threads[started], NULL, serverWorker, server) == 0) started++;
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (started == 0) error = BANK_IO_ERROR;
+
+    // entry 0 is the listening socket, 1 the wake-up pipe, the rest are the idle connections in 'idle'
+    struct pollfd *fds = malloc((2 + SERVER_MAX_CLIENTS) * sizeof(struct pollfd));
+    struct ServerConnection **idle = malloc(SERVER_MAX_CLIENTS * sizeof(struct ServerConnection *));
+    if (fds == NULL || idle == NULL) error = BANK_IO_ERROR;
+    size_t clients = 0;
+    if (fds != NULL && idle != NULL) {
+        fds[0] = (struct pollfd){ listener, POLLIN, 0 };
+        fds[1] = (struct pollfd){ server->wake[0], POLLIN, 0 };
+    }
+    while (error == BANK_OK && !*stop) {
+        // the timeout is a fallback in case a stop signal lands just before poll() starts
+        if (poll(fds, 2 + clients, 500) < 0) {
+            if (errno == EINTR) continue;
+            error = BANK_IO_ERROR;
+            break;
+        }
+
+        // read what arrived, connections with a complete request go to the workers. a client that stopped
+        // halfway through one is dropped. walking backwards lets the last entry fill the hole
+        time_t now = time(NULL);
+        for (size_t i = clients; i-- > 0;) {
+            short events = fds[2 + i].revents;
+            struct ServerConnection *connection = idle[i];
+            int state;
+            if (events & POLLIN) {
+                state = serverReceive(connection);
+            } else if (events != 0) {
+                state = -1;
+            } else {
+                state = connection->received > 0 && now - connection->started >= SERVER_TIMEOUT_SECONDS ? -1 : 0;
+            }
+            if (state == 0) continue;
+            fds[2 + i] = fds[2 + clients - 1];
+            idle[i] = idle[clients - 1];
+            clients--;
+
+            pthread_mutex_lock(&server->lock);
+            if (state > 0) {
+                server->ready[(server->readyHead + server->readyCount) % SERVER_MAX_CLIENTS] = connection;
+                server->readyCount++;
+                pthread_cond_signal(&server->changed);
+            } else {
+                serverDrop(server, connection);
+            }
+            pthread_mutex_unlock(&server->lock);
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(server->wake[0], drain, sizeof(drain)) > 0);
+            pthread_mutex_lock(&server->lock);
+            for (size_t i = 0; i < server->returnedCount; i++) {
+                idle[clients] = server->returned[i];
+                fds[2 + clients++] = (struct pollfd){ server->returned[i]->fd, POLLIN, 0 };
+            }
+            server->returnedCount = 0;
+            pthread_mutex_unlock(&server->lock);
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = wireSocket(accept(listener, NULL, NULL));
+            struct ServerConnection *connection = fd >= 0 ? calloc(1, sizeof(struct ServerConnection)) : NULL;
+            if (connection != NULL) {
+                pthread_mutex_lock(&server->lock);
+                int full = server->connections == SERVER_MAX_CLIENTS;
+                if (!full) server->connections++;
+                pthread_mutex_unlock(&server->lock);
+                if (full) {
+                    close(fd);
+                    free(connection);
+                } else {
+                    // answers are written by the workers, which block until the client reads them
+                    struct timeval timeout = { SERVER_TIMEOUT_SECONDS, 0 };
+                    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                    connection->fd = fd;
+                    idle[clients] = connection;
+                    fds[2 + clients++] = (struct pollfd){ fd, POLLIN, 0 };
+                }
+            } else if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    // let the workers finish what is queued, then close every connection
+    pthread_mutex_lock(&server->lock);
+    server->stop = 1;
+    pthread_cond_broadcast(&server->changed);
+    pthread_mutex_unlock(&server->lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (size_t i = 0; i < clients; i++) {
+        serverDrop(server, idle[i]);
+    }
+    for (size_t i = 0; i < server->returnedCount; i++) {
+        serverDrop(server, server->returned[i]);
+    }
+
+    free(fds);
+    free(idle);
+    close(listener);
+    unlink(socketPath);
+    close(server->wake[0]);
+    close(server->wake[1]);
+    pthread_cond_destroy(&server->changed);
+    pthread_mutex_destroy(&server->lock);
+    free(server);
+    return error;
+}
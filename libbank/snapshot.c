@@ -0,0 +1,125 @@
+// --- snapshots and checkpoints ---
+// a snapshot (snapshot.dat) is a compact copy of every live account plus the journal LSN it
+// covers. taking one lets the journal be emptied, so the journal (and the replay at startup) only ever
+// holds recent activity. if accounts.dat is lost or damaged, the store is rebuilt from the memory-mapped
+// snapshot and only the journal records after it are replayed
+#include "bank_internal.h"
+
+#define SNAPSHOT_MAGIC 0x31504E53u // "SNP1"
+#define SNAPSHOT_VERSION 1
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t lsn;         // last journal record included in the snapshot
+    uint32_t count;       // number of accounts that follow the header
+    uint32_t recordSize;  // sizeof(struct Account)
+    uint32_t allocCursor; // allocator state, so restored stores keep handing out fresh numbers
+    uint32_t allocKey[2];
+    uint32_t reserved[5];
+};
+
+// write a snapshot of the store, then empty the journal. called with every lock held, returns 1 on success
+int checkpoint(struct Bank *bank) {
+    // everything committed so far must be in the store before it is copied
+    if (!journalFlush(bank, 1)) return 0;
+
+    char path[PATH_MAX], tempPath[PATH_MAX];
+    bankPath(bank, SNAPSHOT_FILE, path);
+    bankPath(bank, SNAPSHOT_TEMP_FILE, tempPath);
+    FILE *snapshot = fopen(tempPath, "wb");
+    if (!snapshot) return 0;
+
+    struct SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.lsn = bank->locks->nextLsn - 1;
+    header.count = bank->store.header->count;
+    header.recordSize = sizeof(struct Account);
+    header.allocCursor = bank->store.header->allocCursor;
+    header.allocKey[0] = bank->store.header->allocKey[0];
+    header.allocKey[1] = bank->store.header->allocKey[1];
+
+    int ok = fwrite(&header, sizeof(header), 1, snapshot) == 1;
+    for (uint32_t i = 0; ok && i < bank->store.header->used; i++) {
+        if (bank->store.slots[i].state == SLOT_USED) {
+            ok = fwrite(&bank->store.slots[i].account, sizeof(struct Account), 1, snapshot) == 1;
+        }
+    }
+    ok = fflush(snapshot) == 0 && fsync(fileno(snapshot)) == 0 && ok;
+    if (fclose(snapshot) != 0 || !ok || rename(tempPath, path) != 0) {
+        remove(tempPath);
+        return 0;
+    }
+
+    // the snapshot is in place, so the journal records it covers are no longer needed
+    journalSyncStore(bank);
+    if (ftruncate(bank->journal.fd, 0) != 0) return 0;
+    fsync(bank->journal.fd);
+    bank->locks->journalRecords = 0;
+    return 1;
+}
+
+// 1 once the journal has grown past SNAPSHOT_JOURNAL_RECORDS and no batch of this handle is open
+int needsCheckpoint(struct Bank *bank) {
+    return bank->journal.batchDepth == 0 &&
+           __atomic_load_n(&bank->locks->journalRecords, __ATOMIC_ACQUIRE) >= SNAPSHOT_JOURNAL_RECORDS;
+}
+
+// take a snapshot if the journal needs one. call with no locks held, between operations
+void maybeCheckpoint(struct Bank *bank) {
+    if (!needsCheckpoint(bank)) return;
+    lockAll(bank);
+    // another handle may have taken it while this one waited for the locks
+    if (needsCheckpoint(bank)) checkpoint(bank);
+    unlockAll(bank);
+}
+
+// rebuild accounts.dat from the latest snapshot when the store can't be opened. the damaged file is kept
+// as accounts.dat.damaged. the journal tail after the snapshot is replayed afterwards by journalOpen()
+int restoreFromSnapshot(struct Bank *bank) {
+    char path[PATH_MAX], storePath[PATH_MAX], damagedPath[PATH_MAX + 8], indexPath[PATH_MAX], orderPath[PATH_MAX];
+    bankPath(bank, SNAPSHOT_FILE, path);
+    bankPath(bank, STORE_FILE, storePath);
+    bankPath(bank, INDEX_FILE, indexPath);
+    bankPath(bank, ORDER_FILE, orderPath);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct SnapshotHeader)) {
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (base == MAP_FAILED) return 0;
+
+    const struct SnapshotHeader *header = base;
+    const struct Account *accounts = (const struct Account *)((const unsigned char *)base + sizeof(*header));
+    if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION ||
+        header->recordSize != sizeof(struct Account) ||
+        sizeof(*header) + (size_t)header->count * sizeof(struct Account) > (size_t)st.st_size) {
+        munmap(base, (size_t)st.st_size);
+        return 0;
+    }
+
+    // accounts land in different slots than before, so the hash index and the tree have to be rebuilt as well
+    sprintf(damagedPath, "%s.damaged", storePath);
+    rename(storePath, damagedPath);
+    remove(indexPath);
+    remove(orderPath);
+    int ok = storeOpen(bank);
+    for (uint32_t i = 0; ok && i < header->count; i++) {
+        ok = storeInsert(bank, &accounts[i]) >= 0;
+    }
+    if (ok) {
+        bank->store.header->checkpointLsn = header->lsn;
+        bank->store.header->allocCursor = header->allocCursor;
+        bank->store.header->allocKey[0] = header->allocKey[0];
+        bank->store.header->allocKey[1] = header->allocKey[1];
+    }
+    munmap(base, (size_t)st.st_size);
+    return ok;
+}
+
@@ -0,0 +1,253 @@
+// --- binary account store ---
+// all accounts live in a single file of fixed-size slots (accounts.dat) that is memory mapped,
+// so reading an account is a memory copy and a balance update only rewrites the balance field in place.
+// the mapping sits at the start of a reserved address range, so growing the file extends it in place and
+// threads reading a slot never see it move. every write to a slot makes its seq odd for the duration, so
+// readers can copy an account without taking its lock
+#include "bank_internal.h"
+
+size_t storeFileSize(uint32_t capacity) {
+    return sizeof(struct StoreHeader) + (size_t)capacity * sizeof(struct AccountSlot);
+}
+
+// map the first 'size' bytes of the store file and point header/slots into it. once the address range is
+// reserved, a bigger mapping replaces the old one at the same address
+int storeMap(struct Bank *bank, size_t size) {
+    if (bank->store.base == NULL) {
+        void *reserved = mmap(NULL, STORE_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED) return 0;
+        bank->store.base = reserved;
+    }
+    if (size > STORE_RESERVE ||
+        mmap(bank->store.base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, bank->store.fd, 0) == MAP_FAILED) {
+        return 0;
+    }
+
+    bank->store.header = (struct StoreHeader *)bank->store.base;
+    bank->store.slots = (struct AccountSlot *)(bank->store.base + sizeof(struct StoreHeader));
+    __atomic_store_n(&bank->store.mapSize, size, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// drop the mapping and the reserved range with it
+void storeUnmap(struct Bank *bank) {
+    if (bank->store.base != NULL) munmap(bank->store.base, STORE_RESERVE);
+    bank->store.base = NULL;
+    bank->store.mapSize = 0;
+}
+
+// open (or create) the store file, returns 1 on success
+int storeOpen(struct Bank *bank) {
+    char path[PATH_MAX];
+    bankPath(bank, STORE_FILE, path);
+    bank->store.fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (bank->store.fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(bank->store.fd, &st) != 0) {
+        close(bank->store.fd);
+        bank->store.fd = -1;
+        return 0;
+    }
+
+    if (st.st_size == 0) {
+        // new store, size it and write a fresh header
+        size_t size = storeFileSize(STORE_INITIAL_CAPACITY);
+        if (ftruncate(bank->store.fd, (off_t)size) != 0 || !storeMap(bank, size)) {
+            storeUnmap(bank);
+            close(bank->store.fd);
+            bank->store.fd = -1;
+            return 0;
+        }
+        bank->store.header->magic = STORE_MAGIC;
+        bank->store.header->version = STORE_VERSION;
+        bank->store.header->slotSize = sizeof(struct AccountSlot);
+        bank->store.header->capacity = STORE_INITIAL_CAPACITY;
+        bank->store.header->used = 0;
+        bank->store.header->count = 0;
+        bank->store.header->freeHead = STORE_NO_SLOT;
+        return 1;
+    }
+
+    if ((size_t)st.st_size < sizeof(struct StoreHeader) || !storeMap(bank, (size_t)st.st_size)) {
+        storeUnmap(bank);
+        close(bank->store.fd);
+        bank->store.fd = -1;
+        return 0;
+    }
+
+    // reject files written with a different layout
+    if (bank->store.header->magic != STORE_MAGIC || bank->store.header->version != STORE_VERSION ||
+        bank->store.header->slotSize != sizeof(struct AccountSlot) ||
+        storeFileSize(bank->store.header->capacity) > bank->store.mapSize) {
+        storeUnmap(bank);
+        close(bank->store.fd);
+        bank->store.fd = -1;
+        return 0;
+    }
+    return 1;
+}
+
+void storeClose(struct Bank *bank) {
+    if (bank->store.fd < 0) return;
+    msync(bank->store.base, bank->store.mapSize, MS_SYNC);
+    storeUnmap(bank);
+    close(bank->store.fd);
+    bank->store.fd = -1;
+}
+
+// double the number of slots in the file and remap it. called with the structure lock held
+int storeGrow(struct Bank *bank) {
+    uint32_t newCapacity = bank->store.header->capacity * 2;
+    size_t newSize = storeFileSize(newCapacity);
+
+    if (ftruncate(bank->store.fd, (off_t)newSize) != 0) return 0;
+    pthread_mutex_lock(&bank->mapLock);
+    int ok = storeMap(bank, newSize);
+    pthread_mutex_unlock(&bank->mapLock);
+    if (!ok) return 0;
+
+    bank->store.header->capacity = newCapacity;
+    return 1;
+}
+
+// extend the mapping if another handle has grown the file, returns 0 if that failed
+int storeRefresh(struct Bank *bank) {
+    size_t size = storeFileSize(__atomic_load_n(&bank->store.header->capacity, __ATOMIC_ACQUIRE));
+    if (size <= __atomic_load_n(&bank->store.mapSize, __ATOMIC_ACQUIRE)) return 1;
+
+    pthread_mutex_lock(&bank->mapLock);
+    int ok = size <= bank->store.mapSize || storeMap(bank, size);
+    pthread_mutex_unlock(&bank->mapLock);
+    return ok;
+}
+
+// a slot that is in use by some handle, or NULL. its account may be newer than this handle's mapping
+struct AccountSlot *storeSlot(struct Bank *bank, int slot) {
+    if (slot < 0 || (uint32_t)slot >= __atomic_load_n(&bank->store.header->used, __ATOMIC_ACQUIRE)) return NULL;
+    size_t end = sizeof(struct StoreHeader) + ((size_t)slot + 1) * sizeof(struct AccountSlot);
+    if (end > __atomic_load_n(&bank->store.mapSize, __ATOMIC_ACQUIRE) && (!storeRefresh(bank) || end > bank->store.mapSize)) {
+        return NULL;
+    }
+    return &bank->store.slots[slot];
+}
+
+// writers bracket every change to a slot with these, the caller holds the lock that covers the slot
+void slotBeginWrite(struct AccountSlot *slot) {
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void slotEndWrite(struct AccountSlot *slot) {
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+// copy the account in a slot into 'out', returns 1 on success. the caller holds the account's lock
+int storeRead(struct Bank *bank, int slot, struct Account *out) {
+    struct AccountSlot *entry = storeSlot(bank, slot);
+    if (entry == NULL || entry->state != SLOT_USED) return 0;
+    *out = entry->account;
+    return 1;
+}
+
+// copy an account without any lock: 1 on success, 0 if the slot holds no account, -1 if a writer got in the
+// way and the caller should try again. 'seq' (may be NULL) gets the slot's seq the copy was taken at
+int storeReadOptimistic(struct Bank *bank, int slot, struct Account *out, uint32_t *seq) {
+    struct AccountSlot *entry = storeSlot(bank, slot);
+    if (entry == NULL) return 0;
+
+    uint32_t before = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+    if (before & 1) return -1;
+    uint32_t state = entry->state;
+    struct Account account = entry->account;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != before) return -1;
+
+    if (state != SLOT_USED) return 0;
+    *out = account;
+    if (seq != NULL) *seq = before;
+    return 1;
+}
+
+// the current seq of a slot, odd (mid-write) if the slot doesn't exist
+uint32_t storeSeq(struct Bank *bank, int slot) {
+    struct AccountSlot *entry = storeSlot(bank, slot);
+    return entry == NULL ? 1 : __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+}
+
+// make every seq even again, after a writer died halfway through a slot or the store was written by a
+// version that bumped it once per write. called with every lock held (or the database to itself)
+void storeResetSeq(struct Bank *bank) {
+    for (uint32_t i = 0; i < bank->store.header->used; i++) {
+        bank->store.slots[i].seq += bank->store.slots[i].seq & 1;
+    }
+}
+
+// add a new account to a free slot, returns the slot or -1 if the file couldn't grow. called with the
+// structure lock held
+int storeInsert(struct Bank *bank, const struct Account *account) {
+    uint32_t slot;
+    struct AccountSlot *entry;
+    if (bank->store.header->freeHead != STORE_NO_SLOT) {
+        // reuse a slot released by a deleted account
+        slot = bank->store.header->freeHead;
+        entry = storeSlot(bank, (int)slot);
+        if (entry == NULL) return -1;
+        bank->store.header->freeHead = entry->nextFree;
+    } else {
+        if (bank->store.header->used == bank->store.header->capacity && !storeGrow(bank)) {
+            return -1;
+        }
+        // another handle may have grown the file without this one noticing yet
+        if (!storeRefresh(bank)) return -1;
+        slot = bank->store.header->used;
+        entry = &bank->store.slots[slot];
+    }
+
+    slotBeginWrite(entry);
+    entry->account = *account;
+    entry->state = SLOT_USED;
+    entry->nextFree = STORE_NO_SLOT;
+    slotEndWrite(entry);
+    // a new slot is only published once it is filled in
+    if (slot == bank->store.header->used) __atomic_store_n(&bank->store.header->used, slot + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&bank->store.header->count, 1, __ATOMIC_RELAXED);
+    return (int)slot;
+}
+
+// update only the balance field of an account in place
+int storeWriteBalance(struct Bank *bank, int slot, int64_t balance) {
+    struct AccountSlot *entry = storeSlot(bank, slot);
+    if (entry == NULL || entry->state != SLOT_USED) return 0;
+    slotBeginWrite(entry);
+    entry->account.balance = balance;
+    slotEndWrite(entry);
+    return 1;
+}
+
+// tombstone a slot in O(1), it stays out of use until storeReclaim() puts it back on the free list
+int storeRemove(struct Bank *bank, int slot) {
+    struct AccountSlot *entry = storeSlot(bank, slot);
+    if (entry == NULL || entry->state != SLOT_USED) return 0;
+    slotBeginWrite(entry);
+    memset(&entry->account, 0, sizeof(struct Account));
+    entry->state = SLOT_DELETED;
+    slotEndWrite(entry);
+    __atomic_sub_fetch(&bank->store.header->count, 1, __ATOMIC_RELAXED);
+    bank->store.header->deleted++;
+    return 1;
+}
+
+// move every tombstoned slot to the free list, returns the number of slots reclaimed
+int storeReclaim(struct Bank *bank) {
+    int reclaimed = 0;
+    for (uint32_t i = 0; i < bank->store.header->used; i++) {
+        if (bank->store.slots[i].state != SLOT_DELETED) continue;
+        bank->store.slots[i].state = SLOT_FREE;
+        bank->store.slots[i].nextFree = bank->store.header->freeHead;
+        bank->store.header->freeHead = i;
+        reclaimed++;
+    }
+    bank->store.header->deleted = 0;
+    return reclaimed;
+}
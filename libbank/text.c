@@ -0,0 +1,99 @@
+// --- account text format ---
+// the one-file-per-account layout the store replaced, still read by the import:
+//   Name: <name>
+//   ID: <ID>
+//   Account Number: <accountNumber>
+//   Account Type: <type>
+//   PIN: <pin>
+//   Balance: <RM with two decimals>
+// a file is read whole with one read() and split into fields in a single pass, every value is used where it
+// lies in the buffer and only copied into the account at the end. formatting builds the whole file in one
+// buffer, so it goes out with a single write
+#include "bank_internal.h"
+
+// 1 if the label before a ':' is 'label'
+int textIsLabel(const char *text, size_t length, const char *label) {
+    return length == strlen(label) && memcmp(text, label, length) == 0;
+}
+
+// copy a value into a field of 'size' bytes. a token ends at the first blank like scanf's %s, otherwise the
+// whole value is kept like %[^\n]. either way it is cut to fit
+void textCopy(char *out, size_t size, const char *value, size_t length, int token) {
+    size_t n = 0;
+    while (n < length && n < size - 1 && !(token && isspace((unsigned char)value[n]))) n++;
+    memcpy(out, value, n);
+    out[n] = '\0';
+}
+
+int parseAccountText(const char *text, size_t length, struct Account *out) {
+    memset(out, 0, sizeof(*out));
+    const char *end = text + length;
+    for (const char *line = text; line < end;) {
+        const char *lineEnd = memchr(line, '\n', (size_t)(end - line));
+        if (lineEnd == NULL) lineEnd = end;
+        const char *colon = memchr(line, ':', (size_t)(lineEnd - line));
+        if (colon != NULL) {
+            // the value starts after the blanks following the colon and ends before any '\r' or trailing blanks
+            const char *value = colon + 1, *valueEnd = lineEnd;
+            while (value < valueEnd && (*value == ' ' || *value == '\t')) value++;
+            while (valueEnd > value && isspace((unsigned char)valueEnd[-1])) valueEnd--;
+            size_t labelLength = (size_t)(colon - line), valueLength = (size_t)(valueEnd - value);
+
+            if (textIsLabel(line, labelLength, "Name")) {
+                textCopy(out->name, sizeof(out->name), value, valueLength, 0);
+            } else if (textIsLabel(line, labelLength, "ID")) {
+                textCopy(out->ID, sizeof(out->ID), value, valueLength, 1);
+            } else if (textIsLabel(line, labelLength, "Account Number")) {
+                textCopy(out->accountNumber, sizeof(out->accountNumber), value, valueLength, 1);
+            } else if (textIsLabel(line, labelLength, "Account Type")) {
+                textCopy(out->type, sizeof(out->type), value, valueLength, 0);
+            } else if (textIsLabel(line, labelLength, "PIN")) {
+                textCopy(out->pin, sizeof(out->pin), value, valueLength, 1);
+            } else if (textIsLabel(line, labelLength, "Balance") &&
+                       !parseMoneyText(value, valueLength, &out->balance)) {
+                out->balance = 0; // unreadable balances came in as zero before, too
+            }
+        }
+        line = lineEnd + 1;
+    }
+    return out->accountNumber[0] != '\0';
+}
+
+// append "<label><value>\n", the value no longer than 'size' - 1 bytes
+char *textAppend(char *out, const char *label, const char *value, size_t size) {
+    size_t n = strlen(label);
+    memcpy(out, label, n);
+    out += n;
+    n = strnlen(value, size - 1);
+    memcpy(out, value, n);
+    out += n;
+    *out++ = '\n';
+    return out;
+}
+
+size_t formatAccountText(const struct Account *account, char *out) {
+    char money[MONEY_TEXT_SIZE];
+    char *p = out;
+    p = textAppend(p, "Name: ", account->name, sizeof(account->name));
+    p = textAppend(p, "ID: ", account->ID, sizeof(account->ID));
+    p = textAppend(p, "Account Number: ", account->accountNumber, sizeof(account->accountNumber));
+    p = textAppend(p, "Account Type: ", account->type, sizeof(account->type));
+    p = textAppend(p, "PIN: ", account->pin, sizeof(account->pin));
+    p = textAppend(p, "Balance: ", formatMoney(account->balance, money), sizeof(money));
+    return (size_t)(p - out);
+}
+
+// read and parse one account file, returns 1 if it held an account
+int readAccountFile(const char *path, struct Account *out) {
+    // a file is a couple of hundred bytes, anything past the buffer isn't part of an account
+    char text[ACCOUNT_TEXT_SIZE * 2];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t length;
+    do {
+        length = read(fd, text, sizeof(text));
+    } while (length < 0 && errno == EINTR);
+    close(fd);
+    return length > 0 && parseAccountText(text, (size_t)length, out);
+}
+
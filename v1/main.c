@@ -5,27 +5,22 @@ Description:
 - For a more beautified and improved version, go to the file 'v2/main.c'
 - Total time spent on both versions: 30+ hours
 - Only native C methods listed by the assignment were used.
+- Accounts are kept in one memory-mapped binary store ('database/accounts.dat'). The old one-file-per-account layout is imported on first run, or with 'main.exe --convert'
+- This file is only the terminal UI; storing accounts and moving money is done by libbank ('libbank/bank.h')
 */
 
 #include <stdio.h>
 #include <stdlib.h> 
 #include <stdint.h>
 #include <stdbool.h> 
+#include <stddef.h>
 #include <string.h> 
 #include <ctype.h> 
 #include <time.h> 
-#include <errno.h>
 #include <limits.h>
+#include <signal.h>
 
-// Bank account structure
-struct Account {
-    char name[100];
-    char ID[13];
-    char accountNumber[13];
-    char type[10];
-    char pin[5];
-    float balance;
-};
+#include "bank.h"
 
 struct Account acc;
 
@@ -74,60 +69,20 @@ void printLine() {
     printf("---------------------------------\n");
 }
 
-int countAccounts() {
-    FILE *indexFile = fopen("database/index.txt", "r");
-    if (!indexFile) return 0;
-
-    int count = 0;
-    char number[13];
-    while (1) {
-        int result = fscanf(indexFile, "%12s", number);
-        if (result != 1) {
-            break; // when no more numbers exit
-        }
-        count++;
-    }
+// the open database, every storage operation goes through libbank
+struct Bank *bank;
 
-    fclose(indexFile);
-    return count;
+// number of live accounts
+int countAccounts() {
+    return bankCount(bank);
 }
 
-// log transactions
-void logTransaction(const char *message) {
-    FILE *transactionLog;
-
-    transactionLog = fopen("database/transaction.log", "a");
-    if (transactionLog == NULL) return;
-    time_t t = time(NULL);
-
-    char *timeStr = ctime(&t);
-    // remove newline from buffer to print on same line
-    timeStr[strcspn(timeStr, "\n")] = 0; // finds position of \\n and replaces with \\0 to end string
-
-    fprintf(transactionLog, "[%s] %s\n", timeStr, message);
-    fclose(transactionLog);
-}
+// session and transaction log, the entries are written out by libbank's log thread
+struct BankLog *transactionLog;
 
-// check if account number exists in index.txt
+// check if account number exists, using the hash index instead of scanning index.txt
 int isAccountNumberInIndex(const char* accNum) {
-    FILE *indexFile = fopen("database/index.txt", "r");
-    if (!indexFile) {
-        printf("Error: couldn't open index file.\n");
-        return 0;
-    }
-
-    char number[13];
-    int found = 0;
-    while (fscanf(indexFile, "%12s", number) == 1) {
-        // compare account numbers as string
-        if (strcmp(number, accNum) == 0) {
-            found = 1;
-            break;
-        }
-    }
-
-    fclose(indexFile);
-    return found;
+    return bankLookup(bank, accNum, NULL) == BANK_OK;
 }
 
 // verifyAccount function for delete(requireID), deposit, withdraw and remittance(account to be transferred, no ID or PIN required)
@@ -153,38 +108,20 @@ int verifyAccount(int requireID, char* returnAccountNumber) {
             }
         }
 
-        // get data of account number inputted from file to compare
-        char filename[128];
-        sprintf(filename, "database/%s.txt", accNumInput); // format account number for file directory
-
-        FILE *accFile;
-        accFile = fopen(filename, "r");
-        if (!accFile) {
+        // get data of account number inputted from the store to compare
+        struct Account stored;
+        if (bankLookup(bank, accNumInput, &stored) != BANK_OK) {
             printf("Account not found.\n");
             return 0;
         }
 
-        char storedName[100], storedPIN[5], storedID[13], typeStr[20];
-        char storedAccNum[13];
-        float balance;
-
-        // read and store account data
-        fscanf(accFile, "Name: %[^\n]\n", storedName);
-        fscanf(accFile, "ID: %12s\n", storedID);
-        fscanf(accFile, "Account Number: %12s\n", storedAccNum);
-        fscanf(accFile, "Account Type: %[^\n]\n", typeStr);
-        fscanf(accFile, "PIN: %4s\n", storedPIN);
-        fscanf(accFile, "Balance: %f\n", &balance);
-
-        fclose(accFile);
-
         if (requireID) {
             int idFound = 1;
             char last4IDs[5];
 
             // copy last 4 characters of stored ID
-            int len = strlen(storedID);
-            strncpy(last4IDs, storedID + len - 4, 4);
+            int len = strlen(stored.ID);
+            strncpy(last4IDs, stored.ID + len - 4, 4);
             last4IDs[4] = '\0';
             // verify id (compare idInput with last 4 char of ID)
             while (idFound) {
@@ -209,9 +146,9 @@ int verifyAccount(int requireID, char* returnAccountNumber) {
             }
 
             // compare pin inputted with stored pin
-            if (strcmp(pinInput, storedPIN) == 0) {
+            if (strcmp(pinInput, stored.pin) == 0) {
                 strcpy(returnAccountNumber, accNumInput); // copy account number input
-                printf("Account verified: %s", storedAccNum);
+                printf("Account verified: %s", stored.accountNumber);
                 return 1;
             } else {
                 attemptsLeft--; // if pins are not same (wrong), decrement attempt and exit if no more attempts left
@@ -228,17 +165,6 @@ int verifyAccount(int requireID, char* returnAccountNumber) {
 }
 
 // --- 1. create account functions ---
-void saveAccountNumber(const char* accountNumber) {
-    FILE *indexFile;
-    indexFile = fopen("database/index.txt", "a");
-    if (indexFile == NULL) {
-        printf("Error: couldn't open index file.\n");
-        return;
-    }
-    fprintf(indexFile, "%s\n", accountNumber);
-    fclose(indexFile);
-}
-
 void createAccount() {
     printf("\n=== Create New Account ===\n");
     printLine();
@@ -329,48 +255,23 @@ void createAccount() {
     }
     
     // account balance (default 0)
-    acc.balance = 0.0;
-
-    // generate random account number as int, then convert to string
-    srand(time(NULL));
-    int accountNumberInt;
-    char tempAccNum[13];
-    do {
-        int min = 1000000; // 7 digits
-        int max = 999999999; // 9 digits
-        accountNumberInt = min + rand() % (max + 1 - min);
-        // convert to string
-        sprintf(tempAccNum, "%d", accountNumberInt);
-    } while (isAccountNumberInIndex(tempAccNum));
-
-    // store as string
-    sprintf(acc.accountNumber, "%d", accountNumberInt);
-    saveAccountNumber(acc.accountNumber); // append to accountNumber to index.txt
-
-    // create filename based on account number
-    char filename[100];
-    sprintf(filename, "database/%s.txt", acc.accountNumber); // format to account number in file directory
-
-    FILE *accFile = fopen(filename, "w");
-    if (accFile == NULL) {
-        printf("Error. File is missing. Failed to create new account.\n");
+    acc.balance = 0;
+
+    // number the account and add it to the store
+    enum BankError result = bankCreate(bank, &acc);
+    if (result != BANK_OK) {
+        if (result == BANK_NO_NUMBERS) {
+            printf("Error. No account numbers left. Failed to create new account.\n");
+        } else if (result == BANK_JOURNAL_ERROR) {
+            printf("Error: couldn't write to the journal. Failed to create new account.\n");
+        } else if (result == BANK_STORE_FULL) {
+            printf("Error. Account store is full. Failed to create new account.\n");
+        } else {
+            printf("Error: %s. Failed to create new account.\n", bankErrorText(result));
+        }
         return;
     }
 
-    // write account info to file
-    fprintf(accFile, "Name: %s\n", acc.name);
-    fprintf(accFile, "ID: %s\n", acc.ID);
-    fprintf(accFile, "Account Number: %s\n", acc.accountNumber);  // Write as string
-    fprintf(accFile, "Account Type: %s\n", acc.type);
-    fprintf(accFile, "PIN: %s\n", acc.pin);
-    fprintf(accFile, "Balance: %.2f\n", acc.balance);
-
-    fclose(accFile);
-
-    char logs[50];
-    sprintf(logs, "Created account: %s", acc.accountNumber);
-    logTransaction(logs);
-
     printLine();
     printf("Account created successfully!\n");
     printf("Name: %s\n", acc.name);
@@ -400,24 +301,28 @@ void createAccount() {
 
 
 // --- 2. delete functions ---
+// bankListAccounts() callback for getAccounts()
+void printAccountNumber(const char *accountNumber, void *context) {
+    (void)context;
+    printf("- %s -\n", accountNumber);
+}
+
+// account numbers shown before each account prompt, the rest are one '--list' away
+#define ACCOUNTS_PAGE 10
+
 void getAccounts() {    
-    FILE *indexFile;
-    indexFile = fopen("database/index.txt", "r");
-    if (indexFile == NULL) {
-        printf("Error: couldn't open index file to retrieve account numbers.\n");
-        return;
-    }
-    
     printf("[  Saved Accounts List  ]\n");
-    char line[128];
-    while (fgets(line, sizeof(line), indexFile) != NULL) {
-        line[strcspn(line, "\n")] = 0; // replace newline '\n' with '\0'
-        printf("- %s -\n", line);
+    // only the first page, so a big book doesn't flood the screen before the prompt
+    struct BankListQuery firstPage = { NULL, NULL, NULL, NULL, ACCOUNTS_PAGE };
+    if (bankListPage(bank, &firstPage, printAccountNumber, NULL, NULL) != BANK_OK) {
+        printf("Error: couldn't retrieve account numbers.\n");
+        return;
     }
-    fclose(indexFile);
 
     // get number of accounts loaded
-    printf("No. of Accounts Loaded: %d\n", countAccounts());
+    int count = countAccounts();
+    if (count > ACCOUNTS_PAGE) printf("... and %d more ('main.exe --list' shows them all)\n", count - ACCOUNTS_PAGE);
+    printf("No. of Accounts Loaded: %d\n", count);
     printLine();
 }
 
@@ -437,65 +342,9 @@ void deleteAccount() {
         }
             
         if (tolower(confirm[0]) == 'y') {
-            // create filename string of account number e.g. 'database/1234567.txt'
-            char filename[128];
-            sprintf(filename, "database/%s.txt", accountNumber);  // Use string
-
-            FILE *accFile;
-            accFile = fopen(filename, "r");
-            // check if account file exists, if not return not found
-            if (!accFile) {
-                printf("Account not found.\n");
-                return;
-            }
-            fclose(accFile);
-
-            if (remove(filename) == 0) {
-                // since cannot directly delete files in c, read all account numbers NOT to be deleted, and write them to a different temp file
-                FILE *indexRead = fopen("database/index.txt", "r");
-                // error check
-                if (!indexRead) {
-                    printf("Error: Could not open index.txt for reading.\n");
-                    return;
-                }
-
-                FILE *indexTemp = fopen("database/temp_index.txt", "w");
-                if (!indexTemp) {
-                    printf("Error: Could not create temporary index file.\n");
-                    fclose(indexRead);  // close indexFile too because its not null (from prev error check)
-                    return;
-                }
-
-                char number[13];
-                while (fscanf(indexRead, "%12s", number) == 1) {  // Read as string
-                    // if NOT the account number to be deleted
-                    if (strcmp(number, accountNumber) != 0) {  // Compare strings
-                        // write to temporary file
-                        fprintf(indexTemp, "%s\n", number);
-                    }
-                }
-
-                fclose(indexRead);
-                fclose(indexTemp);
-
-                // remove current index.txt and replace with temp file with all accounts except the file to be deleted
-                // validation checks
-                if (remove("database/index.txt") != 0) {
-                    printf("Error: Could not remove old index file.\n");
-                    remove("database/temp_index.txt");
-                    return;
-                }
-
-                if (rename("database/temp_index.txt", "database/index.txt") != 0) {
-                    printf("Error: Could not rename temporary index file.\n");
-                    return;
-                }
-                
+            if (bankDelete(bank, accountNumber) == BANK_OK) {
                 printLine();
                 printf("Account deleted successfully\n");
-                char logs[50];
-                sprintf(logs, "Deleted account: %s", accountNumber);
-                logTransaction(logs);
                 return; 
             } else {
                 printf("Error deleting account.\n");
@@ -511,109 +360,47 @@ void deleteAccount() {
 }
 
 // getAccountBalance for withdraw and remittance
-float getAccountBalance(const char* accountNumber) {
-    char filename[128];
-    sprintf(filename, "database/%s.txt", accountNumber); 
-    FILE *accFile = fopen(filename, "r");
-    if (!accFile) return -1;
-
-    char line[256];
-    float balance = -1;
-    
-    while (fgets(line, sizeof(line), accFile)) {
-        if (strstr(line, "Balance:") != NULL) {
-            sscanf(line, "Balance: %f", &balance);
-            break;
-        }
-    }
-    
-    fclose(accFile);
-    return balance;
+// balance in sen, -1 if the account doesn't exist
+int64_t getAccountBalance(const char* accountNumber) {
+    struct Account account;
+    if (bankLookup(bank, accountNumber, &account) != BANK_OK) return -1;
+    return account.balance;
 }
 
 // --- 3/4. Deposit / Withdraw ---
-int updateBalance(char operation, float amount, const char* accountNumber, const char *receiverType) {
-    char filename[128];
-    sprintf(filename, "database/%s.txt", accountNumber);
-
-    FILE *accFile = fopen(filename, "r+"); // read and write to file
-    if (!accFile) {
+int updateBalance(char operation, int64_t amount, const char* accountNumber) {
+    int64_t newBalance;
+    enum BankError result = operation == '+' ? bankDeposit(bank, accountNumber, amount, &newBalance)
+                                             : bankWithdraw(bank, accountNumber, amount, &newBalance);
+    if (result == BANK_NOT_FOUND) {
         printf("Account not found.\n");
         return 0;
+    } else if (result == BANK_INVALID_AMOUNT) {
+        printf("Please input between RM 0 and RM 50,000 only\n");
+        return 0;
+    } else if (result == BANK_INSUFFICIENT_FUNDS) {
+        printf("Insufficient balance\n");
+        return 0;
+    } else if (result != BANK_OK) {
+        printf("Error: couldn't write to the journal. No changes were made.\n");
+        return 0;
     }
 
-    // read file
-    fscanf(accFile, "Name: %[^\n]\n", acc.name);
-    fscanf(accFile, "ID: %12s\n", acc.ID);
-    fscanf(accFile, "Account Number: %12s\n", acc.accountNumber);  // Read as string
-    fscanf(accFile, "Account Type: %[^\n]\n", acc.type);
-    fscanf(accFile, "PIN: %4s\n", acc.pin);
-    fscanf(accFile, "Balance: %f\n", &acc.balance);
-
-    float fee = 0.0;
+    printLine();
+    // only show account balance when withdrawing (for deposit, the caller shows the balance)
     if (operation == '+') {
-        // validate deposit amount between 0 and 50000
-        if (amount > 0 && amount <= 50000) {
-            acc.balance += amount;
-            printLine();
-            printf("Deposit successful.\n");
-        } else{
-            printf("Please input between RM 0 and RM 50,000 only\n");
-            fclose(accFile);
-            return 0;
-        }
-    } else if (operation == '-') {
-        // validate when remittance, percentage fee based on transfer accounts 
-        if (receiverType != NULL) {
-            if (strcmp(acc.type, "Savings") == 0 && strcmp(receiverType, "Current") == 0) {
-                fee = 0.02; // 2% fee
-            } else if (strcmp(acc.type, "Current") == 0 && strcmp(receiverType, "Savings") == 0) {
-                fee = 0.03; // 3% fee
-            } else {
-                printf("Transfer error. Transfers only allowed between different account types.\n");
-                printf("Savings --> Current (2%% fee) or Current --> Savings (3%% fee).\n");
-                printf("Same account type transfers are not permitted.\n");
-                fclose(accFile);
-                return 0; // fail
-            }
-        }
-        float totalAmount = amount + (amount * fee);
-        if (totalAmount > acc.balance) {
-            printf("Insufficient balance including remittance fee\n");
-            fclose(accFile);
-            return 0;
-        }
-
-        acc.balance -= totalAmount;
-        if (fee > 0) {
-            printf("A remittance fee of %.2f%% has been applied.\n", fee * 100);
-        }
-        printLine();
-        printf("Withdrawal/Transfer successful.\n");
-    }
-
-    // Go back to start of file
-    rewind(accFile);
-    // rewrite accFile info with new balance
-    fprintf(accFile, "Name: %s\n", acc.name);
-    fprintf(accFile, "ID: %s\n", acc.ID);
-    fprintf(accFile, "Account Number: %s\n", acc.accountNumber);
-    fprintf(accFile, "Account Type: %s\n", acc.type);
-    fprintf(accFile, "PIN: %s\n", acc.pin);
-    fprintf(accFile, "Balance: %.2f\n", acc.balance);
-    fclose(accFile);
-
-    // only show account balance if withdrawing money from own account (for deposit own account, show account balance locally)
-    // so that receiever account balance is not shown when remitting
-    if (operation == '-') {
-        printf("Your new account balance is: %.2f\n", acc.balance);
+        printf("Deposit successful.\n");
+    } else {
+        printf("Withdrawal successful.\n");
+        char money[MONEY_TEXT_SIZE];
+        printf("Your new account balance is: %s\n", formatMoney(newBalance, money));
     }
 
     return 1;
 }
 
 
-// --- 3,4,5. Deposit, Withdraw, Remittance (using updateBalance) ---
+// --- 3,4. Deposit, Withdraw (using updateBalance) ---
 void deposit() {
     printf("\n=== Deposit Amount ===\n");
     printLine();
@@ -626,16 +413,15 @@ void deposit() {
     if (getInput("How much would you like to deposit? ", amountInput, sizeof(amountInput))) {
         return;
     }
-    float amount = atof(amountInput); // convert ascii to float
+    int64_t amount;
+    if (!parseMoney(amountInput, &amount)) amount = 0; // malformed input fails the amount check
 
     // if updateBalance successful (1) then print current balance
-    if (updateBalance('+', amount, accountNumber, NULL)) {
-        float newBalance = getAccountBalance(accountNumber);
+    if (updateBalance('+', amount, accountNumber)) {
+        int64_t newBalance = getAccountBalance(accountNumber);
         if (newBalance >= 0) {
-            printf("Current Balance: RM%.2f\n", newBalance);
-            char logs[50];
-            sprintf(logs, "Deposited RM %.2f into account: %s", amount, accountNumber);
-            logTransaction(logs);
+            char money[MONEY_TEXT_SIZE];
+            printf("Current Balance: RM%s\n", formatMoney(newBalance, money));
         }
     }
 }
@@ -649,27 +435,28 @@ void withdraw() {
     if (!verifyAccount(0, accountNumber)) return; // if pin is wrong, return
 
     // get current account balance
-    float currentBalance = getAccountBalance(accountNumber);
+    int64_t currentBalance = getAccountBalance(accountNumber);
     if (currentBalance >= 0) {
-        printf("Current Balance: RM%.2f\n", currentBalance);
+        char money[MONEY_TEXT_SIZE];
+        printf("Current Balance: RM%s\n", formatMoney(currentBalance, money));
     }
     
     char amountInput[10];
     if (getInput("How much would you like to withdraw? ", amountInput, sizeof(amountInput))) {
         return;
     }
-    float amount = atof(amountInput);
-    if (updateBalance('-', amount, accountNumber, NULL)) { // update balance and print new acc balance
-        float newBalance = getAccountBalance(accountNumber);
+    int64_t amount;
+    if (!parseMoney(amountInput, &amount)) amount = 0;
+    if (updateBalance('-', amount, accountNumber)) { // update balance and print new acc balance
+        int64_t newBalance = getAccountBalance(accountNumber);
         if (newBalance >= 0) {
-            printf("Current Balance: RM%.2f", newBalance);
-            char logs[50];
-            sprintf(logs, "Withdrew RM %.2f from account: %s", amount, accountNumber);
-            logTransaction(logs);
+            char money[MONEY_TEXT_SIZE];
+            printf("Current Balance: RM%s", formatMoney(newBalance, money));
         }
     }
 }
 
+// --- 5. remittance ---
 void remittance() {
     printf("\n=== Transfer Amount ===\n");
     printLine();
@@ -685,60 +472,359 @@ void remittance() {
     if (!isAccountNumberInIndex(receiverInput)) return; // only need verify account number, not pin or ID
 
     // get current account balance
-    float currentBalance = getAccountBalance(senderAccount);
+    int64_t currentBalance = getAccountBalance(senderAccount);
     if (currentBalance >= 0) {
-        printf("Your current balance is: RM%.2f\n", currentBalance);
+        char money[MONEY_TEXT_SIZE];
+        printf("Your current balance is: RM%s\n", formatMoney(currentBalance, money));
     }
 
     char amountInput[10];
     if (getInput("How much would you like to transfer? ", amountInput, sizeof(amountInput))) {
         return;
     }
-    float amount = atof(amountInput); // convert to float
+    int64_t amount;
+    if (!parseMoney(amountInput, &amount)) amount = 0;
 
-    // get receiver type
-    char filename[128];
-    char receiverType[10];
+    // debit, fee and credit are applied together or not at all
+    int32_t feeBps;
+    int64_t newBalance;
+    enum BankError result = bankTransfer(bank, senderAccount, receiverInput, amount, &feeBps, &newBalance);
+    if (result == BANK_OK) {
+        char money[MONEY_TEXT_SIZE];
+        printf("A remittance fee of %d.%02d%% has been applied.\n", feeBps / 100, feeBps % 100);
+        printLine();
+        printf("Your new account balance is: %s\n", formatMoney(newBalance, money));
+        printf("Transfer completed successfully!\n");
+    } else {
+        if (result == BANK_NOT_FOUND) {
+            printf("Recipient account not found.\n");
+        } else if (result == BANK_SAME_TYPE) {
+            printf("Transfer error. Transfers only allowed between different account types.\n");
+            printf("Savings --> Current (2%% fee) or Current --> Savings (3%% fee).\n");
+            printf("Same account type transfers are not permitted.\n");
+        } else if (result == BANK_INVALID_AMOUNT) {
+            printf("Please input between RM 0 and RM 50,000 only\n");
+        } else if (result == BANK_INSUFFICIENT_FUNDS) {
+            printf("Insufficient balance including remittance fee\n");
+        } else {
+            printf("Error: couldn't write to the journal.\n");
+        }
+        printf("Transfer failed. No changes were made.\n");
+    }
+}
 
-    sprintf(filename, "database/%s.txt", receiverInput);
-    FILE *file; 
-    file = fopen(filename, "r");
-    if (!file) {
-        printf("Recipient account file not found.\n");
+// --- 6. search by name ---
+// best matches shown for a name search
+#define SEARCH_RESULTS 10
+
+void searchByName() {
+    printf("\n=== Search by Name ===\n");
+    printLine();
+
+    char query[100];
+    if (getInput("Enter the account holder's name, or part of it: ", query, sizeof(query))) {
         return;
     }
 
-    // read only receiverType in file
-    char line[256];
-    while (fgets(line, sizeof(line), file)) {
-        if (strstr(line, "Account Type:") != NULL) {
-            sscanf(line, "Account Type: %[^\n]", receiverType);
-            break;
-        }
+    // close spellings match too, best match first
+    struct BankNameMatch matches[SEARCH_RESULTS];
+    int found;
+    enum BankError result = bankSearchNames(bank, query, matches, SEARCH_RESULTS, &found);
+    if (result != BANK_OK) {
+        printf("Error: couldn't search the names: %s.\n", bankErrorText(result));
+        return;
+    }
+    if (found == 0) {
+        printf("No account holder's name matches '%s'.\n", query);
+        return;
+    }
+    printf("%-12s %-50s %s\n", "Account", "Name", "Match");
+    for (int i = 0; i < found; i++) {
+        printf("%-12s %-50.50s %3d%%\n", matches[i].accountNumber, matches[i].name, matches[i].score);
     }
-    fclose(file);
+}
 
-    // validate updateBalance and pass receiverType to compare with senderType for remittance fee
-    if (updateBalance('-', amount, senderAccount, receiverType)) {
-        // only update receiver account if sender account was successful updated
-        if (updateBalance('+', amount, receiverInput, NULL)) {
-            printLine();
-            printf("Transfer completed successfully!\n");
-            char logs[50];
-            sprintf(logs, "Transfer from account: %s to %s", senderAccount, receiverInput);
-            logTransaction(logs);
-        }
-    } else {
-        printf("Transfer failed. No changes were made.\n");
+// --- batch mode ---
+// 'main.exe --batch=<file>' runs a file of transactions without the menu, one per line:
+//   create <savings|current> <ID> <PIN> <full name>
+//   deposit <account> <amount>
+//   withdraw <account> <amount>
+//   transfer <from account> <to account> <amount>
+// blank lines and lines starting with '#' are skipped. every record goes through the same checks as the
+// menu and gets one line in the result file. see bankRunBatch() in libbank for how it is executed
+int runBatch(const char *inputPath, const char *outputPath) {
+    struct BankBatchStats stats;
+    enum BankError result = bankRunBatch(bank, inputPath, outputPath, &stats);
+    if (result == BANK_IO_ERROR && stats.records == 0) {
+        printf("Error: couldn't read batch file '%s' or write result file '%s'.\n", inputPath, outputPath);
+        return 0;
+    } else if (result != BANK_OK) {
+        printf("Error: batch stopped after %lu record(s): %s.\n", stats.records, bankErrorText(result));
+    }
+    printf("Batch: %lu record(s), %lu succeeded, %lu failed in %.3f s (%.0f records/s, %lu journal sync(s))\n",
+           stats.records, stats.succeeded, stats.records - stats.succeeded, stats.seconds,
+           stats.seconds > 0 ? stats.records / stats.seconds : 0.0, stats.syncs);
+    printf("Schedule: %.1f independent records per wave, %d worker thread(s)\n",
+           stats.waves > 0 ? (double)stats.records / stats.waves : 0.0, stats.workers);
+    printf("Results written to %s\n", outputPath);
+
+    bankLogEvent(transactionLog, BANK_LOG_BATCH, NULL, NULL, (int64_t)stats.records, 0,
+                 (int64_t)stats.succeeded);
+    return result == BANK_OK;
+}
+
+// --- history (--history) ---
+// parse "YYYY-MM-DD" as the first (or with 'endOfDay', the last) second of that local day
+int parseDate(const char *text, int endOfDay, int64_t *out) {
+    int year, month, day;
+    char extra;
+    if (sscanf(text, "%d-%d-%d%c", &year, &month, &day, &extra) != 3) return 0;
+    struct tm date;
+    memset(&date, 0, sizeof(date));
+    date.tm_year = year - 1900;
+    date.tm_mon = month - 1;
+    date.tm_mday = day + (endOfDay ? 1 : 0);
+    date.tm_isdst = -1;
+    time_t t = mktime(&date);
+    if (t == (time_t)-1) return 0;
+    *out = (int64_t)t - (endOfDay ? 1 : 0);
+    return 1;
+}
+
+void printHistoryRecord(const struct BankLogRecord *record, void *context) {
+    (void)context;
+    char when[32], amount[MONEY_TEXT_SIZE], fee[MONEY_TEXT_SIZE], balance[MONEY_TEXT_SIZE];
+    time_t t = (time_t)record->time;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    const char *event = bankLogEventText(record->event);
+    switch (record->event) {
+    case BANK_LOG_CREATE:
+    case BANK_LOG_DELETE:
+    case BANK_LOG_DEPOSIT:
+    case BANK_LOG_WITHDRAW:
+    case BANK_LOG_TRANSFER:
+        printf("%s  %-16s %-12s %-12s %12s %10s %12s\n", when, event, record->account, record->other,
+               formatMoney(record->amount, amount), formatMoney(record->fee, fee), formatMoney(record->balance, balance));
+        break;
+    case BANK_LOG_BATCH:
+        printf("%s  %-16s %lld record(s), %lld succeeded\n", when, event, (long long)record->amount,
+               (long long)record->balance);
+        break;
+    default:
+        printf("%s  %s\n", when, event);
     }
 }
 
-int main() {
+// print every logged event of 'accountNumber' (NULL for all) between two dates, oldest first
+int runHistory(const char *accountNumber, int64_t from, int64_t to) {
+    printf("%-19s  %-16s %-12s %-12s %12s %10s %12s\n", "Time", "Event", "Account", "To account", "Amount (RM)",
+           "Fee (RM)", "Balance (RM)");
+    enum BankError result = bankHistory("database", accountNumber, from, to, printHistoryRecord, NULL);
+    if (result != BANK_OK) {
+        printf("Error: couldn't read the history: %s.\n", bankErrorText(result));
+        return 0;
+    }
+    return 1;
+}
+
+// --- account list (--list) ---
+// print the account numbers starting with 'prefix' (NULL for all) after 'after', 'limit' of them (0 for all),
+// in ascending order. a page that stops early ends with the option that continues it
+int runList(const char *prefix, const char *after, int limit) {
+    struct BankListQuery query = { prefix, NULL, NULL, after, limit };
+    char next[13];
+    enum BankError result = bankListPage(bank, &query, printAccountNumber, NULL, next);
+    if (result != BANK_OK) {
+        printf("Error: couldn't list the accounts: %s.\n", bankErrorText(result));
+        return 0;
+    }
+    if (next[0] != '\0') printf("More accounts follow, continue with --after=%s\n", next);
+    return 1;
+}
+
+// --- accounts of a customer (--customer) ---
+void printCustomerAccount(const char *accountNumber, void *context) {
+    int *found = context;
+    struct Account account;
+    char money[MONEY_TEXT_SIZE];
+    // skipped if it was deleted since it was listed
+    if (bankLookup(bank, accountNumber, &account) != BANK_OK) return;
+    printf("%s  %-7s  %-30s  RM%s\n", account.accountNumber, account.type, account.name,
+           formatMoney(account.balance, money));
+    (*found)++;
+}
+
+// print every account opened with customer ID 'ID': number, type, name and balance
+int runCustomer(const char *ID) {
+    int found = 0;
+    enum BankError result = bankCustomerAccounts(bank, ID, printCustomerAccount, &found);
+    if (result != BANK_OK) {
+        printf("Error: couldn't list the accounts of customer '%s': %s.\n", ID, bankErrorText(result));
+        return 0;
+    }
+    if (found == 0) printf("No accounts for customer %s\n", ID);
+    return 1;
+}
+
+// set by Ctrl+C (or SIGTERM) to stop --serve
+volatile sig_atomic_t stopServing = 0;
+
+void handleStopSignal(int signalNumber) {
+    (void)signalNumber;
+    stopServing = 1;
+}
+
+// answer menus started with --connect until Ctrl+C, they all share this process's open database
+int runServer(const char *socketPath) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("Serving the database on %s, press Ctrl+C to stop.\n", socketPath);
+    fflush(stdout);
+    bankLogEvent(transactionLog, BANK_LOG_SERVER_START, NULL, NULL, 0, 0, 0);
+    if (bankServe(bank, socketPath, 0, &stopServing) != BANK_OK) {
+        printf("Error: couldn't serve on '%s', is another server already running?\n", socketPath);
+        return 0;
+    }
+    printf("Server stopped.\n");
+    bankLogEvent(transactionLog, BANK_LOG_SERVER_STOP, NULL, NULL, 0, 0, 0);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
     time_t t = time(NULL);
     char* timeStr = ctime(&t);
     timeStr[strcspn(timeStr, "\n")] = 0; // remove newline
 
-    logTransaction("Session Start");
+    // command line options, the durability level can also come from BANK_DURABILITY
+    int convertOnly = 0;
+    int compactOnly = 0;
+    int checkpointOnly = 0;
+    const char *batchInput = NULL;
+    const char *batchOutput = NULL;
+    const char *serveSocket = NULL;
+    const char *connectSocket = NULL;
+    int showHistory = 0;
+    const char *historyAccount = NULL;
+    int64_t historyFrom = INT64_MIN;
+    int64_t historyTo = INT64_MAX;
+    int showList = 0;
+    const char *listPrefix = NULL;
+    const char *listAfter = NULL;
+    int listLimit = 0;
+    const char *customerID = NULL;
+    const char *defaultSocket = "database/" BANK_SOCKET_FILE;
+    enum BankDurability durability = BANK_DURABILITY_BATCH;
+    const char *durabilityEnv = getenv("BANK_DURABILITY");
+    if (durabilityEnv != NULL && !bankParseDurability(durabilityEnv, &durability)) {
+        printf("Unknown BANK_DURABILITY '%s', expected none, batch or op.\n", durabilityEnv);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--convert") == 0) {
+            convertOnly = 1; // re-run the import of database/<accountNumber>.txt files and exit
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            compactOnly = 1; // reclaim deleted accounts now and exit
+        } else if (strcmp(argv[i], "--checkpoint") == 0) {
+            checkpointOnly = 1; // write a snapshot now and exit
+        } else if (strncmp(argv[i], "--batch=", 8) == 0) {
+            batchInput = argv[i] + 8; // run a transaction file and exit
+        } else if (strncmp(argv[i], "--batch-out=", 12) == 0) {
+            batchOutput = argv[i] + 12;
+        } else if (strcmp(argv[i], "--serve") == 0 || strncmp(argv[i], "--serve=", 8) == 0) {
+            serveSocket = argv[i][7] == '=' ? argv[i] + 8 : defaultSocket; // serve other menus until Ctrl+C
+        } else if (strcmp(argv[i], "--connect") == 0 || strncmp(argv[i], "--connect=", 10) == 0) {
+            connectSocket = argv[i][9] == '=' ? argv[i] + 10 : defaultSocket; // use a running server's database
+        } else if (strcmp(argv[i], "--history") == 0 || strncmp(argv[i], "--history=", 10) == 0) {
+            showHistory = 1; // print logged events and exit, of one account or of all
+            historyAccount = argv[i][9] == '=' ? argv[i] + 10 : NULL;
+        } else if (strncmp(argv[i], "--from=", 7) == 0 && parseDate(argv[i] + 7, 0, &historyFrom)) {
+            continue; // first day --history shows
+        } else if (strncmp(argv[i], "--to=", 5) == 0 && parseDate(argv[i] + 5, 1, &historyTo)) {
+            continue; // last day --history shows
+        } else if (strcmp(argv[i], "--list") == 0 || strncmp(argv[i], "--list=", 7) == 0) {
+            showList = 1; // print account numbers in order and exit, all or those starting with a prefix
+            listPrefix = argv[i][6] == '=' ? argv[i] + 7 : NULL;
+        } else if (strncmp(argv[i], "--after=", 8) == 0) {
+            listAfter = argv[i] + 8; // --list starts after this account number
+        } else if (strncmp(argv[i], "--limit=", 8) == 0 && atoi(argv[i] + 8) > 0) {
+            listLimit = atoi(argv[i] + 8); // --list prints this many at most
+        } else if (strncmp(argv[i], "--customer=", 11) == 0) {
+            customerID = argv[i] + 11; // print a customer's accounts and exit
+        } else if (strncmp(argv[i], "--durability=", 13) != 0 || !bankParseDurability(argv[i] + 13, &durability)) {
+            printf("Usage: main.exe [--convert] [--compact] [--checkpoint] [--batch=<file> [--batch-out=<file>]]\n"
+                   "                [--durability=none|batch|op] [--serve[=<socket>] | --connect[=<socket>]]\n"
+                   "                [--history[=<account>] [--from=YYYY-MM-DD] [--to=YYYY-MM-DD]]\n"
+                   "                [--list[=<prefix>] [--after=<account>] [--limit=N]] [--customer=<ID>]\n");
+            return 1;
+        }
+    }
+
+    // open the account store (rebuilding it from the last snapshot if it is damaged) and its index, replay
+    // the journal records the store doesn't have yet, and import the old per-account text files the first
+    // time the store is created. with --connect the menu talks to a server instead, which has all of that open
+    if (connectSocket != NULL) {
+        if (bankConnect(connectSocket, &bank) != BANK_OK) {
+            printf("Error: couldn't connect to a server on '%s'.\n", connectSocket);
+            return 1;
+        }
+    } else {
+        enum BankError opened = bankOpen("database", durability, &bank);
+        if (opened != BANK_OK) {
+            printf("Error: couldn't open the database: %s.\n", bankErrorText(opened));
+            return 1;
+        }
+    }
+    // without the log file the bank still works, the events just aren't recorded
+    if (bankLogOpen("database", &transactionLog) != BANK_OK) transactionLog = NULL;
+    // libbank logs every change made through the handle, this program only adds session events
+    bankSetLog(bank, transactionLog);
+
+    if (serveSocket != NULL && connectSocket == NULL) {
+        int served = runServer(serveSocket);
+        bankLogClose(transactionLog);
+        bankClose(bank);
+        return served ? 0 : 1;
+    }
+
+    if (convertOnly || compactOnly || checkpointOnly || batchInput != NULL || showHistory || showList ||
+        customerID != NULL) {
+        int status = 0;
+        if (batchInput != NULL) {
+            // results go next to the input unless --batch-out says otherwise
+            char defaultOutput[PATH_MAX];
+            if (batchOutput == NULL) {
+                snprintf(defaultOutput, sizeof(defaultOutput), "%s.out", batchInput);
+                batchOutput = defaultOutput;
+            }
+            if (!runBatch(batchInput, batchOutput)) status = 1;
+        }
+        if (convertOnly) printf("Imported %d account(s) into database/accounts.dat\n", bankImportLegacy(bank));
+        if (compactOnly) {
+            uint32_t reclaimed;
+            if (bankCompact(bank, &reclaimed) == BANK_OK) {
+                printf("Reclaimed %u deleted account(s)\n", reclaimed);
+            } else {
+                printf("Error: compaction failed\n");
+            }
+        }
+        if (showHistory && !runHistory(historyAccount, historyFrom, historyTo)) status = 1;
+        if (showList && !runList(listPrefix, listAfter, listLimit)) status = 1;
+        if (customerID != NULL && !runCustomer(customerID)) status = 1;
+        if (checkpointOnly) {
+            printf(bankCheckpoint(bank) == BANK_OK ? "Snapshot written to database/snapshot.dat\n"
+                                                   : "Error: couldn't write database/snapshot.dat\n");
+        }
+        bankLogClose(transactionLog);
+        bankClose(bank);
+        return status;
+    }
+
+    bankLogEvent(transactionLog, BANK_LOG_SESSION_START, NULL, NULL, 0, 0, 0);
     printf("\n=== Welcome to the official Bank System! ===\n");
     printf("\nSession start: %s\n", timeStr);
     printf("No. of Accounts Loaded: %d\n", countAccounts());
@@ -748,13 +834,14 @@ int main() {
     while (running) {
         printf("\n=== Main Menu ===\n");
         printLine();
-        printf("Please choose an option (1-6):\n");
+        printf("Please choose an option (1-7):\n");
         printf("1. Create Account\n");
         printf("2. Delete Account\n");
         printf("3. Deposit\n");
         printf("4. Withdraw\n");
         printf("5. Remittance\n");
-        printf("6. Exit\n");
+        printf("6. Search by Name\n");
+        printf("7. Exit\n");
         printf("Tip: Press 'q' to exit and return to main menu.\n");
         printLine();
 
@@ -779,14 +866,19 @@ int main() {
             withdraw();
         } else if (strcmp(choice, "5") == 0 || strcmp(choice, "remittance") == 0) {
             remittance();
-        } else if (strcmp(choice, "6") == 0 || strcmp(choice, "exit") == 0) {
+        } else if (strcmp(choice, "6") == 0 || strcmp(choice, "search") == 0) {
+            searchByName();
+        } else if (strcmp(choice, "7") == 0 || strcmp(choice, "exit") == 0) {
             printf("Thank you for using our service. Please come again next time... BYE!\n");
-            logTransaction("Session ended");
+            bankLogEvent(transactionLog, BANK_LOG_SESSION_END, NULL, NULL, 0, 0, 0);
             break;
         } else {
             printf("Invalid choice. Please try again.\n");
         }
     }
 
+    // compacts first if enough accounts were deleted
+    bankLogClose(transactionLog);
+    bankClose(bank);
     return 0;
 }
\ No newline at end of file